@@ -0,0 +1,41 @@
+#ifndef ANNOTATION_TOOLS_AI_CACHE_H_
+#define ANNOTATION_TOOLS_AI_CACHE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <json-c/json.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ai_cache: on-disk cache of ai-server results.
+ *   key: 128-bit hash of the image bytes, seeded with the server url and the model version,
+ *   one <key>.json file per entry, the mtime is the LRU clock,
+ *   the least recently used entries are evicted when the total size exceeds max_size.
+ */
+#define AI_CACHE_KEY_SIZE (33)	// 32 hex digits + '\0'
+
+typedef struct ai_cache
+{
+	char * path;
+	int64_t max_size;
+	int64_t total_size;		// bytes of the cached results
+	pthread_mutex_t lock;	// store() and evict(): used from the main loop and the ai client's workers
+
+	json_object * (* lookup)(struct ai_cache * cache, const char * key);	// NULL: miss
+	int (* store)(struct ai_cache * cache, const char * key, json_object * jresult);
+}ai_cache_t;
+
+ai_cache_t * ai_cache_new(const char * path, int64_t max_size);	// path: NULL ==> $XDG_CACHE_HOME/annotation-tools/ai
+void ai_cache_free(ai_cache_t * cache);
+
+void ai_cache_make_key(char key[static AI_CACHE_KEY_SIZE], const void * image_data, size_t cb_image,
+	const char * server_url, const char * model_version);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,142 @@
+#ifndef ANNOTATION_TOOLS_AI_CLIENT_
+#define ANNOTATION_TOOLS_AI_CLIENT_
+
+#include <stdio.h>
+#include <json-c/json.h>
+#include "ai-cache.h"
+#include "ai-detections.h"
+#include "ai-postprocess.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ai_client: opaque, configured and used through the functions below.
+ * ai_request_t: an async prediction, owned by the client (see ai_client_cancel()).
+ */
+struct ai_client;
+typedef struct ai_request ai_request_t;
+
+/*
+ * ai_request_stats: timing of one request (ms), including its retries
+ */
+typedef struct ai_request_stats
+{
+	double queue_time;		// queued ==> sent, waiting for a free connection
+	double rtt;				// request written ==> response headers received
+	double server_time;		// sum of the Server-Timing durations, < 0: not reported
+	double total_time;
+	int attempts;
+	unsigned int status_code;
+}ai_request_stats_t;
+
+/*
+ * ai_tile_stats: one tile of a tiled prediction (ms)
+ */
+typedef struct ai_tile_stats
+{
+	int index;
+	int num_tiles;
+	int x, y, width, height;	// in the image
+	double queue_time;		// cut ==> picked up by a tile thread
+	double encode_time;		// letterbox and jpeg
+	double predict_time;	// request(s) or ipc call
+	int num_detections;
+	int rc;
+}ai_tile_stats_t;
+
+/*
+ * ai_predict_callback: called on the main loop when an async request completes,
+ *   rc: 0 on success, jresult is owned by the client (valid during the call only).
+ *   Not called for cancelled requests.
+ */
+typedef void (*ai_predict_callback)(struct ai_client *client, int rc, json_object *jresult, void *user_data);
+typedef void (*ai_detections_callback)(struct ai_client *client, int rc, const ai_detections_t *detections, void *user_data);
+
+typedef struct ai_image
+{
+	const void *data;	// jpeg or png file content
+	size_t size;
+}ai_image_t;
+
+/*
+ * ai_client_options: the settings of a client, read and written as a whole.
+ *   Versioned by its size: the caller passes sizeof(ai_client_options_t) as it was compiled,
+ *   new fields are only appended and keep their current values for older callers.
+ *   Set them before the first prediction.
+ */
+typedef struct ai_client_options
+{
+	// transport: failed requests (connection errors, 429, 502 ~ 504) are retried
+	// after an exponential backoff with full jitter: random(0, retry_base_ms * 2^attempt)
+	int max_connections;	// also the number of requests in flight, default 4
+	int timeout;			// seconds, default 30
+	int max_retries;		// default 2
+	int retry_base_ms;		// default 200
+	int eject_ms;			// a replica is skipped this long after consecutive failures, default 10000
+	size_t ipc_ring_size;	// shared memory of a "unix:" endpoint added afterwards, default 64 MB
+	
+	// > 0: images larger than input_size x input_size are decoded at a reduced scale,
+	// letterboxed and re-encoded as jpeg before upload (the model input size)
+	int input_size;
+	int jpeg_quality;		// of the re-encoded image, default 90
+	
+	// > 0: predict_detections*() cuts images larger than tile_size x tile_size into overlapping tiles
+	// (tile_overlap: fraction of tile_size, default 0.2), tile_concurrency of them are predicted 
+	// at a time (default 4), the boxes are mapped back to the image and merged (nms)
+	int tile_size;
+	double tile_overlap;
+	int tile_concurrency;
+	
+	void (*on_stats)(struct ai_client *client, const ai_request_stats_t *stats);	// optional, after every request
+	void (*on_tile_stats)(struct ai_client *client, const ai_tile_stats_t *stats);	// optional, called from the tile threads
+}ai_client_options_t;
+
+struct ai_client *ai_client_new(void *user_data);
+void ai_client_free(struct ai_client *client);	// cancels the pending requests, waits for the workers
+void *ai_client_get_user_data(const struct ai_client *client);
+
+void ai_client_get_options(const struct ai_client *client, ai_client_options_t *options, size_t size);
+int ai_client_set_options(struct ai_client *client, const ai_client_options_t *options, size_t size);
+
+// optional: results of previously seen images (taken over, freed with the client), 
+// the model version is part of the cache key
+void ai_client_set_cache(struct ai_client *client, ai_cache_t *cache);
+int ai_client_set_model_version(struct ai_client *client, const char *model_version);
+// optional, not owned: applied to the results of predict_detections*(), after the cache (which keeps the raw results)
+void ai_client_set_postprocess(struct ai_client *client, const ai_postprocess_t *postprocess);
+
+// replicas of the server: set_url() replaces them with one, add_endpoint() appends,
+// every attempt of a request is routed to one of them (least ewma latency x outstanding);
+// "unix:/path": a server on the same machine, decoded pixels are passed through
+// shared memory (ai-ipc.h) instead of http, used for every request when set
+int ai_client_set_url(struct ai_client *client, const char *server_url);
+int ai_client_add_endpoint(struct ai_client *client, const char *url);
+int ai_client_load_endpoints(struct ai_client *client, json_object *jurls);	// a url or an array of urls
+const char *ai_client_get_url(const struct ai_client *client);	// the first endpoint
+int ai_client_get_num_endpoints(const struct ai_client *client);	// http replicas
+const char *ai_client_get_endpoint_url(const struct ai_client *client, int index);
+void ai_client_get_stats(const struct ai_client *client, long *num_requests, long *num_retries, long *num_failures);
+
+int ai_client_predict(struct ai_client *client, const void *image_data, size_t cb_image, json_object **p_jresult);
+
+// several images in one request, results[i] (json_object_put() each) is NULL for an image that failed,
+// returns 0 when every image has a result
+int ai_client_predict_batch(struct ai_client *client, const ai_image_t *images, size_t num_images, json_object **results);
+
+// async: queued on the session, the request is freed after its completion or cancel()
+ai_request_t *ai_client_predict_async(struct ai_client *client, const void *image_data, size_t cb_image, 
+	ai_predict_callback callback, void *user_data);
+void ai_client_cancel(struct ai_client *client, ai_request_t *request);
+
+// the detections only, parsed without building a json tree (large responses): 
+// as the body arrives for the async request, the buffer passed to the callback is owned by the request
+int ai_client_predict_detections(struct ai_client *client, const void *image_data, size_t cb_image, ai_detections_t *detections);
+ai_request_t *ai_client_predict_detections_async(struct ai_client *client, const void *image_data, size_t cb_image, 
+	ai_detections_callback callback, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
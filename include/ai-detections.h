@@ -0,0 +1,95 @@
+#ifndef ANNOTATION_TOOLS_AI_DETECTIONS_H_
+#define ANNOTATION_TOOLS_AI_DETECTIONS_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <json-c/json.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ai_detections: flat buffer of the boxes of one prediction
+ */
+typedef struct ai_detection
+{
+	int class_index;
+	double score;			// 1.0 if not reported
+	double left;			// normalized to the image
+	double top;
+	double width;
+	double height;
+}ai_detection_t;
+
+typedef struct ai_detections
+{
+	ssize_t max_size;
+	ssize_t length;
+	ai_detection_t *data;
+}ai_detections_t;
+void ai_detections_reset(ai_detections_t *detections);		// length = 0, the memory is kept
+void ai_detections_clear(ai_detections_t *detections);		// frees the memory
+int ai_detections_append(ai_detections_t *detections, const ai_detection_t *detection);
+
+// { "detections": [ ... ] } <==> buffer, for the cache and the json based apis
+json_object *ai_detections_to_json(const ai_detections_t *detections);
+int ai_detections_from_json(ai_detections_t *detections, json_object *jresult);
+
+/*
+ * ai_detections_parser: incremental parser of an ai-server response,
+ *   { "detections": [ { "class_index", "score", "left", "top", "width", "height" }, ... ], ... }
+ *
+ *   Fed with the bytes as they arrive (chunks may split any token), every detection is appended
+ *   to the buffer as soon as its object is closed; no json tree is built.
+ *   Other keys and nested values are validated and skipped.
+ */
+#define AI_DETECTIONS_PARSER_MAX_DEPTH	(64)
+#define AI_DETECTIONS_PARSER_TOKEN_SIZE	(64)
+
+typedef struct ai_detections_parser
+{
+	ai_detections_t *detections;	// not owned
+
+	int error;						// sticky, feed() returns -1 once set
+	int state;						// expected next token
+	int lex;						// token being read
+	int done;						// the root value is complete
+
+	int depth;
+	char stack[AI_DETECTIONS_PARSER_MAX_DEPTH];		// '{' or '['
+
+	char token[AI_DETECTIONS_PARSER_TOKEN_SIZE];	// current string (truncated) or literal
+	int token_length;
+	int unicode_digits;
+	
+	struct {						// current number, read digit by digit: no length limit
+		int state;
+		int negative;
+		int digits;					// significant digits kept in 'mantissa'
+		double mantissa;
+		int exponent;				// decimal exponent of 'mantissa'
+		int exp_negative;
+		int exp;					// the e+nn part
+		double value;
+	}number;
+
+	int has_detections;				// the root object has a "detections" array
+	int detections_depth;			// > 0: depth of the "detections" array
+	int is_detections_key;
+	int field;						// of the current detection
+	ai_detection_t current;
+}ai_detections_parser_t;
+
+ai_detections_parser_t *ai_detections_parser_init(ai_detections_parser_t *parser, ai_detections_t *detections);
+void ai_detections_parser_reset(ai_detections_parser_t *parser);	// parse a new document into the same buffer
+int ai_detections_parser_feed(ai_detections_parser_t *parser, const char *data, size_t length);	// -1: invalid json
+int ai_detections_parser_finish(ai_detections_parser_t *parser);	// 0: a complete document with a "detections" array
+
+// the whole document at once
+int ai_detections_parse(ai_detections_t *detections, const char *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,111 @@
+#ifndef ANNOTATION_TOOLS_AI_IPC_H_
+#define ANNOTATION_TOOLS_AI_IPC_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <json-c/json.h>
+#include "img_proc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ai_ipc: transport to an inference server on the same machine.
+ *
+ *   The client owns a shared-memory ring (memfd), its fd is passed to the server once (HELLO, SCM_RIGHTS).
+ *   Decoded pixels are written into the ring, a PREDICT message over the unix socket tells the server
+ *   where they are; the server answers with a RESULT record per image, in the order of the requests.
+ *   No image bytes go through the socket, no http, no json.
+ *
+ *   message: ai_ipc_header_t + payload (header.length bytes), little-endian, host layout
+ *     HELLO   client ==> server: ai_ipc_hello_t, the memfd attached
+ *     PREDICT client ==> server: ai_ipc_image_t
+ *     RESULT  server ==> client: ai_ipc_result_t + ai_ipc_detection_t[num_detections]
+ *
+ *   url of an ai_client endpoint: "unix:/path/to/socket"
+ */
+#define AI_IPC_MAGIC		(0x50494941)	// "AIIP"
+#define AI_IPC_URL_PREFIX	"unix:"
+#define AI_IPC_MAX_DETECTIONS	(4096)
+
+enum ai_ipc_msg_type
+{
+	AI_IPC_HELLO = 1,
+	AI_IPC_PREDICT = 2,
+	AI_IPC_RESULT = 3,
+};
+
+typedef struct ai_ipc_header
+{
+	uint32_t magic;
+	uint32_t type;
+	uint32_t id;		// PREDICT: chosen by the client, echoed by the RESULT
+	uint32_t length;	// of the payload
+}ai_ipc_header_t;
+
+typedef struct ai_ipc_hello
+{
+	uint64_t ring_size;
+}ai_ipc_hello_t;
+
+enum ai_ipc_pixel_format
+{
+	AI_IPC_FORMAT_BGRA8 = 0,
+};
+
+typedef struct ai_ipc_image
+{
+	uint64_t offset;	// in the ring
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t format;
+}ai_ipc_image_t;
+
+typedef struct ai_ipc_result
+{
+	int32_t status;		// 0: ok
+	uint32_t num_detections;
+}ai_ipc_result_t;
+
+typedef struct ai_ipc_detection
+{
+	int32_t class_index;
+	float score;
+	float left;			// normalized to the image
+	float top;
+	float width;
+	float height;
+}ai_ipc_detection_t;
+
+// message i/o, shared by the client and the servers
+int ai_ipc_send_msg(int sock, uint32_t type, uint32_t id, const void *payload, uint32_t length, int pass_fd);	// pass_fd: -1 ==> none
+int ai_ipc_recv_msg(int sock, ai_ipc_header_t *header, void *payload, uint32_t max_length, int *p_fd);		// p_fd: NULL ==> none
+
+typedef struct ai_ipc_client
+{
+	char *socket_path;
+	int sock;			// -1: not connected, (re)connected on demand
+	unsigned char *ring;
+	size_t ring_size;
+	int timeout;		// seconds per send / receive, 0: none
+	pthread_mutex_t mutex;
+}ai_ipc_client_t;
+
+ai_ipc_client_t *ai_ipc_client_new(const char *socket_path, size_t ring_size);
+void ai_ipc_client_free(ai_ipc_client_t *ipc);
+void ai_ipc_client_set_timeout(ai_ipc_client_t *ipc, int timeout);	// a stalled server fails the prediction
+
+/*
+ * ai_ipc_predict(): results[i] = { "detections": [ { class_index, score, left, top, width, height }, ... ] },
+ *   NULL for a failed image, returns 0 when every image has a result.
+ *   The images are pipelined: as many as fit into the ring are sent before the results are read.
+ */
+int ai_ipc_predict(ai_ipc_client_t *ipc, const bgra_image_t **images, size_t num_images, json_object **results);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
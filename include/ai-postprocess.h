@@ -0,0 +1,61 @@
+#ifndef ANNOTATION_TOOLS_AI_POSTPROCESS_H_
+#define ANNOTATION_TOOLS_AI_POSTPROCESS_H_
+
+#include <stdio.h>
+#include <json-c/json.h>
+#include "ai-detections.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ai_postprocess: applied to the detections before they are written to the labels
+ *   1. score thresholds (per class)
+ *   2. overlapping boxes merged: greedy nms, or weighted box fusion (wbf)
+ *   3. the max_detections best are kept
+ *
+ * Both merges sort the boxes (class, score) first and only compare a box with the boxes already
+ * kept / fused of its class, 4 at a time (sse2).
+ */
+enum ai_merge_mode
+{
+	AI_MERGE_NONE,
+	AI_MERGE_NMS,
+	AI_MERGE_WBF,
+};
+
+typedef struct ai_postprocess
+{
+	double score_threshold;		// default 0: everything
+	double *class_thresholds;	// optional, [num_classes], < 0: score_threshold
+	int num_classes;
+
+	int merge;					// enum ai_merge_mode, default nms
+	double iou_threshold;		// default 0.5
+	int class_agnostic;			// boxes of different classes are merged too
+	int max_detections;			// 0: unlimited
+}ai_postprocess_t;
+
+ai_postprocess_t *ai_postprocess_init(ai_postprocess_t *pp);
+void ai_postprocess_cleanup(ai_postprocess_t *pp);
+
+// "ai-score-threshold", "ai-class-thresholds" (array), "ai-merge" ("nms", "wbf", "none"),
+// "ai-iou-threshold", "ai-class-agnostic", "ai-max-detections"
+int ai_postprocess_load(ai_postprocess_t *pp, json_object *jconfig);
+int ai_postprocess_parse_merge(const char *name);	// -1: unknown
+
+int ai_postprocess_apply(const ai_postprocess_t *pp, ai_detections_t *detections);
+
+// ensemble: the responses of several models (thresholded in place) fused into one list (wbf)
+int ai_postprocess_apply_ensemble(const ai_postprocess_t *pp, ai_detections_t *fused, ai_detections_t *lists, int num_lists);
+
+// building blocks: nms and fuse return the boxes sorted by score, threshold keeps the order
+ssize_t ai_detections_threshold(ai_detections_t *detections, const ai_postprocess_t *pp);
+ssize_t ai_detections_nms(ai_detections_t *detections, double iou_threshold, int class_agnostic);
+ssize_t ai_detections_fuse(ai_detections_t *fused, const ai_detections_t *lists, int num_lists, double iou_threshold, int class_agnostic);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,32 @@
+#ifndef _ANNOTATION_TOOLS_ANNOTATION_CORE_H_
+#define _ANNOTATION_TOOLS_ANNOTATION_CORE_H_
+
+/*
+ * libannotation-core: everything that does not need a display.
+ *   label i/o:     annotation-list.h
+ *   image codecs:  img_proc.h (jpeg/png, 16-bit grayscale, resize, adjustments)
+ *   ai client:     ai-client.h, ai-cache.h, ai-ipc.h (local server), ai-detections.h (response parser),
+ *                  ai-postprocess.h (thresholds, nms, wbf)
+ *   helpers:       utils.h
+ *
+ * build:  make core   ==> lib/libannotation-core.a, lib/libannotation-core.so
+ * link:   -lannotation-core -lm -lpthread -ljson-c -ljpeg -lpng -lcairo `pkg-config --libs libsoup-2.4`
+ *
+ * Stable from 1.0 (libannotation-core.so.1): the ai client and its requests are opaque
+ * (struct ai_client, ai_request_t), configured through functions and ai_client_options_t,
+ * which is versioned by the size the caller passes and only grows at its end.
+ * The soname is bumped on every incompatible change of these headers.
+ */
+#define ANNOTATION_CORE_VERSION_MAJOR	1
+#define ANNOTATION_CORE_VERSION_MINOR	0
+
+#include "utils.h"
+#include "img_proc.h"
+#include "annotation-list.h"
+#include "ai-cache.h"
+#include "ai-ipc.h"
+#include "ai-detections.h"
+#include "ai-postprocess.h"
+#include "ai-client.h"
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _ANNOTATION_TOOLS_ANNOTATION_LIST_H_
+#define _ANNOTATION_TOOLS_ANNOTATION_LIST_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <json-c/json.h>
+#include "ai-detections.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * annotation_list: boxes of one image (darknet/yolo text format on disk),
+ *   no GTK dependency: shared by the gui and the command line tools.
+ */
+typedef struct annotation_data
+{
+	int klass;
+	double x;		// center.x
+	double y;		// center.y
+	double width;
+	double height;
+}annotation_data_t;
+
+typedef struct annotation_list
+{
+	ssize_t max_size;
+	ssize_t length;
+	annotation_data_t ** data;
+	ssize_t (* load)(struct annotation_list * list, const char * filename);
+	int (* save)(struct annotation_list * list, const char * filename);
+	int (* resize)(struct annotation_list * list, ssize_t new_size);
+	int (* update)(struct annotation_list * list, int index, const annotation_data_t * data);	// index: -1 ==> add
+	int (* remove)(struct annotation_list * list, int index);
+}annotation_list_t;
+annotation_list_t * annotation_list_init(annotation_list_t * list, ssize_t max_size);
+void annotation_list_cleanup(annotation_list_t * list);
+void annotation_list_reset(annotation_list_t * list);
+void annotation_list_dump(const annotation_list_t * list);
+ssize_t annotation_list_add_ai_detections(annotation_list_t * list, const ai_detections_t * detections);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -18,6 +18,7 @@ extern "C" {
 #define TEXT_DOMAIN	"annotation-tools"
 
 #include <gtk/gtk.h>
+#include "annotation-list.h"
 
 struct ai_client;
 struct shell_context;
@@ -38,35 +39,21 @@ typedef struct global_params
 	double font_size;
 	const char * font_name;
 	
+	double lod_min_box_size;	// boxes smaller than this (screen pixels) are aggregated
+	double lod_min_label_size;	// labels are hidden for boxes lower than this (screen pixels)
+	int render_threads;			// canvas worker threads, 0: number of cpus, 1: single-threaded
+	int render_tile_size;		// pixels
+	int server_side_surfaces;	// upload the rendered layers once into surfaces similar to the window
+	int measure_uploads;		// print the bytes sent to the display per frame
+	int num_viewports;			// synchronized views of the image
+	int loupe_size;				// magnifier size (pixels)
+	double loupe_zoom;			// magnifier: screen pixels per source pixel
+	int edge_snap_radius;		// box borders snap to image edges within this distance (screen pixels), 0: disabled
+	
 	struct ai_client *ai;
 }global_params_t;
 global_params_t * global_params_get_default();
 
-typedef struct annotation_data
-{
-	int klass;
-	double x;		// center.x
-	double y;		// center.y
-	double width;
-	double height;
-}annotation_data_t;
-
-typedef struct annotation_list
-{
-	ssize_t max_size;
-	ssize_t length;
-	annotation_data_t ** data;
-	ssize_t (* load)(struct annotation_list * list, const char * filename);
-	int (* save)(struct annotation_list * list, const char * filename);
-	int (* resize)(struct annotation_list * list, ssize_t new_size);
-	int (* update)(struct annotation_list * list, int index, const annotation_data_t * data);	// index: -1 ==> add
-	int (* remove)(struct annotation_list * list, int index);
-}annotation_list_t;
-annotation_list_t * annotation_list_init(annotation_list_t * list, ssize_t max_size);
-void annotation_list_cleanup(annotation_list_t * list);
-void annotation_list_reset(annotation_list_t * list);
-void annotation_list_dump(const annotation_list_t * list);
-
 #ifdef __cplusplus
 }
 #endif
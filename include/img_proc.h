@@ -2,6 +2,7 @@
 #define _IMG_PROC_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -19,6 +20,17 @@ typedef struct bgra_image
 }bgra_image_t;
 bgra_image_t * bgra_image_init(bgra_image_t * image, int width, int height, const unsigned char * image_data);
 void bgra_image_clear(bgra_image_t * image);
+int bgra_image_resize(bgra_image_t * dst, const bgra_image_t * src, int width, int height);
+
+typedef struct img_letterbox
+{
+	int size;				// the letterboxed image is size x size
+	int width, height;		// scaled source inside it
+	int pad_x, pad_y;
+	int src_width, src_height;
+}img_letterbox_t;
+int bgra_image_letterbox(bgra_image_t * dst, const bgra_image_t * src, int size, img_letterbox_t * box);
+void img_letterbox_to_source(const img_letterbox_t * box, double * x, double * y, double * width, double * height);	// normalized (left, top, width, height)
 /**
  * @}
  */
@@ -29,6 +41,7 @@ void bgra_image_clear(bgra_image_t * image);
  * @{
  */
 int bgra_image_from_jpeg_stream(bgra_image_t * image, const unsigned char * jpeg, size_t length);
+int bgra_image_from_jpeg_stream_scaled(bgra_image_t * image, const unsigned char * jpeg, size_t length, int min_width, int min_height);	// DCT-scaled decode
 int bgra_image_from_png_stream(bgra_image_t * image, const unsigned char * jpeg, size_t length);
 int bgra_image_load_data(bgra_image_t * image, const void * image_data, size_t size);		// image_data: png or jpeg format
 int bgra_image_load_from_file(bgra_image_t * image, const char * filename);
@@ -38,12 +51,123 @@ int bgra_image_save_to_png(bgra_image_t * image, const char * filename);
 ssize_t bgra_image_to_jpeg_stream(bgra_image_t * image, unsigned char ** jpeg_stream, int quality);
 ssize_t bgra_image_to_png_stream(bgra_image_t * image, unsigned char ** png_stream);
 
+// rows of a jpeg in order (bgra), a band at a time
+typedef struct img_jpeg_reader
+{
+	int width;
+	int height;
+	int next_row;	// rows read so far
+	void * priv;
+}img_jpeg_reader_t;
+int img_jpeg_reader_open(img_jpeg_reader_t * reader, const unsigned char * jpeg, size_t length);
+int img_jpeg_reader_read(img_jpeg_reader_t * reader, unsigned char * data, int stride, int num_rows);	// returns the rows read, -1 on error
+void img_jpeg_reader_close(img_jpeg_reader_t * reader);
+
 int img_utils_get_jpeg_size(const unsigned char * jpeg, size_t length, int * p_width, int * p_height);
 int img_utils_get_png_size(const unsigned char * png, size_t length, int * p_width, int * p_height);
 
 /**
 * @}
 */
+
+
+/**
+ * @ingroup img_proc
+ * display adjustments (utils/img_adjust.c)
+ * @{
+ */
+typedef struct img_adjustments
+{
+	double brightness;	// -1.0 ~ 1.0, 0: unchanged
+	double contrast;	// 0.0 ~ 4.0, 1: unchanged
+	double gamma;		// 0.1 ~ 10.0, 1: unchanged
+	int auto_levels;	// stretch the 0.5% ~ 99.5% range of each channel
+	int clahe;			// contrast limited adaptive histogram equalization (luma)
+	double clahe_clip_limit;	// relative to the mean bin height, default 2.0
+}img_adjustments_t;
+void img_adjustments_init(img_adjustments_t * adj);
+int img_adjustments_is_identity(const img_adjustments_t * adj);
+
+typedef struct img_lut
+{
+	unsigned char bgr[3][256];	// per channel: b, g, r
+}img_lut_t;
+void img_lut_build(img_lut_t * lut, const img_adjustments_t * adj, const bgra_image_t * image);	// image: auto-levels statistics
+void bgra_apply_lut(unsigned char * data, int width, int height, int stride, const img_lut_t * lut);
+
+typedef struct img_clahe
+{
+	int tiles_x;
+	int tiles_y;
+	unsigned char * luts;	// [tiles_y][tiles_x][256]
+}img_clahe_t;
+int img_clahe_build(img_clahe_t * clahe, const bgra_image_t * image, int tiles_x, int tiles_y, double clip_limit);
+void img_clahe_cleanup(img_clahe_t * clahe);
+
+// (u0, v0): normalized image position of the first pixel, (du, dv): per pixel step
+void bgra_apply_clahe(unsigned char * data, int width, int height, int stride, const img_clahe_t * clahe,
+	double u0, double v0, double du, double dv);
+/**
+* @}
+*/
+
+
+/**
+ * @ingroup img_proc
+ * 16-bit single-channel images (utils/img_gray16.c)
+ * @{
+ */
+typedef struct gray16_image
+{
+	uint16_t * data;
+	int width;
+	int height;
+	int stride;		// in pixels, 0: width
+}gray16_image_t;
+gray16_image_t * gray16_image_init(gray16_image_t * image, int width, int height, const uint16_t * image_data);
+void gray16_image_clear(gray16_image_t * image);
+int gray16_image_load_png(gray16_image_t * image, const char * filename);	// -1: not a 16-bit grayscale png
+void gray16_image_get_range(const gray16_image_t * image, int * p_min, int * p_max);
+
+// window / level --> 8-bit gray BGRA (same size, allocated if needed)
+int gray16_image_to_bgra(const gray16_image_t * image, bgra_image_t * bgra, int window_center, int window_width);
+/**
+* @}
+*/
+
+
+/**
+ * @ingroup img_proc
+ * edge maps for border snapping (utils/img_gradient.c)
+ *   Sobel responses are computed per tile on first use, then kept as prefix sums:
+ *   the edge strength along any border segment is a difference of two sums.
+ * @{
+ */
+typedef struct img_gradient_tile
+{
+	uint32_t * col_sums;	// (cy + 1) x cx: vertical prefix sums of |Gx| (vertical edges)
+	uint32_t * row_sums;	// cy x (cx + 1): horizontal prefix sums of |Gy| (horizontal edges)
+}img_gradient_tile_t;
+
+typedef struct img_gradient
+{
+	const bgra_image_t * image;	// not owned
+	int tile_size;
+	int tiles_x;
+	int tiles_y;
+	img_gradient_tile_t * tiles;	// [tiles_y][tiles_x], computed lazily
+}img_gradient_t;
+int img_gradient_init(img_gradient_t * grad, const bgra_image_t * image, int tile_size);
+void img_gradient_reset(img_gradient_t * grad);		// the image pixels have been changed
+void img_gradient_cleanup(img_gradient_t * grad);
+
+// strongest vertical edge in [x - radius, x + radius] along rows [y1, y2],
+// returns x if no candidate reaches an average |Gx| of min_strength
+int img_gradient_snap_x(img_gradient_t * grad, int x, int y1, int y2, int radius, int min_strength);
+int img_gradient_snap_y(img_gradient_t * grad, int y, int x1, int x2, int radius, int min_strength);
+/**
+* @}
+*/
 #ifdef __cplusplus
 }
 #endif
@@ -74,7 +74,7 @@ typedef char * string;
 		type value = (type)0;												\
 		if (jobj) {															\
 			json_object * jvalue = NULL;									\
-			json_bool ok = FALSE;											\
+			json_bool ok = 0;												\
 			ok = json_object_object_get_ex(jobj, #key, &jvalue);			\
 			if(ok && jvalue) value = (type)json_object_get_##type(jvalue);	\
 		}																	\
@@ -84,7 +84,7 @@ typedef char * string;
 #define json_get_value_default(jobj, type, key, defval)	({					\
 		type value = (type)defval;											\
 		json_object * jvalue = NULL;										\
-		json_bool ok = FALSE;												\
+		json_bool ok = 0;													\
 		ok = json_object_object_get_ex(jobj, #key, &jvalue);				\
 		if(ok && jvalue) value = (type)json_object_get_##type(jvalue);		\
 		value;																\
@@ -0,0 +1,340 @@
+/*
+ * ai-cache.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <json-c/json.h>
+#include "ai-cache.h"
+
+#define AI_CACHE_LOW_WATER(max_size) ((max_size) / 10 * 9)	// eviction stops at 90%
+
+/******************************************************************************
+ * MurmurHash3 (x64, 128-bit), public domain algorithm by Austin Appleby
+******************************************************************************/
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static void murmur3_128(const void * key, size_t len, uint64_t seed, uint64_t hash[2])
+{
+	const unsigned char * data = key;
+	const size_t num_blocks = len / 16;
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = seed, h2 = seed;
+
+	for(size_t i = 0; i < num_blocks; ++i)
+	{
+		uint64_t k1, k2;
+		memcpy(&k1, data + i * 16, 8);
+		memcpy(&k2, data + i * 16 + 8, 8);
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	const unsigned char * tail = data + num_blocks * 16;
+	uint64_t k1 = 0, k2 = 0;
+	switch(len & 15)
+	{
+	case 15: k2 ^= ((uint64_t)tail[14]) << 48;	// fall through
+	case 14: k2 ^= ((uint64_t)tail[13]) << 40;	// fall through
+	case 13: k2 ^= ((uint64_t)tail[12]) << 32;	// fall through
+	case 12: k2 ^= ((uint64_t)tail[11]) << 24;	// fall through
+	case 11: k2 ^= ((uint64_t)tail[10]) << 16;	// fall through
+	case 10: k2 ^= ((uint64_t)tail[9]) << 8;	// fall through
+	case 9: k2 ^= ((uint64_t)tail[8]);
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		// fall through
+	case 8: k1 ^= ((uint64_t)tail[7]) << 56;	// fall through
+	case 7: k1 ^= ((uint64_t)tail[6]) << 48;	// fall through
+	case 6: k1 ^= ((uint64_t)tail[5]) << 40;	// fall through
+	case 5: k1 ^= ((uint64_t)tail[4]) << 32;	// fall through
+	case 4: k1 ^= ((uint64_t)tail[3]) << 24;	// fall through
+	case 3: k1 ^= ((uint64_t)tail[2]) << 16;	// fall through
+	case 2: k1 ^= ((uint64_t)tail[1]) << 8;	// fall through
+	case 1: k1 ^= ((uint64_t)tail[0]);
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= len; h2 ^= len;
+	h1 += h2; h2 += h1;
+	h1 = fmix64(h1); h2 = fmix64(h2);
+	h1 += h2; h2 += h1;
+
+	hash[0] = h1;
+	hash[1] = h2;
+	return;
+}
+
+void ai_cache_make_key(char key[static AI_CACHE_KEY_SIZE], const void * image_data, size_t cb_image,
+	const char * server_url, const char * model_version)
+{
+	char config[PATH_MAX * 2] = "";
+	int cb = snprintf(config, sizeof(config), "%s\n%s", server_url?server_url:"", model_version?model_version:"");
+	if(cb < 0) cb = 0;
+	if(cb >= (int)sizeof(config)) cb = sizeof(config) - 1;
+
+	uint64_t seed[2] = { 0 };
+	murmur3_128(config, cb, 0, seed);
+
+	uint64_t hash[2] = { 0 };
+	murmur3_128(image_data, cb_image, seed[0], hash);
+	snprintf(key, AI_CACHE_KEY_SIZE, "%016llx%016llx", (unsigned long long)hash[0], (unsigned long long)hash[1]);
+	return;
+}
+
+/******************************************************************************
+ * entries
+******************************************************************************/
+static int is_entry_name(const char * name)
+{
+	size_t len = strlen(name);
+	return (len == AI_CACHE_KEY_SIZE - 1 + 5) && strcmp(name + AI_CACHE_KEY_SIZE - 1, ".json") == 0;
+}
+
+static void get_entry_path(const ai_cache_t * cache, const char * key, char path_name[static PATH_MAX])
+{
+	snprintf(path_name, PATH_MAX, "%s/%s.json", cache->path, key);
+}
+
+struct cache_entry
+{
+	char name[AI_CACHE_KEY_SIZE + 8];
+	int64_t size;
+	struct timespec mtime;
+};
+
+static int compare_mtime(const void * a, const void * b)
+{
+	const struct cache_entry * entry_a = a;
+	const struct cache_entry * entry_b = b;
+	if(entry_a->mtime.tv_sec != entry_b->mtime.tv_sec) return (entry_a->mtime.tv_sec < entry_b->mtime.tv_sec)?-1:1;
+	if(entry_a->mtime.tv_nsec != entry_b->mtime.tv_nsec) return (entry_a->mtime.tv_nsec < entry_b->mtime.tv_nsec)?-1:1;
+	return 0;
+}
+
+/*
+ * scan_entries(): total size of the cache directory, and (if p_entries) the entries sorted by mtime
+ */
+static int64_t scan_entries(ai_cache_t * cache, struct cache_entry ** p_entries, size_t * p_count)
+{
+	DIR * dir = opendir(cache->path);
+	if(NULL == dir) return 0;
+
+	int64_t total_size = 0;
+	size_t count = 0, max_count = 0;
+	struct cache_entry * entries = NULL;
+
+	struct dirent * item = NULL;
+	while((item = readdir(dir)))
+	{
+		if(!is_entry_name(item->d_name)) continue;
+
+		struct stat st[1];
+		if(fstatat(dirfd(dir), item->d_name, st, 0) || !S_ISREG(st->st_mode)) continue;
+		total_size += st->st_size;
+		if(NULL == p_entries) continue;
+
+		if(count >= max_count)
+		{
+			max_count = max_count?(max_count * 2):256;
+			entries = realloc(entries, sizeof(*entries) * max_count);
+			assert(entries);
+		}
+		struct cache_entry * entry = &entries[count++];
+		strncpy(entry->name, item->d_name, sizeof(entry->name) - 1);
+		entry->name[sizeof(entry->name) - 1] = '\0';
+		entry->size = st->st_size;
+		entry->mtime = st->st_mtim;
+	}
+	closedir(dir);
+
+	if(p_entries)
+	{
+		if(count > 1) qsort(entries, count, sizeof(*entries), compare_mtime);
+		*p_entries = entries;
+		*p_count = count;
+	}
+	return total_size;
+}
+
+static void evict(ai_cache_t * cache)
+{
+	struct cache_entry * entries = NULL;
+	size_t count = 0;
+	cache->total_size = scan_entries(cache, &entries, &count);
+
+	int64_t low_water = AI_CACHE_LOW_WATER(cache->max_size);
+	for(size_t i = 0; i < count && cache->total_size > low_water; ++i)
+	{
+		char path_name[PATH_MAX] = "";
+		snprintf(path_name, sizeof(path_name), "%s/%s", cache->path, entries[i].name);
+		if(0 == unlink(path_name)) cache->total_size -= entries[i].size;
+	}
+	free(entries);
+	return;
+}
+
+static json_object * ai_cache_lookup(ai_cache_t * cache, const char * key)
+{
+	char path_name[PATH_MAX] = "";
+	get_entry_path(cache, key, path_name);
+
+	json_object * jresult = json_object_from_file(path_name);
+	if(NULL == jresult) return NULL;
+
+	utimensat(AT_FDCWD, path_name, NULL, 0);	// most recently used
+	return jresult;
+}
+
+static int ai_cache_store(ai_cache_t * cache, const char * key, json_object * jresult)
+{
+	assert(jresult);
+	char path_name[PATH_MAX] = "";
+	char tmp_name[PATH_MAX + 32] = "";
+	get_entry_path(cache, key, path_name);
+	static long tmp_counter;	// unique per store: two threads may write the same key
+	snprintf(tmp_name, sizeof(tmp_name), "%s.%ld.%ld.tmp", path_name, (long)getpid(), __sync_add_and_fetch(&tmp_counter, 1));
+
+	const char * json_str = json_object_to_json_string_ext(jresult, JSON_C_TO_STRING_PLAIN);
+	size_t length = strlen(json_str);
+
+	FILE * fp = fopen(tmp_name, "w");
+	if(NULL == fp) return -1;
+	size_t cb = fwrite(json_str, 1, length, fp);
+	fclose(fp);
+
+	if(cb != length)
+	{
+		unlink(tmp_name);
+		return -1;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	// an existing entry is replaced, its size no longer counts
+	struct stat st[1];
+	int64_t old_size = (0 == stat(path_name, st))?(int64_t)st->st_size:0;
+
+	// replaced atomically: readers never see a partial entry
+	int rc = rename(tmp_name, path_name);
+	if(0 == rc)
+	{
+		cache->total_size += (int64_t)length - old_size;
+		if(cache->total_size > cache->max_size) evict(cache);
+	}
+	pthread_mutex_unlock(&cache->lock);
+	
+	if(rc) unlink(tmp_name);
+	return rc?-1:0;
+}
+
+/******************************************************************************
+ * ai_cache
+******************************************************************************/
+static int make_dirs(const char * path)
+{
+	char dir[PATH_MAX] = "";
+	strncpy(dir, path, sizeof(dir) - 1);
+
+	for(char * p = dir + 1; *p; ++p)
+	{
+		if(*p != '/') continue;
+		*p = '\0';
+		if(mkdir(dir, 0755) && errno != EEXIST) return -1;
+		*p = '/';
+	}
+	if(mkdir(dir, 0755) && errno != EEXIST) return -1;
+	return 0;
+}
+
+ai_cache_t * ai_cache_new(const char * path, int64_t max_size)
+{
+	if(max_size <= 0) return NULL;
+
+	char default_path[PATH_MAX] = "";
+	if(NULL == path || path[0] == '\0')
+	{
+		const char * cache_home = getenv("XDG_CACHE_HOME");
+		const char * home = getenv("HOME");
+		if(cache_home && cache_home[0]) snprintf(default_path, sizeof(default_path), "%s/annotation-tools/ai", cache_home);
+		else if(home && home[0]) snprintf(default_path, sizeof(default_path), "%s/.cache/annotation-tools/ai", home);
+		else return NULL;
+		path = default_path;
+	}
+
+	if(make_dirs(path))
+	{
+		fprintf(stderr, "[WARNING]::%s(%s)::%s\n", __FUNCTION__, path, strerror(errno));
+		return NULL;
+	}
+
+	ai_cache_t * cache = calloc(1, sizeof(*cache));
+	assert(cache);
+	cache->path = strdup(path);
+	cache->max_size = max_size;
+	cache->lookup = ai_cache_lookup;
+	cache->store = ai_cache_store;
+	pthread_mutex_init(&cache->lock, NULL);
+
+	cache->total_size = scan_entries(cache, NULL, NULL);
+	if(cache->total_size > cache->max_size) evict(cache);	// the cap may have been lowered
+	return cache;
+}
+
+void ai_cache_free(ai_cache_t * cache)
+{
+	if(NULL == cache) return;
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->path);
+	free(cache);
+	return;
+}
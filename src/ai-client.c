@@ -26,40 +26,163 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libsoup/soup.h>
 #include <json-c/json.h>
 
 #include "ai-client.h"
+#include "ai-ipc.h"
+#include "img_proc.h"
+#include "utils.h"
 
-static int ai_client_predict(struct ai_client *client, const void *image_data, size_t cb_image, json_object **p_jresult)
+/*************************************************
+ * private: the public headers only see the pointers
+*************************************************/
+typedef struct ai_endpoint
 {
-	assert(client->session);
+	char *url;
+	int outstanding;		// requests in flight
+	double ewma_latency;	// ms, 0: not measured yet
+	int failures;			// consecutive
+	double ejected_until;	// monotonic ms, skipped until then
+	long num_requests;
+	long num_failures;
+}ai_endpoint_t;
+
+typedef struct ai_timing
+{
+	double queued;
+	double started;
+	double wrote_body;
+	double got_headers;
+}ai_timing_t;
+
+struct ai_request
+{
+	struct ai_client *client;
+	SoupMessage *msg;
+	int cancelled;
 	
-	int rc = -1;
-	if(NULL == image_data || cb_image <= 0) return -1;
+	char key[AI_CACHE_KEY_SIZE];	// cache key of the image
+	json_object *jcached;			// cache hit or ipc result (NULL: failed): delivered from an idle callback
+	img_letterbox_t letterbox;		// size > 0: the detections are mapped back to the source image
+	guint idle_id;
+	
+	int attempts;
+	guint retry_id;					// backoff timer of the next attempt
+	ai_endpoint_t *endpoint;		// of the current attempt
+	double attempt_begin;
+	ai_timing_t timing;
+	ai_request_stats_t stats;
+	
+	ai_predict_callback callback;
+	void *user_data;
+	
+	// predict_detections_async(): the response body is parsed chunk by chunk into the buffer
+	ai_detections_callback on_detections;
+	ai_detections_parser_t parser;
+	ai_detections_t detections;
+	
+	// prepared by a worker thread from a copy of the image (letterbox, local server, tiles),
+	// then queued / delivered on the main loop
+	unsigned char *image_data;
+	size_t cb_image;
+	int tiled;
+	int rc;							// of the tiled prediction
+	int in_worker;					// listed in client->pending
+	struct ai_request *prev;		// client->pending
+	struct ai_request *next;
+	struct ai_request *next_job;	// client->jobs
+};
+
+struct ai_client
+{
+	void *user_data;
+	char *ai_server_url;	// the first endpoint
+	
+	ai_endpoint_t *endpoints;
+	int num_endpoints;
+	int eject_ms;
+	pthread_mutex_t endpoints_lock;
+	SoupSession *session;
+	
+	struct ai_ipc_client *ipc;	// "unix:/path" endpoint
+	size_t ipc_ring_size;
 	
-	SoupSession *session = client->session;
+	ai_cache_t *cache;
+	const ai_postprocess_t *postprocess;
+	char *model_version;	// part of the cache key
+	
+	int input_size;
+	int jpeg_quality;
+	
+	int tile_size;
+	double tile_overlap;
+	int tile_concurrency;
+	void (*on_tile_stats)(struct ai_client *client, const ai_tile_stats_t *stats);
+	
+	int max_connections;
+	int timeout;
+	int max_retries;
+	int retry_base_ms;
+	struct {
+		long num_requests;
+		long num_retries;
+		long num_failures;
+	}stats;
+	void (*on_stats)(struct ai_client *client, const ai_request_stats_t *stats);
+	
+	// async requests that need decoding (letterbox, local server, tiles) are prepared by worker threads, 
+	// not on the main loop, two images at a time; ai_client_free() cancels them and waits for the workers
+	pthread_t *workers;		// started on first use
+	int num_workers;
+	int quit;
+	pthread_mutex_t jobs_lock;
+	pthread_cond_t jobs_cond;
+	ai_request_t *jobs;		// fifo, waiting for a worker
+	ai_request_t *jobs_tail;
+	ai_request_t *pending;	// every request between submit and on_request_prepared()
+};
+
+static char *guess_image_type(const void *image_data, size_t cb_image)	// g_free() the result
+{
 	char *content_type = NULL;
 	gboolean uncertain = TRUE;
 	content_type = g_content_type_guess(NULL, image_data, cb_image, &uncertain);
 	if(NULL == content_type || uncertain) {
 		fprintf(stderr, "[ERROR]: %s(): unknown image type.\n", __FUNCTION__);
 		if(content_type) g_free(content_type);
-		return -1;
+		return NULL;
 	}
+	return content_type;
+}
 
-	SoupMessage *msg = soup_message_new("POST", client->ai_server_url);
-	if(NULL == msg) goto label_cleanup;
-	
-	SoupMessageHeaders *request_headers = msg->request_headers;
-	soup_message_headers_append(request_headers, "Content-Type", content_type);
-	soup_message_body_append(msg->request_body, SOUP_MEMORY_COPY, image_data, cb_image);
+static SoupMessage *create_predict_message(struct ai_client *client, const void *image_data, size_t cb_image)
+{
+	if(NULL == image_data || cb_image <= 0 || NULL == client->ai_server_url) return NULL;
 	
-	guint response_code = soup_session_send_message(session, msg);
-	if(response_code < 200 || response_code >= 300) goto label_cleanup;
+	char *content_type = guess_image_type(image_data, cb_image);
+	if(NULL == content_type) return NULL;
+
+	SoupMessage *msg = soup_message_new("POST", client->ai_server_url);
+	if(msg) {
+		SoupMessageHeaders *request_headers = msg->request_headers;
+		soup_message_headers_append(request_headers, "Content-Type", content_type);
+		soup_message_body_append(msg->request_body, SOUP_MEMORY_COPY, image_data, cb_image);
+	}
+	g_free(content_type);
+	return msg;
+}
+
+static int parse_response(SoupMessage *msg, json_object **p_jresult)
+{
+	int rc = -1;
+	guint response_code = msg->status_code;
+	if(response_code < 200 || response_code >= 300) return -1;
 	
 	if(msg->response_body && msg->response_body->length > 0 && msg->response_body->data)
 	{
@@ -72,69 +195,1497 @@ static int ai_client_predict(struct ai_client *client, const void *image_data, s
 		enum json_tokener_error jerr = json_tokener_get_error(jtok);
 		if(jerr == json_tokener_success) {
 			if(p_jresult) *p_jresult = jresult;
+			else json_object_put(jresult);
 			rc = 0;
 		}else {
 			if(jresult) json_object_put(jresult);
 		}
 		json_tokener_free(jtok);
 	}
-label_cleanup:	
-	if(msg) g_object_unref(msg);
-	if(content_type) g_free(content_type);
 	return rc;
 }
 
+/*
+ * transport: retries, backoff and per-request timing
+ */
+#define AI_CLIENT_MAX_BACKOFF_MS	(10000)
+
+static double now_ms(void)
+{
+	return (double)g_get_monotonic_time() / 1000.0;
+}
+
+static void on_message_starting(SoupMessage *msg, ai_timing_t *timing)	// left the session queue
+{
+	timing->started = now_ms();
+}
+static void on_message_wrote_body(SoupMessage *msg, ai_timing_t *timing)
+{
+	timing->wrote_body = now_ms();
+}
+static void on_message_got_headers(SoupMessage *msg, ai_timing_t *timing)
+{
+	timing->got_headers = now_ms();
+}
+
+static void watch_message(SoupMessage *msg, ai_timing_t *timing)
+{
+	timing->queued = now_ms();
+	timing->started = timing->wrote_body = timing->got_headers = 0;
+	g_signal_connect(msg, "starting", G_CALLBACK(on_message_starting), timing);
+	g_signal_connect(msg, "wrote-body", G_CALLBACK(on_message_wrote_body), timing);
+	g_signal_connect(msg, "got-headers", G_CALLBACK(on_message_got_headers), timing);
+}
+
+static double parse_server_timing(SoupMessage *msg)	// Server-Timing: name;dur=12.5, ... ==> total ms, -1: not reported
+{
+	const char *header = soup_message_headers_get_list(msg->response_headers, "Server-Timing");
+	if(NULL == header) return -1;
+	
+	double total = -1;
+	for(const char *p = strstr(header, "dur="); p; p = strstr(p, "dur=")) {
+		p += sizeof("dur=") - 1;
+		if(total < 0) total = 0;
+		total += strtod(p, NULL);
+	}
+	return total;
+}
+
+static void update_stats(struct ai_client *client, ai_request_stats_t *stats, SoupMessage *msg, const ai_timing_t *timing, int attempts)
+{
+	double end = now_ms();
+	stats->status_code = msg->status_code;
+	stats->attempts = attempts;
+	stats->total_time = end - stats->total_time;	// begin ==> end
+	stats->queue_time = (timing->started > 0)?(timing->started - timing->queued):0;
+	stats->rtt = (timing->got_headers > 0 && timing->wrote_body > 0)?(timing->got_headers - timing->wrote_body):0;
+	stats->server_time = parse_server_timing(msg);
+	
+	__sync_fetch_and_add(&client->stats.num_requests, 1);
+	__sync_fetch_and_add(&client->stats.num_retries, attempts - 1);
+	if(!SOUP_STATUS_IS_SUCCESSFUL(msg->status_code)) __sync_fetch_and_add(&client->stats.num_failures, 1);
+	if(client->on_stats) client->on_stats(client, stats);
+}
+
+static int is_retryable(guint status_code)
+{
+	if(status_code == SOUP_STATUS_CANCELLED) return 0;
+	return SOUP_STATUS_IS_TRANSPORT_ERROR(status_code)	// connection refused/reset, timeout, ...
+		|| status_code == 429	// too many requests
+		|| status_code == SOUP_STATUS_BAD_GATEWAY
+		|| status_code == SOUP_STATUS_SERVICE_UNAVAILABLE
+		|| status_code == SOUP_STATUS_GATEWAY_TIMEOUT;
+}
+
+static unsigned int backoff_delay_ms(struct ai_client *client, int attempt)	// exponential, full jitter
+{
+	double delay = client->retry_base_ms;
+	for(int i = 0; i < attempt && delay < AI_CLIENT_MAX_BACKOFF_MS; ++i) delay *= 2;
+	if(delay > AI_CLIENT_MAX_BACKOFF_MS) delay = AI_CLIENT_MAX_BACKOFF_MS;
+	return (unsigned int)(g_random_double() * delay);
+}
+
+static SoupMessage *clone_message(SoupMessage *msg)	// a completed message cannot be queued again
+{
+	SoupMessage *clone = soup_message_new_from_uri(msg->method, soup_message_get_uri(msg));
+	assert(clone);
+	
+	const char *content_type = soup_message_headers_get_one(msg->request_headers, "Content-Type");
+	if(content_type) soup_message_headers_replace(clone->request_headers, "Content-Type", content_type);
+	
+	SoupBuffer *body = soup_message_body_flatten(msg->request_body);
+	soup_message_body_append_buffer(clone->request_body, body);
+	soup_buffer_free(body);
+	return clone;
+}
+
+/*
+ * endpoints: replicas of the ai-server, 
+ *   a request goes to the available endpoint with the lowest ewma_latency x (outstanding + 1),
+ *   consecutive failures eject an endpoint for eject_ms (doubled per further failure, up to 16x),
+ *   once the time is up it gets a trial request: a success brings it back, a failure ejects it again.
+ */
+#define AI_ENDPOINT_EWMA_ALPHA		(0.3)
+#define AI_ENDPOINT_EJECT_FAILURES	(2)
+
+static ai_endpoint_t *route_message(struct ai_client *client, SoupMessage *msg)
+{
+	pthread_mutex_lock(&client->endpoints_lock);
+	double now = now_ms();
+	ai_endpoint_t *best = NULL;
+	double best_score = 0;
+	ai_endpoint_t *first_back = NULL;	// all ejected: the one returning first
+	for(int i = 0; i < client->num_endpoints; ++i) {
+		ai_endpoint_t *endpoint = &client->endpoints[i];
+		if(endpoint->ejected_until > now) {
+			if(NULL == first_back || endpoint->ejected_until < first_back->ejected_until) first_back = endpoint;
+			continue;
+		}
+		// unmeasured endpoints first, spread by their outstanding requests
+		double latency = (endpoint->ewma_latency > 0)?endpoint->ewma_latency:0.001;
+		double score = latency * (endpoint->outstanding + 1);
+		if(NULL == best || score < best_score) {
+			best = endpoint;
+			best_score = score;
+		}
+	}
+	if(NULL == best) best = first_back;
+	if(best) {
+		++best->outstanding;
+		++best->num_requests;
+	}
+	pthread_mutex_unlock(&client->endpoints_lock);
+	
+	if(best) {
+		SoupURI *uri = soup_uri_new(best->url);
+		if(uri) {
+			soup_message_set_uri(msg, uri);
+			soup_uri_free(uri);
+		}
+	}
+	return best;
+}
+
+static void endpoint_done(struct ai_client *client, ai_endpoint_t *endpoint, guint status_code, double latency)
+{
+	if(NULL == endpoint) return;
+	pthread_mutex_lock(&client->endpoints_lock);
+	--endpoint->outstanding;
+	if(status_code == SOUP_STATUS_CANCELLED) {
+		// neither healthy nor failed
+	}else if(is_retryable(status_code)) {
+		++endpoint->num_failures;
+		if(++endpoint->failures >= AI_ENDPOINT_EJECT_FAILURES) {
+			int shift = endpoint->failures - AI_ENDPOINT_EJECT_FAILURES;
+			if(shift > 4) shift = 4;
+			endpoint->ejected_until = now_ms() + (double)client->eject_ms * (1 << shift);
+			fprintf(stderr, "[WARNING]: ai endpoint %s ejected for %d ms (status %u)\n", 
+				endpoint->url, client->eject_ms * (1 << shift), status_code);
+		}
+	}else {
+		endpoint->failures = 0;
+		endpoint->ejected_until = 0;
+		if(endpoint->ewma_latency <= 0) endpoint->ewma_latency = latency;
+		else endpoint->ewma_latency += AI_ENDPOINT_EWMA_ALPHA * (latency - endpoint->ewma_latency);
+	}
+	pthread_mutex_unlock(&client->endpoints_lock);
+}
+
+/*
+ * send_message(): blocking send with retries, *p_msg is replaced by the last attempt
+ */
+static guint send_message(struct ai_client *client, SoupMessage **p_msg)
+{
+	SoupMessage *msg = *p_msg;
+	ai_request_stats_t stats[1] = {{ .total_time = now_ms() }};
+	ai_timing_t timing[1];
+	
+	int attempt = 0;
+	while(1) {
+		watch_message(msg, timing);
+		ai_endpoint_t *endpoint = route_message(client, msg);
+		double begin = now_ms();
+		soup_session_send_message(client->session, msg);
+		endpoint_done(client, endpoint, msg->status_code, now_ms() - begin);
+		++attempt;
+		if(attempt > client->max_retries || !is_retryable(msg->status_code)) break;
+		
+		SoupMessage *retry = clone_message(msg);
+		g_object_unref(msg);
+		msg = retry;
+		g_usleep(backoff_delay_ms(client, attempt - 1) * 1000);
+	}
+	update_stats(client, stats, msg, timing, attempt);
+	*p_msg = msg;
+	return msg->status_code;
+}
+
+/*
+ * decode_input(): the pixels of the model input, letterboxed (box->size > 0) 
+ *   when input_size is set and the image is larger than input_size x input_size
+ */
+static int decode_input(struct ai_client *client, const unsigned char *image_data, size_t cb_image, 
+	bgra_image_t *image, img_letterbox_t *box)
+{
+	int size = client->input_size;
+	if(NULL == image_data || cb_image < 4) return -1;
+	memset(box, 0, sizeof(*box));
+	
+	int rc = -1;
+	if(size > 0 && image_data[0] == 0xff && image_data[1] == 0xd8) rc = bgra_image_from_jpeg_stream_scaled(image, image_data, cb_image, size, size);
+	else rc = bgra_image_load_data(image, image_data, cb_image);
+	if(rc) {
+		bgra_image_clear(image);
+		return -1;
+	}
+	if(size <= 0 || (image->width <= size && image->height <= size)) return 0;
+	
+	bgra_image_t letterboxed[1];
+	memset(letterboxed, 0, sizeof(letterboxed));
+	rc = bgra_image_letterbox(letterboxed, image, size, box);
+	bgra_image_clear(image);
+	if(rc) {
+		bgra_image_clear(letterboxed);
+		return -1;
+	}
+	*image = *letterboxed;
+	return 0;
+}
+
+/*
+ * letterbox_image(): the model input (input_size x input_size jpeg) of a larger image,
+ *   NULL: sent as is (preprocessing disabled, the image already fits, or not decodable)
+ */
+static unsigned char *letterbox_image(struct ai_client *client, const unsigned char *image_data, size_t cb_image, 
+	size_t *p_size, img_letterbox_t *box)
+{
+	if(client->input_size <= 0) return NULL;
+	
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	if(decode_input(client, image_data, cb_image, image, box)) return NULL;
+	if(box->size <= 0) {	// already fits
+		bgra_image_clear(image);
+		return NULL;
+	}
+	
+	unsigned char *jpeg = NULL;
+	ssize_t cb_jpeg = bgra_image_to_jpeg_stream(image, &jpeg, client->jpeg_quality?client->jpeg_quality:90);
+	bgra_image_clear(image);
+	
+	if(cb_jpeg <= 0) {
+		free(jpeg);
+		memset(box, 0, sizeof(*box));
+		return NULL;
+	}
+	*p_size = cb_jpeg;
+	return jpeg;
+}
+
+static void map_detections(json_object *jresult, const img_letterbox_t *box)	// letterbox ==> source coordinates
+{
+	json_object *jdetections = NULL;
+	if(NULL == jresult || !json_object_object_get_ex(jresult, "detections", &jdetections)) return;
+	if(!json_object_is_type(jdetections, json_type_array)) return;
+	
+	int num_detections = json_object_array_length(jdetections);
+	for(int i = 0; i < num_detections; ++i) {
+		json_object *jdet = json_object_array_get_idx(jdetections, i);
+		if(NULL == jdet) continue;
+		double left = json_get_value(jdet, double, left);
+		double top = json_get_value(jdet, double, top);
+		double width = json_get_value(jdet, double, width);
+		double height = json_get_value(jdet, double, height);
+		img_letterbox_to_source(box, &left, &top, &width, &height);
+		json_object_object_add(jdet, "left", json_object_new_double(left));
+		json_object_object_add(jdet, "top", json_object_new_double(top));
+		json_object_object_add(jdet, "width", json_object_new_double(width));
+		json_object_object_add(jdet, "height", json_object_new_double(height));
+	}
+}
+
+static void map_detection_boxes(ai_detections_t *detections, const img_letterbox_t *box)
+{
+	for(ssize_t i = 0; i < detections->length; ++i) {
+		ai_detection_t *det = &detections->data[i];
+		img_letterbox_to_source(box, &det->left, &det->top, &det->width, &det->height);
+	}
+}
+
+static json_object *lookup_cache_tag(struct ai_client *client, const void *image_data, size_t cb_image, int tiled, 
+	char key[static AI_CACHE_KEY_SIZE])
+{
+	if(NULL == client->cache || NULL == image_data || cb_image <= 0) return NULL;
+	
+	// the preprocessing changes the results
+	char model_tag[256] = "";
+	int cb = snprintf(model_tag, sizeof(model_tag), "%s@%d", client->model_version?client->model_version:"", client->input_size);
+	if(tiled) snprintf(model_tag + cb, sizeof(model_tag) - cb, "/%d+%.3f", client->tile_size, client->tile_overlap);
+	ai_cache_make_key(key, image_data, cb_image, client->ai_server_url, model_tag);
+	return client->cache->lookup(client->cache, key);
+}
+static json_object *lookup_cache(struct ai_client *client, const void *image_data, size_t cb_image, char key[static AI_CACHE_KEY_SIZE])
+{
+	return lookup_cache_tag(client, image_data, cb_image, 0, key);
+}
+
+static void store_cache(struct ai_client *client, const char *key, json_object *jresult)
+{
+	if(NULL == client->cache || NULL == jresult || key[0] == '\0') return;
+	client->cache->store(client->cache, key, jresult);
+	return;
+}
+
+/*
+ * predict_ipc(): "unix:" endpoint, the decoded pixels go through the shared ring (ai-ipc.h),
+ *   no jpeg re-encoding, no http
+ */
+static int predict_ipc(struct ai_client *client, const ai_image_t *images, size_t num_images, json_object **results)
+{
+	memset(results, 0, num_images * sizeof(*results));
+	
+	char (*keys)[AI_CACHE_KEY_SIZE] = calloc(num_images, sizeof(*keys));
+	img_letterbox_t *boxes = calloc(num_images, sizeof(*boxes));
+	bgra_image_t *decoded = calloc(num_images, sizeof(*decoded));
+	const bgra_image_t **inputs = calloc(num_images, sizeof(*inputs));
+	json_object **jresults = calloc(num_images, sizeof(*jresults));
+	size_t *index = calloc(num_images, sizeof(*index));	// input ==> image
+	assert(keys && boxes && decoded && inputs && jresults && index);
+	
+	size_t num_inputs = 0;
+	for(size_t i = 0; i < num_images; ++i) {
+		results[i] = lookup_cache(client, images[i].data, images[i].size, keys[i]);
+		if(results[i]) continue;
+		if(decode_input(client, images[i].data, images[i].size, &decoded[i], &boxes[i])) continue;
+		inputs[num_inputs] = &decoded[i];
+		index[num_inputs++] = i;
+	}
+	
+	if(num_inputs > 0) {
+		double begin = now_ms();
+		int rc = ai_ipc_predict(client->ipc, inputs, num_inputs, jresults);
+		
+		__sync_fetch_and_add(&client->stats.num_requests, 1);
+		if(rc) __sync_fetch_and_add(&client->stats.num_failures, 1);
+		if(client->on_stats) {
+			ai_request_stats_t stats = { .server_time = -1, .attempts = 1 };
+			stats.rtt = stats.total_time = now_ms() - begin;
+			stats.status_code = rc?SOUP_STATUS_BAD_GATEWAY:SOUP_STATUS_OK;
+			client->on_stats(client, &stats);
+		}
+		
+		for(size_t k = 0; k < num_inputs; ++k) {
+			size_t i = index[k];
+			results[i] = jresults[k];
+			if(NULL == results[i]) continue;
+			if(boxes[i].size > 0) map_detections(results[i], &boxes[i]);
+			store_cache(client, keys[i], results[i]);
+		}
+	}
+	
+	for(size_t i = 0; i < num_images; ++i) bgra_image_clear(&decoded[i]);
+	free(index);
+	free(jresults);
+	free(inputs);
+	free(decoded);
+	free(boxes);
+	free(keys);
+	
+	int rc = 0;
+	for(size_t i = 0; i < num_images; ++i) if(NULL == results[i]) rc = -1;
+	return rc;
+}
+
+/*
+ * tiled prediction: an image larger than tile_size is cut into overlapping tiles (the last 
+ *   row / column shifted inside the image), tile_concurrency threads predict them while the next 
+ *   band of rows is cut; the boxes are mapped to the image and merged with nms.
+ *   A jpeg is decoded band by band (img_jpeg_reader): a band of tile_size rows is kept, 
+ *   not the whole image.
+ */
+typedef struct tile_job
+{
+	int index;
+	int x, y;
+	bgra_image_t image;
+	double queued;
+}tile_job_t;
+
+typedef struct tile_queue
+{
+	struct ai_client *client;
+	int width, height;		// of the image
+	int num_tiles;
+	
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	tile_job_t **jobs;		// ring
+	int size;
+	int start;
+	int length;
+	int closed;				// no more jobs
+	
+	ai_detections_t *detections;	// image coordinates
+	int num_failures;
+	const int *cancelled;			// optional, the remaining tiles are skipped once set
+}tile_queue_t;
+
+static int is_tiled(struct ai_client *client, const unsigned char *image_data, size_t cb_image, int *p_width, int *p_height)
+{
+	if(client->tile_size <= 0 || NULL == image_data || cb_image < 8) return 0;
+	
+	int rc = -1;
+	if(image_data[0] == 0xff && image_data[1] == 0xd8) rc = img_utils_get_jpeg_size(image_data, cb_image, p_width, p_height);
+	else if(0 == memcmp(image_data, "\x89PNG", 4)) rc = img_utils_get_png_size(image_data, cb_image, p_width, p_height);
+	if(rc) return 0;
+	return (*p_width > client->tile_size || *p_height > client->tile_size);
+}
+
+static int tile_positions(int length, int tile_size, int overlap, int *positions)	// returns the number of tiles
+{
+	positions[0] = 0;
+	if(length <= tile_size) return 1;
+	
+	// evenly spread: the overlaps are at least 'overlap', the last tile ends at the border
+	int step = tile_size - overlap;
+	int num_tiles = 1 + (length - tile_size + step - 1) / step;
+	for(int i = 1; i < num_tiles; ++i) positions[i] = (int)((int64_t)i * (length - tile_size) / (num_tiles - 1));
+	return num_tiles;
+}
+
+static void tile_queue_push(tile_queue_t *queue, tile_job_t *job)
+{
+	pthread_mutex_lock(&queue->mutex);
+	while(queue->length == queue->size) pthread_cond_wait(&queue->not_full, &queue->mutex);
+	job->queued = now_ms();
+	queue->jobs[(queue->start + queue->length) % queue->size] = job;
+	++queue->length;
+	pthread_cond_signal(&queue->not_empty);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+static tile_job_t *tile_queue_pop(tile_queue_t *queue)	// NULL: closed and empty
+{
+	tile_job_t *job = NULL;
+	pthread_mutex_lock(&queue->mutex);
+	while(queue->length == 0 && !queue->closed) pthread_cond_wait(&queue->not_empty, &queue->mutex);
+	if(queue->length > 0) {
+		job = queue->jobs[queue->start];
+		queue->start = (queue->start + 1) % queue->size;
+		--queue->length;
+		pthread_cond_signal(&queue->not_full);
+	}
+	pthread_mutex_unlock(&queue->mutex);
+	return job;
+}
+
+static int tile_queue_stopped(tile_queue_t *queue)	// a tile failed or the request was cancelled
+{
+	pthread_mutex_lock(&queue->mutex);
+	int num_failures = queue->num_failures;
+	pthread_mutex_unlock(&queue->mutex);
+	return (num_failures > 0) || (queue->cancelled && __atomic_load_n(queue->cancelled, __ATOMIC_ACQUIRE));
+}
+
+static void tile_queue_close(tile_queue_t *queue)
+{
+	pthread_mutex_lock(&queue->mutex);
+	queue->closed = 1;
+	pthread_cond_broadcast(&queue->not_empty);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+static int predict_tile(struct ai_client *client, const bgra_image_t *tile, ai_detections_t *detections, double *encode_time)
+{
+	double begin = now_ms();
+	const bgra_image_t *input = tile;
+	bgra_image_t letterboxed[1];
+	memset(letterboxed, 0, sizeof(letterboxed));
+	img_letterbox_t box[1] = {{ 0 }};
+	
+	int size = client->input_size;
+	if(size > 0 && (tile->width > size || tile->height > size)) {
+		if(bgra_image_letterbox(letterboxed, tile, size, box)) {
+			bgra_image_clear(letterboxed);
+			return -1;
+		}
+		input = letterboxed;
+	}
+	
+	int rc = -1;
+	if(client->ipc) {
+		*encode_time = now_ms() - begin;
+		json_object *jresult = NULL;
+		if(0 == ai_ipc_predict(client->ipc, &input, 1, &jresult)) rc = ai_detections_from_json(detections, jresult);
+		if(jresult) json_object_put(jresult);
+		__sync_fetch_and_add(&client->stats.num_requests, 1);
+		if(rc) __sync_fetch_and_add(&client->stats.num_failures, 1);
+	}else {
+		unsigned char *jpeg = NULL;
+		ssize_t cb_jpeg = bgra_image_to_jpeg_stream((bgra_image_t *)input, &jpeg, client->jpeg_quality?client->jpeg_quality:90);
+		SoupMessage *msg = (cb_jpeg > 0)?create_predict_message(client, jpeg, cb_jpeg):NULL;
+		free(jpeg);
+		*encode_time = now_ms() - begin;
+		if(msg) {
+			send_message(client, &msg);
+			if(SOUP_STATUS_IS_SUCCESSFUL(msg->status_code) && msg->response_body && msg->response_body->data) {
+				rc = ai_detections_parse(detections, msg->response_body->data, msg->response_body->length);
+			}
+			g_object_unref(msg);
+		}
+	}
+	bgra_image_clear(letterboxed);
+	if(0 == rc && box->size > 0) map_detection_boxes(detections, box);
+	return rc;
+}
+
+static void *tile_thread(void *user_data)
+{
+	tile_queue_t *queue = user_data;
+	struct ai_client *client = queue->client;
+	ai_detections_t tile_detections[1];
+	memset(tile_detections, 0, sizeof(tile_detections));
+	
+	tile_job_t *job = NULL;
+	while((job = tile_queue_pop(queue))) {
+		ai_tile_stats_t stats = {
+			.index = job->index, .num_tiles = queue->num_tiles,
+			.x = job->x, .y = job->y, .width = job->image.width, .height = job->image.height,
+		};
+		double begin = now_ms();
+		stats.queue_time = begin - job->queued;
+		
+		ai_detections_reset(tile_detections);
+		int cancelled = queue->cancelled && __atomic_load_n(queue->cancelled, __ATOMIC_ACQUIRE);
+		stats.rc = cancelled?-1:predict_tile(client, &job->image, tile_detections, &stats.encode_time);
+		stats.predict_time = now_ms() - begin - stats.encode_time;
+		stats.num_detections = tile_detections->length;
+		
+		// tile ==> image coordinates
+		double scale_x = (double)job->image.width / queue->width;
+		double scale_y = (double)job->image.height / queue->height;
+		double offset_x = (double)job->x / queue->width;
+		double offset_y = (double)job->y / queue->height;
+		pthread_mutex_lock(&queue->mutex);
+		if(stats.rc) ++queue->num_failures;
+		else for(ssize_t i = 0; i < tile_detections->length; ++i) {
+			ai_detection_t det = tile_detections->data[i];
+			det.left = offset_x + det.left * scale_x;
+			det.top = offset_y + det.top * scale_y;
+			det.width *= scale_x;
+			det.height *= scale_y;
+			ai_detections_append(queue->detections, &det);
+		}
+		pthread_mutex_unlock(&queue->mutex);
+		
+		if(client->on_tile_stats) client->on_tile_stats(client, &stats);
+		bgra_image_clear(&job->image);
+		free(job);
+	}
+	ai_detections_clear(tile_detections);
+	return NULL;
+}
+
+static int cut_tiles(tile_queue_t *queue, const unsigned char *image_data, size_t cb_image, int tile_size, int overlap)
+{
+	int width = queue->width;
+	int height = queue->height;
+	int tile_width = (width < tile_size)?width:tile_size;
+	int tile_height = (height < tile_size)?height:tile_size;
+	int stride = width * 4;
+	
+	int *xs = calloc(width / (tile_size - overlap) + 2, sizeof(*xs));
+	int *ys = calloc(height / (tile_size - overlap) + 2, sizeof(*ys));
+	assert(xs && ys);
+	int num_cols = tile_positions(width, tile_size, overlap, xs);
+	int num_rows = tile_positions(height, tile_size, overlap, ys);
+	queue->num_tiles = num_cols * num_rows;
+	
+	int rc = -1;
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	img_jpeg_reader_t reader[1];
+	memset(reader, 0, sizeof(reader));
+	unsigned char *band = NULL;
+	
+	int is_jpeg = (image_data[0] == 0xff && image_data[1] == 0xd8);
+	if(is_jpeg) {
+		if(img_jpeg_reader_open(reader, image_data, cb_image)) goto label_cleanup;
+		if(reader->width != width || reader->height != height) goto label_cleanup;
+		band = malloc((size_t)stride * tile_height);
+		assert(band);
+	}else {
+		if(bgra_image_load_data(image, image_data, cb_image)) goto label_cleanup;
+		if(image->width != width || image->height != height) goto label_cleanup;
+	}
+	
+	for(int row = 0; row < num_rows; ++row) {
+		const unsigned char *rows = NULL;
+		if(is_jpeg) {	// the rows shared with the previous band are kept
+			int keep = (row > 0)?(ys[row - 1] + tile_height - ys[row]):0;
+			if(keep > 0) memmove(band, band + (size_t)(tile_height - keep) * stride, (size_t)keep * stride);
+			int num_read = tile_height - keep;
+			if(img_jpeg_reader_read(reader, band + (size_t)keep * stride, stride, num_read) != num_read) goto label_cleanup;
+			rows = band;
+		}else {
+			rows = image->data + (size_t)ys[row] * stride;
+		}
+		
+		for(int col = 0; col < num_cols; ++col) {
+			if(tile_queue_stopped(queue)) goto label_cleanup;	// the image fails anyway
+			
+			tile_job_t *job = calloc(1, sizeof(*job));
+			assert(job);
+			job->index = row * num_cols + col;
+			job->x = xs[col];
+			job->y = ys[row];
+			bgra_image_init(&job->image, tile_width, tile_height, NULL);
+			for(int y = 0; y < tile_height; ++y) {
+				memcpy(job->image.data + (size_t)y * tile_width * 4, rows + (size_t)y * stride + job->x * 4, tile_width * 4);
+			}
+			tile_queue_push(queue, job);
+		}
+	}
+	rc = 0;
+	
+label_cleanup:
+	img_jpeg_reader_close(reader);
+	free(band);
+	bgra_image_clear(image);
+	free(xs);
+	free(ys);
+	return rc;
+}
+
+static int predict_tiles(struct ai_client *client, const unsigned char *image_data, size_t cb_image, int width, int height, 
+	ai_detections_t *detections, const int *cancelled)	// the boxes of every tile, in image coordinates, not merged
+{
+	int tile_size = client->tile_size;
+	double overlap_ratio = client->tile_overlap;
+	if(overlap_ratio < 0) overlap_ratio = 0;
+	if(overlap_ratio > 0.5) overlap_ratio = 0.5;
+	int overlap = (int)(tile_size * overlap_ratio);
+	
+	int num_threads = (client->tile_concurrency > 0)?client->tile_concurrency:1;
+	tile_queue_t queue[1] = {{
+		.client = client,
+		.width = width, .height = height,
+		.size = num_threads * 2,	// the tiles waiting for a thread
+		.detections = detections,
+		.cancelled = cancelled,
+	}};
+	queue->jobs = calloc(queue->size, sizeof(*queue->jobs));
+	assert(queue->jobs);
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->not_empty, NULL);
+	pthread_cond_init(&queue->not_full, NULL);
+	
+	pthread_t *threads = calloc(num_threads, sizeof(*threads));
+	assert(threads);
+	int num_started = 0;
+	for(; num_started < num_threads; ++num_started) {
+		if(pthread_create(&threads[num_started], NULL, tile_thread, queue)) break;
+	}
+	
+	int rc = (num_started > 0)?cut_tiles(queue, image_data, cb_image, tile_size, overlap):-1;
+	tile_queue_close(queue);
+	for(int i = 0; i < num_started; ++i) pthread_join(threads[i], NULL);
+	if(queue->num_failures > 0) rc = -1;
+	
+	free(threads);
+	pthread_cond_destroy(&queue->not_full);
+	pthread_cond_destroy(&queue->not_empty);
+	pthread_mutex_destroy(&queue->mutex);
+	free(queue->jobs);
+	return rc;
+}
+
+/*
+ * predict_tiled(): 1: not tiled (tiling disabled, small image or not a jpeg / png), 
+ *   0: the merged detections of the tiles (without postprocess), -1: a tile failed or cancelled (optional flag)
+ *   The cache keeps the boxes of the tiles before the merge: changing the iou threshold needs no re-prediction.
+ */
+static int predict_tiled(struct ai_client *client, const unsigned char *image_data, size_t cb_image, ai_detections_t *detections, 
+	const int *cancelled)
+{
+	int width = 0, height = 0;
+	if(!is_tiled(client, image_data, cb_image, &width, &height)) return 1;
+	ai_detections_reset(detections);
+	
+	int rc = -1;
+	char key[AI_CACHE_KEY_SIZE] = "";
+	json_object *jcached = lookup_cache_tag(client, image_data, cb_image, 1, key);
+	if(jcached) {
+		rc = ai_detections_from_json(detections, jcached);
+		json_object_put(jcached);
+	}else {
+		rc = predict_tiles(client, image_data, cb_image, width, height, detections, cancelled);
+		if(0 == rc && client->cache) {
+			json_object *jresult = ai_detections_to_json(detections);
+			store_cache(client, key, jresult);
+			json_object_put(jresult);
+		}
+	}
+	if(rc) {
+		ai_detections_reset(detections);
+		return -1;
+	}
+	
+	// the same object seen by several tiles
+	const ai_postprocess_t *pp = client->postprocess;
+	ai_detections_nms(detections, pp?pp->iou_threshold:0.5, pp?pp->class_agnostic:0);
+	return 0;
+}
+
+int ai_client_predict(struct ai_client *client, const void *image_data, size_t cb_image, json_object **p_jresult)
+{
+	if(client->ipc) {
+		ai_image_t image = { .data = image_data, .size = cb_image };
+		json_object *jresult = NULL;
+		int rc = predict_ipc(client, &image, 1, &jresult);
+		if(p_jresult) *p_jresult = jresult;
+		else if(jresult) json_object_put(jresult);
+		return rc;
+	}
+
+	assert(client->session);
+	
+	char key[AI_CACHE_KEY_SIZE] = "";
+	json_object *jcached = lookup_cache(client, image_data, cb_image, key);
+	if(jcached) {
+		if(p_jresult) *p_jresult = jcached;
+		else json_object_put(jcached);
+		return 0;
+	}
+	
+	img_letterbox_t box[1] = {{ 0 }};
+	size_t cb_input = 0;
+	unsigned char *input = letterbox_image(client, image_data, cb_image, &cb_input, box);
+	SoupMessage *msg = input?create_predict_message(client, input, cb_input):create_predict_message(client, image_data, cb_image);
+	free(input);
+	if(NULL == msg) return -1;
+	
+	send_message(client, &msg);
+	json_object *jresult = NULL;
+	int rc = parse_response(msg, &jresult);
+	g_object_unref(msg);
+	
+	if(0 == rc && box->size > 0) map_detections(jresult, box);
+	if(0 == rc) store_cache(client, key, jresult);
+	if(p_jresult) *p_jresult = jresult;
+	else if(jresult) json_object_put(jresult);
+	return rc;
+}
+
+/*
+ * predict_detections(): the response is parsed straight into the buffer, no json tree
+ */
+int ai_client_predict_detections(struct ai_client *client, const void *image_data, size_t cb_image, ai_detections_t *detections)
+{
+	assert(client->session && detections);
+	ai_detections_reset(detections);
+	
+	int rc = predict_tiled(client, image_data, cb_image, detections, NULL);
+	if(rc <= 0) {
+		if(0 == rc && client->postprocess) ai_postprocess_apply(client->postprocess, detections);
+		return rc;
+	}
+	
+	char key[AI_CACHE_KEY_SIZE] = "";
+	json_object *jresult = lookup_cache(client, image_data, cb_image, key);
+	if(NULL == jresult && client->ipc) {
+		ai_image_t image = { .data = image_data, .size = cb_image };
+		predict_ipc(client, &image, 1, &jresult);
+	}
+	if(jresult) {
+		rc = ai_detections_from_json(detections, jresult);
+		json_object_put(jresult);
+		if(0 == rc && client->postprocess) ai_postprocess_apply(client->postprocess, detections);
+		return rc;
+	}
+	if(client->ipc) return -1;
+	
+	img_letterbox_t box[1] = {{ 0 }};
+	size_t cb_input = 0;
+	unsigned char *input = letterbox_image(client, image_data, cb_image, &cb_input, box);
+	SoupMessage *msg = input?create_predict_message(client, input, cb_input):create_predict_message(client, image_data, cb_image);
+	free(input);
+	if(NULL == msg) return -1;
+	
+	send_message(client, &msg);
+	rc = -1;
+	if(SOUP_STATUS_IS_SUCCESSFUL(msg->status_code) && msg->response_body && msg->response_body->data) {
+		rc = ai_detections_parse(detections, msg->response_body->data, msg->response_body->length);
+	}
+	g_object_unref(msg);
+	
+	if(0 == rc && box->size > 0) map_detection_boxes(detections, box);
+	if(0 == rc && client->cache) {
+		jresult = ai_detections_to_json(detections);
+		store_cache(client, key, jresult);
+		json_object_put(jresult);
+	}
+	if(0 == rc && client->postprocess) ai_postprocess_apply(client->postprocess, detections);
+	return rc;
+}
+
+/*
+ * predict_batch(): one multipart/form-data request, a part per image (name "images", in order),
+ *   the server replies { "results": [ { "detections": [...] }, ... ] } in the same order.
+ *   Cache hits are not uploaded.
+ */
+int ai_client_predict_batch(struct ai_client *client, const ai_image_t *images, size_t num_images, json_object **results)
+{
+	assert(client->session && results);
+	if(NULL == images || num_images == 0) return -1;
+	if(NULL == client->ai_server_url) return -1;
+	if(client->ipc) return predict_ipc(client, images, num_images, results);
+	memset(results, 0, num_images * sizeof(*results));
+	
+	char (*keys)[AI_CACHE_KEY_SIZE] = calloc(num_images, sizeof(*keys));
+	img_letterbox_t *boxes = calloc(num_images, sizeof(*boxes));
+	size_t *parts = calloc(num_images, sizeof(*parts));	// part index ==> image index
+	assert(keys && boxes && parts);
+	
+	size_t num_parts = 0;
+	SoupMultipart *multipart = soup_multipart_new(SOUP_FORM_MIME_TYPE_MULTIPART);
+	for(size_t i = 0; i < num_images; ++i) {
+		results[i] = lookup_cache(client, images[i].data, images[i].size, keys[i]);
+		if(results[i]) continue;
+		if(NULL == images[i].data || images[i].size == 0) continue;
+		
+		size_t cb_input = 0;
+		unsigned char *input = letterbox_image(client, images[i].data, images[i].size, &cb_input, &boxes[i]);
+		const void *data = input?(const void *)input:images[i].data;
+		size_t length = input?cb_input:images[i].size;
+		
+		char *content_type = guess_image_type(data, length);
+		if(content_type) {
+			char filename[32] = "";
+			snprintf(filename, sizeof(filename), "%zu", num_parts);
+			SoupBuffer *buffer = soup_buffer_new(SOUP_MEMORY_COPY, data, length);
+			soup_multipart_append_form_file(multipart, "images", filename, content_type, buffer);
+			soup_buffer_free(buffer);
+			g_free(content_type);
+			parts[num_parts++] = i;
+		}
+		free(input);
+	}
+	
+	if(num_parts > 0) {
+		SoupMessage *msg = soup_message_new("POST", client->ai_server_url);
+		assert(msg);
+		soup_multipart_to_message(multipart, msg->request_headers, msg->request_body);
+		send_message(client, &msg);
+		
+		json_object *jresponse = NULL;
+		json_object *jresults = NULL;
+		int rc = parse_response(msg, &jresponse);
+		g_object_unref(msg);
+		
+		if(0 == rc 
+			&& json_object_object_get_ex(jresponse, "results", &jresults)
+			&& json_object_is_type(jresults, json_type_array)
+			&& json_object_array_length(jresults) == (int)num_parts)
+		{
+			for(size_t k = 0; k < num_parts; ++k) {
+				size_t i = parts[k];
+				json_object *jresult = json_object_array_get_idx(jresults, k);
+				if(NULL == jresult || !json_object_is_type(jresult, json_type_object)) continue;
+				
+				results[i] = json_object_get(jresult);
+				if(boxes[i].size > 0) map_detections(results[i], &boxes[i]);
+				store_cache(client, keys[i], results[i]);
+			}
+		}else if(0 == rc) {
+			fprintf(stderr, "[ERROR]: %s(): invalid batch response.\n", __FUNCTION__);
+		}
+		if(jresponse) json_object_put(jresponse);
+	}
+	soup_multipart_free(multipart);
+	free(parts);
+	free(boxes);
+	free(keys);
+	
+	int rc = 0;
+	for(size_t i = 0; i < num_images; ++i) if(NULL == results[i]) rc = -1;
+	return rc;
+}
+
+static void request_free(ai_request_t *request)
+{
+	ai_detections_clear(&request->detections);
+	free(request->image_data);
+	free(request);
+}
 
-static int ai_client_set_url(struct ai_client *client, const char *server_url)
+static void deliver_detections(ai_request_t *request, int rc)
+{
+	struct ai_client *client = request->client;
+	if(0 == rc && request->letterbox.size > 0) map_detection_boxes(&request->detections, &request->letterbox);
+	if(0 == rc && client->cache) {
+		json_object *jresult = ai_detections_to_json(&request->detections);
+		store_cache(client, request->key, jresult);
+		json_object_put(jresult);
+	}
+	if(0 == rc && client->postprocess) ai_postprocess_apply(client->postprocess, &request->detections);
+	request->on_detections(client, rc, &request->detections, request->user_data);
+}
+
+static void on_got_chunk(SoupMessage *msg, SoupBuffer *chunk, ai_request_t *request)
+{
+	if(!SOUP_STATUS_IS_SUCCESSFUL(msg->status_code)) return;	// an error page
+	ai_detections_parser_feed(&request->parser, chunk->data, chunk->length);
+}
+
+static void on_predict_response(SoupSession *session, SoupMessage *msg, gpointer user_data);
+static gboolean queue_request(ai_request_t *request)
+{
+	request->retry_id = 0;
+	++request->attempts;
+	watch_message(request->msg, &request->timing);
+	if(request->on_detections) {	// parsed as the body arrives, not accumulated
+		ai_detections_parser_reset(&request->parser);
+		soup_message_body_set_accumulate(request->msg->response_body, FALSE);
+		g_signal_connect(request->msg, "got-chunk", G_CALLBACK(on_got_chunk), request);
+	}
+	request->endpoint = route_message(request->client, request->msg);
+	request->attempt_begin = now_ms();
+	soup_session_queue_message(request->client->session, request->msg, on_predict_response, request);
+	return G_SOURCE_REMOVE;
+}
+
+static void on_predict_response(SoupSession *session, SoupMessage *msg, gpointer user_data)
+{
+	ai_request_t *request = user_data;
+	assert(request && request->msg == msg);
+	struct ai_client *client = request->client;
+	endpoint_done(client, request->endpoint, msg->status_code, now_ms() - request->attempt_begin);
+	request->endpoint = NULL;
+	
+	if(!request->cancelled && request->attempts <= client->max_retries && is_retryable(msg->status_code)) {
+		// msg is unreferenced by the session, the retry is a copy
+		request->msg = clone_message(msg);
+		request->retry_id = g_timeout_add(backoff_delay_ms(client, request->attempts - 1), (GSourceFunc)queue_request, request);
+		return;
+	}
+	
+	if(!request->cancelled && msg->status_code != SOUP_STATUS_CANCELLED) {
+		update_stats(client, &request->stats, msg, &request->timing, request->attempts);
+		if(request->on_detections) {	// already parsed by on_got_chunk()
+			int rc = SOUP_STATUS_IS_SUCCESSFUL(msg->status_code)?ai_detections_parser_finish(&request->parser):-1;
+			deliver_detections(request, rc);
+		}else {
+			json_object *jresult = NULL;
+			int rc = parse_response(msg, &jresult);
+			if(0 == rc && request->letterbox.size > 0) map_detections(jresult, &request->letterbox);
+			if(0 == rc) store_cache(request->client, request->key, jresult);
+			if(request->callback) request->callback(request->client, rc, jresult, request->user_data);
+			if(jresult) json_object_put(jresult);
+		}
+	}
+	request_free(request);	// msg is unreferenced by the session
+	return;
+}
+
+static gboolean deliver_cached(ai_request_t *request)
+{
+	request->idle_id = 0;
+	int rc = request->jcached?0:-1;	// failed local (ipc) prediction or preprocessing
+	if(request->on_detections) {
+		if(0 == rc) rc = ai_detections_from_json(&request->detections, request->jcached);
+		if(0 == rc && request->client->postprocess) ai_postprocess_apply(request->client->postprocess, &request->detections);
+		request->on_detections(request->client, rc, &request->detections, request->user_data);
+	}else if(request->callback) {
+		request->callback(request->client, rc, request->jcached, request->user_data);
+	}
+	if(request->jcached) json_object_put(request->jcached);
+	request_free(request);
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * workers: the decoding, letterboxing and re-encoding of an async request take tens to hundreds of 
+ *   milliseconds for a large image, a local server may stall, the tiles of a very large one take seconds:
+ *   they run on worker threads from a copy of the image, at most AI_CLIENT_WORKERS images at a time.
+ *   The prepared message is queued (or the result delivered) from an idle callback.
+ *   Every request in this phase is listed in client->pending, ai_client_free() frees those left.
+ */
+#define AI_CLIENT_WORKERS	(2)
+
+static void pending_unlink(struct ai_client *client, ai_request_t *request)	// jobs_lock held
+{
+	if(request->prev) request->prev->next = request->next;
+	else client->pending = request->next;
+	if(request->next) request->next->prev = request->prev;
+	request->prev = request->next = NULL;
+	request->in_worker = 0;
+}
+
+static void discard_request(ai_request_t *request)	// not delivered: cancelled or the client is closing
+{
+	if(request->msg) g_object_unref(request->msg);
+	if(request->jcached) json_object_put(request->jcached);
+	request_free(request);
+}
+
+static gboolean deliver_tiled(ai_request_t *request)
+{
+	if(0 == request->rc && request->client->postprocess) ai_postprocess_apply(request->client->postprocess, &request->detections);
+	request->on_detections(request->client, request->rc, &request->detections, request->user_data);
+	request_free(request);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean on_request_prepared(ai_request_t *request)	// main loop
+{
+	struct ai_client *client = request->client;
+	pthread_mutex_lock(&client->jobs_lock);
+	pending_unlink(client, request);
+	request->idle_id = 0;
+	pthread_mutex_unlock(&client->jobs_lock);
+	
+	if(request->tiled) return deliver_tiled(request);
+	if(NULL == request->msg) return deliver_cached(request);	// ipc result, or preprocessing failed
+	
+	request->stats.total_time = now_ms();
+	queue_request(request);
+	return G_SOURCE_REMOVE;
+}
+
+static void prepare_request(struct ai_client *client, ai_request_t *request)	// worker thread
+{
+	if(request->tiled) {	// stops early when cancelled
+		request->rc = predict_tiled(client, request->image_data, request->cb_image, &request->detections, &request->cancelled);
+		return;
+	}
+	if(client->ipc) {	// a round-trip to the local server, bounded by client->timeout
+		ai_image_t image = { .data = request->image_data, .size = request->cb_image };
+		predict_ipc(client, &image, 1, &request->jcached);
+		return;
+	}
+	
+	size_t cb_input = 0;
+	unsigned char *input = letterbox_image(client, request->image_data, request->cb_image, &cb_input, &request->letterbox);
+	request->msg = input?create_predict_message(client, input, cb_input)
+		:create_predict_message(client, request->image_data, request->cb_image);
+	free(input);
+}
+
+static void *worker_thread(void *user_data)
+{
+	struct ai_client *client = user_data;
+	while(1) {
+		pthread_mutex_lock(&client->jobs_lock);
+		while(NULL == client->jobs && !client->quit) pthread_cond_wait(&client->jobs_cond, &client->jobs_lock);
+		ai_request_t *request = client->jobs;
+		if(NULL == request) {	// quit, no jobs left
+			pthread_mutex_unlock(&client->jobs_lock);
+			break;
+		}
+		client->jobs = request->next_job;
+		if(NULL == client->jobs) client->jobs_tail = NULL;
+		pthread_mutex_unlock(&client->jobs_lock);
+		
+		if(!__atomic_load_n(&request->cancelled, __ATOMIC_ACQUIRE)) prepare_request(client, request);
+		
+		// back to the main loop, unless cancelled meanwhile
+		pthread_mutex_lock(&client->jobs_lock);
+		int cancelled = __atomic_load_n(&request->cancelled, __ATOMIC_ACQUIRE);
+		if(cancelled) pending_unlink(client, request);
+		else request->idle_id = g_idle_add((GSourceFunc)on_request_prepared, request);
+		pthread_mutex_unlock(&client->jobs_lock);
+		if(cancelled) discard_request(request);
+	}
+	return NULL;
+}
+
+static ai_request_t *queue_job(struct ai_client *client, ai_request_t *request, const void *image_data, size_t cb_image)
+{
+	request->image_data = malloc(cb_image);
+	assert(request->image_data);
+	memcpy(request->image_data, image_data, cb_image);
+	request->cb_image = cb_image;
+	
+	pthread_mutex_lock(&client->jobs_lock);
+	if(NULL == client->workers) {
+		client->workers = calloc(AI_CLIENT_WORKERS, sizeof(*client->workers));
+		assert(client->workers);
+		for(; client->num_workers < AI_CLIENT_WORKERS; ++client->num_workers) {
+			if(pthread_create(&client->workers[client->num_workers], NULL, worker_thread, client)) break;
+		}
+	}
+	if(client->num_workers == 0) {
+		pthread_mutex_unlock(&client->jobs_lock);
+		request_free(request);
+		return NULL;
+	}
+	
+	request->in_worker = 1;
+	request->next = client->pending;
+	if(client->pending) client->pending->prev = request;
+	client->pending = request;
+	
+	if(client->jobs_tail) client->jobs_tail->next_job = request;
+	else client->jobs = request;
+	client->jobs_tail = request;
+	pthread_cond_signal(&client->jobs_cond);
+	pthread_mutex_unlock(&client->jobs_lock);
+	return request;
+}
+
+static void stop_workers(struct ai_client *client)
+{
+	pthread_mutex_lock(&client->jobs_lock);
+	client->quit = 1;
+	for(ai_request_t *request = client->pending; request; request = request->next) {
+		__atomic_store_n(&request->cancelled, 1, __ATOMIC_RELEASE);
+	}
+	pthread_cond_broadcast(&client->jobs_cond);
+	pthread_mutex_unlock(&client->jobs_lock);
+	
+	if(client->session) soup_session_abort(client->session);	// blocking requests of the workers return at once
+	for(int i = 0; i < client->num_workers; ++i) pthread_join(client->workers[i], NULL);
+	free(client->workers);
+	client->workers = NULL;
+	client->num_workers = 0;
+	
+	// prepared, not delivered yet
+	while(client->pending) {
+		ai_request_t *request = client->pending;
+		pending_unlink(client, request);
+		if(request->idle_id) g_source_remove(request->idle_id);
+		discard_request(request);
+	}
+}
+
+static ai_request_t *submit_request(struct ai_client *client, ai_request_t *request, const void *image_data, size_t cb_image)
+{
+	// cache hit: a hash and a lookup, still completed asynchronously like a network reply
+	request->jcached = lookup_cache(client, image_data, cb_image, request->key);
+	if(request->jcached) {
+		request->idle_id = g_idle_add((GSourceFunc)deliver_cached, request);
+		return request;
+	}
+	
+	// decoded (and letterboxed) by a worker: the local server's result is delivered like a cache hit
+	if(client->ipc || client->input_size > 0) return queue_job(client, request, image_data, cb_image);
+	
+	size_t cb_input = 0;
+	unsigned char *input = letterbox_image(client, image_data, cb_image, &cb_input, &request->letterbox);
+	SoupMessage *msg = input?create_predict_message(client, input, cb_input):create_predict_message(client, image_data, cb_image);
+	free(input);
+	if(NULL == msg) {
+		request_free(request);
+		return NULL;
+	}
+	request->msg = msg;
+	request->stats.total_time = now_ms();
+	
+	queue_request(request);
+	return request;
+}
+
+ai_request_t *ai_client_predict_async(struct ai_client *client, const void *image_data, size_t cb_image, 
+	ai_predict_callback callback, void *user_data)
+{
+	assert(client->session);
+	
+	ai_request_t *request = calloc(1, sizeof(*request));
+	assert(request);
+	request->client = client;
+	request->callback = callback;
+	request->user_data = user_data;
+	return submit_request(client, request, image_data, cb_image);
+}
+
+ai_request_t *ai_client_predict_detections_async(struct ai_client *client, const void *image_data, size_t cb_image, 
+	ai_detections_callback callback, void *user_data)
+{
+	assert(client->session && callback);
+	
+	ai_request_t *request = calloc(1, sizeof(*request));
+	assert(request);
+	request->client = client;
+	request->on_detections = callback;
+	request->user_data = user_data;
+	ai_detections_parser_init(&request->parser, &request->detections);
+	
+	int width = 0, height = 0;
+	if(is_tiled(client, image_data, cb_image, &width, &height)) {
+		request->tiled = 1;
+		return queue_job(client, request, image_data, cb_image);
+	}
+	return submit_request(client, request, image_data, cb_image);
+}
+
+void ai_client_cancel(struct ai_client *client, ai_request_t *request)
+{
+	if(NULL == request) return;
+	if(request->in_worker) {
+		pthread_mutex_lock(&client->jobs_lock);
+		if(request->in_worker) {
+			__atomic_store_n(&request->cancelled, 1, __ATOMIC_RELEASE);
+			guint idle_id = request->idle_id;
+			if(idle_id) {	// prepared, on_request_prepared() not called yet
+				g_source_remove(idle_id);
+				pending_unlink(client, request);
+			}
+			pthread_mutex_unlock(&client->jobs_lock);
+			if(idle_id) discard_request(request);	// else freed by the worker
+			return;
+		}
+		pthread_mutex_unlock(&client->jobs_lock);
+	}
+	if(request->idle_id) {	// cache hit or ipc result, not delivered yet
+		g_source_remove(request->idle_id);
+		json_object_put(request->jcached);
+		request_free(request);
+		return;
+	}
+	if(request->retry_id) {	// waiting for a retry: the message is not queued
+		g_source_remove(request->retry_id);
+		g_object_unref(request->msg);
+		request_free(request);
+		return;
+	}
+	request->cancelled = 1;
+	soup_session_cancel_message(client->session, request->msg, SOUP_STATUS_CANCELLED);	// frees the request
+	return;
+}
+
+
+static int set_limits(struct ai_client *client, int max_connections, int timeout)
+{
+	if(max_connections < 1) max_connections = 1;
+	if(timeout < 0) timeout = 0;
+	client->max_connections = max_connections;
+	client->timeout = timeout;
+	
+	// requests beyond max_connections wait in the session queue (reported as queue_time),
+	// idle connections are kept alive and reused
+	g_object_set(client->session, 
+		SOUP_SESSION_MAX_CONNS, max_connections,
+		SOUP_SESSION_MAX_CONNS_PER_HOST, max_connections,
+		SOUP_SESSION_TIMEOUT, (guint)timeout,
+		NULL);
+	if(client->ipc) ai_ipc_client_set_timeout(client->ipc, timeout);
+	return 0;
+}
+
+static void clear_endpoints(struct ai_client *client)
+{
+	pthread_mutex_lock(&client->endpoints_lock);
+	for(int i = 0; i < client->num_endpoints; ++i) free(client->endpoints[i].url);
+	free(client->endpoints);
+	client->endpoints = NULL;
+	client->num_endpoints = 0;
+	pthread_mutex_unlock(&client->endpoints_lock);
+}
+
+int ai_client_add_endpoint(struct ai_client *client, const char *url)
+{
+	if(NULL == url || !url[0]) return -1;
+	
+	if(0 == strncmp(url, AI_IPC_URL_PREFIX, sizeof(AI_IPC_URL_PREFIX) - 1)) {	// local server, replaces http
+		if(client->ipc) {
+			fprintf(stderr, "[WARNING]: %s(): only one local server, %s ignored.\n", __FUNCTION__, url);
+			return -1;
+		}
+		client->ipc = ai_ipc_client_new(url + sizeof(AI_IPC_URL_PREFIX) - 1, client->ipc_ring_size);
+		ai_ipc_client_set_timeout(client->ipc, client->timeout);
+		if(NULL == client->ai_server_url) client->ai_server_url = strdup(url);
+		return 0;
+	}
+	
+	pthread_mutex_lock(&client->endpoints_lock);
+	ai_endpoint_t *endpoints = realloc(client->endpoints, (client->num_endpoints + 1) * sizeof(*endpoints));
+	assert(endpoints);
+	memset(&endpoints[client->num_endpoints], 0, sizeof(*endpoints));
+	endpoints[client->num_endpoints].url = strdup(url);
+	client->endpoints = endpoints;
+	++client->num_endpoints;
+	pthread_mutex_unlock(&client->endpoints_lock);
+	
+	// the first endpoint names the service (messages, cache keys)
+	if(NULL == client->ai_server_url) client->ai_server_url = strdup(url);
+	return 0;
+}
+
+int ai_client_set_url(struct ai_client *client, const char *server_url)
 {
 	if(client->ai_server_url) {
 		free(client->ai_server_url);
 		client->ai_server_url = NULL;
 	}
+	clear_endpoints(client);
+	ai_ipc_client_free(client->ipc);
+	client->ipc = NULL;
+	
+	if(server_url) ai_client_add_endpoint(client, server_url);
+	return 0;
+}
+
+int ai_client_load_endpoints(struct ai_client *client, json_object *jurls)
+{
+	if(NULL == jurls) return -1;
+	if(json_object_is_type(jurls, json_type_string)) return ai_client_set_url(client, json_object_get_string(jurls));
+	if(!json_object_is_type(jurls, json_type_array)) return -1;
+	
+	ai_client_set_url(client, NULL);
+	int num_urls = json_object_array_length(jurls);
+	for(int i = 0; i < num_urls; ++i) {
+		ai_client_add_endpoint(client, json_object_get_string(json_object_array_get_idx(jurls, i)));
+	}
+	return (client->num_endpoints > 0 || client->ipc)?0:-1;
+}
+
+const char *ai_client_get_url(const struct ai_client *client)
+{
+	return client->ai_server_url;
+}
+
+int ai_client_get_num_endpoints(const struct ai_client *client)
+{
+	return client->num_endpoints;
+}
+
+const char *ai_client_get_endpoint_url(const struct ai_client *client, int index)
+{
+	if(index < 0 || index >= client->num_endpoints) return NULL;
+	return client->endpoints[index].url;
+}
+
+void ai_client_get_stats(const struct ai_client *client, long *num_requests, long *num_retries, long *num_failures)
+{
+	if(num_requests) *num_requests = __atomic_load_n(&client->stats.num_requests, __ATOMIC_RELAXED);
+	if(num_retries) *num_retries = __atomic_load_n(&client->stats.num_retries, __ATOMIC_RELAXED);
+	if(num_failures) *num_failures = __atomic_load_n(&client->stats.num_failures, __ATOMIC_RELAXED);
+}
+
+void *ai_client_get_user_data(const struct ai_client *client)
+{
+	return client->user_data;
+}
+
+/*
+ * options: copied field by field, only the ones within 'size' (the caller's version of the struct)
+ */
+#define options_has(field, size) (offsetof(ai_client_options_t, field) + sizeof(((ai_client_options_t *)0)->field) <= (size))
+
+void ai_client_get_options(const struct ai_client *client, ai_client_options_t *options, size_t size)
+{
+	assert(client && options);
+	ai_client_options_t current = {
+		.max_connections = client->max_connections,
+		.timeout = client->timeout,
+		.max_retries = client->max_retries,
+		.retry_base_ms = client->retry_base_ms,
+		.eject_ms = client->eject_ms,
+		.ipc_ring_size = client->ipc_ring_size,
+		.input_size = client->input_size,
+		.jpeg_quality = client->jpeg_quality,
+		.tile_size = client->tile_size,
+		.tile_overlap = client->tile_overlap,
+		.tile_concurrency = client->tile_concurrency,
+		.on_stats = client->on_stats,
+		.on_tile_stats = client->on_tile_stats,
+	};
+	if(size > sizeof(current)) size = sizeof(current);
+	memcpy(options, &current, size);
+}
+
+int ai_client_set_options(struct ai_client *client, const ai_client_options_t *options, size_t size)
+{
+	assert(client && options);
+	ai_client_options_t current;
+	ai_client_get_options(client, &current, sizeof(current));
+	if(size > sizeof(current)) size = sizeof(current);
+	
+#define set_option(field) do { if(options_has(field, size)) current.field = options->field; } while(0)
+	set_option(max_connections);
+	set_option(timeout);
+	set_option(max_retries);
+	set_option(retry_base_ms);
+	set_option(eject_ms);
+	set_option(ipc_ring_size);
+	set_option(input_size);
+	set_option(jpeg_quality);
+	set_option(tile_size);
+	set_option(tile_overlap);
+	set_option(tile_concurrency);
+	set_option(on_stats);
+	set_option(on_tile_stats);
+#undef set_option
 	
-	if(server_url) client->ai_server_url = strdup(server_url);
+	client->max_retries = current.max_retries;
+	client->retry_base_ms = current.retry_base_ms;
+	client->eject_ms = current.eject_ms;
+	client->ipc_ring_size = current.ipc_ring_size;
+	client->input_size = current.input_size;
+	client->jpeg_quality = current.jpeg_quality;
+	client->tile_size = current.tile_size;
+	client->tile_overlap = current.tile_overlap;
+	client->tile_concurrency = current.tile_concurrency;
+	client->on_stats = current.on_stats;
+	client->on_tile_stats = current.on_tile_stats;
+	return set_limits(client, current.max_connections, current.timeout);
+}
+
+void ai_client_set_cache(struct ai_client *client, ai_cache_t *cache)
+{
+	if(client->cache == cache) return;
+	ai_cache_free(client->cache);
+	client->cache = cache;
+}
+
+int ai_client_set_model_version(struct ai_client *client, const char *model_version)
+{
+	free(client->model_version);
+	client->model_version = model_version?strdup(model_version):NULL;
 	return 0;
 }
 
-struct ai_client *ai_client_init(struct ai_client *client, void *user_data)
+void ai_client_set_postprocess(struct ai_client *client, const ai_postprocess_t *postprocess)
 {
-	if(NULL == client) client = calloc(1, sizeof(*client));
+	client->postprocess = postprocess;
+}
+
+struct ai_client *ai_client_new(void *user_data)
+{
+	struct ai_client *client = calloc(1, sizeof(*client));
 	assert(client);
 	
 	client->user_data = user_data;
-	client->set_url = ai_client_set_url;
-	client->predict = ai_client_predict;
+	pthread_mutex_init(&client->endpoints_lock, NULL);
+	client->eject_ms = 10000;
+	client->ipc_ring_size = 64 * 1024 * 1024;
+	pthread_mutex_init(&client->jobs_lock, NULL);
+	pthread_cond_init(&client->jobs_cond, NULL);
+	client->jpeg_quality = 90;
+	client->tile_overlap = 0.2;
+	client->tile_concurrency = 4;
 	
-	client->session = soup_session_new_with_options(SOUP_SESSION_USER_AGENT, "soup/2.4 Mozilla/5.0", NULL);
+	client->session = soup_session_new_with_options(SOUP_SESSION_USER_AGENT, "soup/2.4 Mozilla/5.0", 
+		SOUP_SESSION_IDLE_TIMEOUT, 60,
+		NULL);
 	assert(client->session);
 	
+	client->max_retries = 2;
+	client->retry_base_ms = 200;
+	set_limits(client, 4, 30);
+	
 	return client;
 }
-void ai_client_cleanup(struct ai_client *client)
+
+void ai_client_free(struct ai_client *client)
 {
 	if(NULL == client) return;
+	stop_workers(client);
+	pthread_cond_destroy(&client->jobs_cond);
+	pthread_mutex_destroy(&client->jobs_lock);
 	
-	if(client->ai_server_url) {
-		free(client->ai_server_url);
-		client->ai_server_url = NULL;
-	}
+	free(client->ai_server_url);
+	clear_endpoints(client);
+	pthread_mutex_destroy(&client->endpoints_lock);
+	ai_ipc_client_free(client->ipc);
 	
-	if(client->session) {
-		g_object_unref(client->session);
-		client->session = NULL;
-	}
+	if(client->session) g_object_unref(client->session);
+	ai_cache_free(client->cache);
+	free(client->model_version);
+	free(client);
 }
 
 
 #if defined(TEST_AI_CLIENT_) && defined(_STAND_ALONE)
-#include "utils.h"
 int main(int argc, char **argv)
 {
 	const char *server_url = "http://127.0.0.1:9090/ai";
 	if(argc > 1) server_url = argv[1];
 	
-	struct ai_client *client = ai_client_init(NULL, NULL);
-	client->set_url(client, server_url);
+	struct ai_client *client = ai_client_new(NULL);
+	ai_client_set_url(client, server_url);
 
 	const char *jpeg_file = "test.jpg";
 	const char *png_file = "test.png";
@@ -146,7 +1697,7 @@ int main(int argc, char **argv)
 	
 	cb_image = load_binary_data(jpeg_file, &image_data);
 	assert(image_data && cb_image > 0);
-	rc = client->predict(client, image_data, cb_image, &jresult);
+	rc = ai_client_predict(client, image_data, cb_image, &jresult);
 	assert(0 == rc);
 	printf("== image_file: %s, result:\n%s\n",
 		jpeg_file, 
@@ -161,7 +1712,7 @@ int main(int argc, char **argv)
 	
 	cb_image = load_binary_data(png_file, &image_data);
 	assert(image_data && cb_image > 0);
-	rc = client->predict(client, image_data, cb_image, &jresult);
+	rc = ai_client_predict(client, image_data, cb_image, &jresult);
 	assert(0 == rc);
 	printf("== image_file: %s, result:\n%s\n",
 		png_file, 
@@ -174,6 +1725,7 @@ int main(int argc, char **argv)
 	image_data = NULL;
 	cb_image = 0;
 	
+	ai_client_free(client);
 	return 0;
 }
 #endif
@@ -0,0 +1,709 @@
+/*
+ * ai-detections.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "ai-detections.h"
+#include "utils.h"
+
+/*************************************************
+ * buffer
+*************************************************/
+#define AI_DETECTIONS_ALLOCATION_SIZE	(256)
+void ai_detections_reset(ai_detections_t *detections)
+{
+	if(detections) detections->length = 0;
+}
+
+void ai_detections_clear(ai_detections_t *detections)
+{
+	if(NULL == detections) return;
+	free(detections->data);
+	detections->data = NULL;
+	detections->length = 0;
+	detections->max_size = 0;
+}
+
+int ai_detections_append(ai_detections_t *detections, const ai_detection_t *detection)
+{
+	assert(detections && detection);
+	if(detections->length >= detections->max_size) {
+		ssize_t new_size = detections->max_size?(detections->max_size * 2):AI_DETECTIONS_ALLOCATION_SIZE;
+		ai_detection_t *data = realloc(detections->data, new_size * sizeof(*data));
+		if(NULL == data) return -1;
+		detections->data = data;
+		detections->max_size = new_size;
+	}
+	detections->data[detections->length++] = *detection;
+	return 0;
+}
+
+json_object *ai_detections_to_json(const ai_detections_t *detections)
+{
+	json_object *jdetections = json_object_new_array();
+	for(ssize_t i = 0; i < detections->length; ++i) {
+		const ai_detection_t *det = &detections->data[i];
+		json_object *jdet = json_object_new_object();
+		json_object_object_add(jdet, "class_index", json_object_new_int(det->class_index));
+		json_object_object_add(jdet, "score", json_object_new_double(det->score));
+		json_object_object_add(jdet, "left", json_object_new_double(det->left));
+		json_object_object_add(jdet, "top", json_object_new_double(det->top));
+		json_object_object_add(jdet, "width", json_object_new_double(det->width));
+		json_object_object_add(jdet, "height", json_object_new_double(det->height));
+		json_object_array_add(jdetections, jdet);
+	}
+
+	json_object *jresult = json_object_new_object();
+	json_object_object_add(jresult, "detections", jdetections);
+	return jresult;
+}
+
+int ai_detections_from_json(ai_detections_t *detections, json_object *jresult)
+{
+	json_object *jdetections = NULL;
+	if(NULL == jresult || !json_object_object_get_ex(jresult, "detections", &jdetections)) return -1;
+	if(!json_object_is_type(jdetections, json_type_array)) return -1;
+
+	int num_detections = json_object_array_length(jdetections);
+	for(int i = 0; i < num_detections; ++i) {
+		json_object *jdet = json_object_array_get_idx(jdetections, i);
+		if(NULL == jdet) continue;
+
+		ai_detection_t det = {
+			.class_index = json_get_value(jdet, int, class_index),
+			.score = json_get_value_default(jdet, double, score, 1.0),
+			.left = json_get_value(jdet, double, left),
+			.top = json_get_value(jdet, double, top),
+			.width = json_get_value(jdet, double, width),
+			.height = json_get_value(jdet, double, height),
+		};
+		if(ai_detections_append(detections, &det)) return -1;
+	}
+	return 0;
+}
+
+/*************************************************
+ * parser
+*************************************************/
+enum lex_state
+{
+	LEX_NONE,
+	LEX_STRING,
+	LEX_ESCAPE,
+	LEX_UNICODE,
+	LEX_NUMBER,
+	LEX_LITERAL,
+};
+
+enum parse_state
+{
+	EXPECT_VALUE,
+	EXPECT_VALUE_OR_END,	// after '['
+	EXPECT_KEY,				// after ',' in an object
+	EXPECT_KEY_OR_END,		// after '{'
+	EXPECT_COLON,
+	EXPECT_COMMA_OR_END,	// after a value in a container
+};
+
+// tokens: the punctuation characters, TOKEN_STRING, TOKEN_NUMBER, TOKEN_LITERAL
+#define TOKEN_STRING	's'
+#define TOKEN_NUMBER	'n'
+#define TOKEN_LITERAL	'l'
+
+enum detection_field
+{
+	FIELD_NONE,
+	FIELD_CLASS_INDEX,
+	FIELD_SCORE,
+	FIELD_LEFT,
+	FIELD_TOP,
+	FIELD_WIDTH,
+	FIELD_HEIGHT,
+};
+
+static const char *s_field_names[] = {
+	[FIELD_CLASS_INDEX] = "class_index",
+	[FIELD_SCORE] = "score",
+	[FIELD_LEFT] = "left",
+	[FIELD_TOP] = "top",
+	[FIELD_WIDTH] = "width",
+	[FIELD_HEIGHT] = "height",
+};
+
+ai_detections_parser_t *ai_detections_parser_init(ai_detections_parser_t *parser, ai_detections_t *detections)
+{
+	assert(detections);
+	if(NULL == parser) parser = calloc(1, sizeof(*parser));
+	assert(parser);
+	parser->detections = detections;
+	ai_detections_parser_reset(parser);
+	return parser;
+}
+
+void ai_detections_parser_reset(ai_detections_parser_t *parser)
+{
+	ai_detections_t *detections = parser->detections;
+	memset(parser, 0, sizeof(*parser));
+	parser->detections = detections;
+	parser->state = EXPECT_VALUE;
+	parser->lex = LEX_NONE;
+	ai_detections_reset(detections);
+}
+
+/*
+ * numbers: json grammar, independent of the locale (gtk_init() may set one with a decimal comma).
+ *   Read one character at a time, any length: the digits after the first 19 significant ones 
+ *   only move the decimal exponent.
+ */
+enum number_state
+{
+	NUMBER_SIGN,		// after '-'
+	NUMBER_ZERO,		// a leading '0'
+	NUMBER_INTEGER,
+	NUMBER_POINT,		// after '.'
+	NUMBER_FRACTION,
+	NUMBER_E,			// after 'e'
+	NUMBER_EXP_SIGN,	// after 'e+' or 'e-'
+	NUMBER_EXP,
+};
+#define NUMBER_MAX_DIGITS	(19)
+
+static int is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static void begin_number(ai_detections_parser_t *parser, char c)
+{
+	memset(&parser->number, 0, sizeof(parser->number));
+	if(c == '-') {
+		parser->number.negative = 1;
+		parser->number.state = NUMBER_SIGN;
+		return;
+	}
+	parser->number.state = (c == '0')?NUMBER_ZERO:NUMBER_INTEGER;
+	parser->number.mantissa = c - '0';
+	parser->number.digits = (c != '0');
+}
+
+static void push_digit(ai_detections_parser_t *parser, char c, int fraction)
+{
+	if(parser->number.digits >= NUMBER_MAX_DIGITS) {
+		if(!fraction) ++parser->number.exponent;	// beyond the precision of a double
+		return;
+	}
+	parser->number.mantissa = parser->number.mantissa * 10.0 + (c - '0');
+	if(parser->number.digits > 0 || c != '0') ++parser->number.digits;	// leading zeros are not significant
+	if(fraction) --parser->number.exponent;
+}
+
+// 0: 'c' is part of the number, 1: 'c' ends it, -1: invalid number
+static int number_push(ai_detections_parser_t *parser, char c)
+{
+	int state = parser->number.state;
+	if(is_digit(c)) {
+		switch(state) {
+		case NUMBER_SIGN:
+			parser->number.state = (c == '0')?NUMBER_ZERO:NUMBER_INTEGER;
+			push_digit(parser, c, 0);
+			return 0;
+		case NUMBER_ZERO: return -1;	// no leading zeros
+		case NUMBER_INTEGER: push_digit(parser, c, 0); return 0;
+		case NUMBER_POINT: 
+		case NUMBER_FRACTION:
+			parser->number.state = NUMBER_FRACTION;
+			push_digit(parser, c, 1);
+			return 0;
+		default:
+			parser->number.state = NUMBER_EXP;
+			if(parser->number.exp < 100000) parser->number.exp = parser->number.exp * 10 + (c - '0');
+			return 0;
+		}
+	}
+	switch(c) {
+	case '.':
+		if(state != NUMBER_ZERO && state != NUMBER_INTEGER) return -1;
+		parser->number.state = NUMBER_POINT;
+		return 0;
+	case 'e': case 'E':
+		if(state != NUMBER_ZERO && state != NUMBER_INTEGER && state != NUMBER_FRACTION) return -1;
+		parser->number.state = NUMBER_E;
+		return 0;
+	case '+': case '-':
+		if(state != NUMBER_E) return -1;
+		parser->number.exp_negative = (c == '-');
+		parser->number.state = NUMBER_EXP_SIGN;
+		return 0;
+	default:
+		break;
+	}
+	return 1;
+}
+
+static int end_number(ai_detections_parser_t *parser)
+{
+	int state = parser->number.state;
+	if(state != NUMBER_ZERO && state != NUMBER_INTEGER && state != NUMBER_FRACTION && state != NUMBER_EXP) return -1;
+	
+	// 10^0 ~ 10^22 are exact doubles
+	static const double s_powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	int exponent = parser->number.exponent + (parser->number.exp_negative?-parser->number.exp:parser->number.exp);
+	int e = (exponent < 0)?-exponent:exponent;
+	double scale = (e <= 22)?s_powers[e]:pow(10.0, e);
+	double value = parser->number.mantissa;
+	if(exponent < 0) value /= scale;
+	else value *= scale;
+	parser->number.value = parser->number.negative?-value:value;
+	return 0;
+}
+
+static int in_detection(const ai_detections_parser_t *parser)	// directly inside a detection object
+{
+	return parser->detections_depth > 0 && parser->depth == parser->detections_depth + 1;
+}
+
+static void value_done(ai_detections_parser_t *parser)
+{
+	parser->is_detections_key = 0;
+	parser->field = FIELD_NONE;
+	if(parser->depth == 0) parser->done = 1;
+	else parser->state = EXPECT_COMMA_OR_END;
+}
+
+static int open_container(ai_detections_parser_t *parser, char type)
+{
+	if(parser->depth >= AI_DETECTIONS_PARSER_MAX_DEPTH) return -1;
+
+	if(type == '[' && parser->is_detections_key) {
+		parser->detections_depth = parser->depth + 1;
+		parser->has_detections = 1;
+	}else if(type == '{' && parser->detections_depth > 0 && parser->depth == parser->detections_depth) {
+		memset(&parser->current, 0, sizeof(parser->current));
+		parser->current.score = 1.0;
+	}
+	parser->is_detections_key = 0;
+	parser->field = FIELD_NONE;
+
+	parser->stack[parser->depth++] = type;
+	parser->state = (type == '{')?EXPECT_KEY_OR_END:EXPECT_VALUE_OR_END;
+	return 0;
+}
+
+static int close_container(ai_detections_parser_t *parser, char type)
+{
+	if(parser->depth == 0 || parser->stack[parser->depth - 1] != type) return -1;
+	--parser->depth;
+
+	if(parser->detections_depth > 0) {
+		if(type == '{' && parser->depth == parser->detections_depth) {	// a detection is complete
+			if(ai_detections_append(parser->detections, &parser->current)) return -1;
+		}else if(type == '[' && parser->depth == parser->detections_depth - 1) {
+			parser->detections_depth = 0;
+		}
+	}
+	value_done(parser);
+	return 0;
+}
+
+static void on_key(ai_detections_parser_t *parser)
+{
+	parser->is_detections_key = 0;
+	parser->field = FIELD_NONE;
+	if(parser->token_length >= AI_DETECTIONS_PARSER_TOKEN_SIZE) return;	// truncated: none of ours
+
+	if(parser->depth == 1 && parser->stack[0] == '{') {
+		parser->is_detections_key = (0 == strcmp(parser->token, "detections"));
+		return;
+	}
+	if(in_detection(parser)) {
+		for(int i = FIELD_CLASS_INDEX; i <= FIELD_HEIGHT; ++i) {
+			if(0 == strcmp(parser->token, s_field_names[i])) {
+				parser->field = i;
+				break;
+			}
+		}
+	}
+}
+
+static int on_scalar(ai_detections_parser_t *parser, int type)
+{
+	if(type == TOKEN_NUMBER) {
+		double value = parser->number.value;
+
+		ai_detection_t *det = &parser->current;
+		switch(parser->field) {
+		case FIELD_CLASS_INDEX: det->class_index = (int)value; break;
+		case FIELD_SCORE: det->score = value; break;
+		case FIELD_LEFT: det->left = value; break;
+		case FIELD_TOP: det->top = value; break;
+		case FIELD_WIDTH: det->width = value; break;
+		case FIELD_HEIGHT: det->height = value; break;
+		default: break;
+		}
+	}else if(type == TOKEN_LITERAL) {
+		if(strcmp(parser->token, "true") && strcmp(parser->token, "false") && strcmp(parser->token, "null")) return -1;
+	}
+	value_done(parser);
+	return 0;
+}
+
+static int on_token(ai_detections_parser_t *parser, int type)
+{
+	if(parser->done) return -1;	// trailing content
+
+	switch(parser->state) {
+	case EXPECT_VALUE_OR_END:
+		if(type == ']') return close_container(parser, '[');
+		// fall through
+	case EXPECT_VALUE:
+		if(type == '{' || type == '[') return open_container(parser, type);
+		if(type == TOKEN_STRING || type == TOKEN_NUMBER || type == TOKEN_LITERAL) return on_scalar(parser, type);
+		return -1;
+	case EXPECT_KEY_OR_END:
+		if(type == '}') return close_container(parser, '{');
+		// fall through
+	case EXPECT_KEY:
+		if(type != TOKEN_STRING) return -1;
+		on_key(parser);
+		parser->state = EXPECT_COLON;
+		return 0;
+	case EXPECT_COLON:
+		if(type != ':') return -1;
+		parser->state = EXPECT_VALUE;
+		return 0;
+	case EXPECT_COMMA_OR_END:
+		if(type == ',') {
+			parser->state = (parser->stack[parser->depth - 1] == '{')?EXPECT_KEY:EXPECT_VALUE;
+			return 0;
+		}
+		if(type == '}') return close_container(parser, '{');
+		if(type == ']') return close_container(parser, '[');
+		return -1;
+	default:
+		break;
+	}
+	return -1;
+}
+
+static void push_char(ai_detections_parser_t *parser, char c)
+{
+	if(parser->token_length < AI_DETECTIONS_PARSER_TOKEN_SIZE - 1) {
+		parser->token[parser->token_length] = c;
+		parser->token[parser->token_length + 1] = '\0';
+	}
+	++parser->token_length;	// >= TOKEN_SIZE: truncated
+}
+
+static int end_token(ai_detections_parser_t *parser)	// a number or a literal ends at the next character
+{
+	int lex = parser->lex;
+	parser->lex = LEX_NONE;
+	if(lex == LEX_NUMBER) {
+		if(end_number(parser)) return -1;
+		return on_token(parser, TOKEN_NUMBER);
+	}
+	if(parser->token_length >= AI_DETECTIONS_PARSER_TOKEN_SIZE) return -1;
+	return on_token(parser, TOKEN_LITERAL);
+}
+
+static void begin_token(ai_detections_parser_t *parser, int lex)
+{
+	parser->lex = lex;
+	parser->token_length = 0;
+	parser->token[0] = '\0';
+}
+
+int ai_detections_parser_feed(ai_detections_parser_t *parser, const char *data, size_t length)
+{
+	if(parser->error) return -1;
+
+	int rc = 0;
+	for(size_t i = 0; i < length; ++i) {
+		char c = data[i];
+		switch(parser->lex) {
+		case LEX_STRING:
+			if(c == '"') {
+				parser->lex = LEX_NONE;
+				if(on_token(parser, TOKEN_STRING)) goto label_error;
+			}
+			else if(c == '\\') parser->lex = LEX_ESCAPE;
+			else if((unsigned char)c < 0x20) goto label_error;
+			else push_char(parser, c);
+			continue;
+		case LEX_ESCAPE:
+			if(c == 'u') {
+				parser->lex = LEX_UNICODE;
+				parser->unicode_digits = 0;
+				push_char(parser, '?');	// keys of interest are ascii
+				continue;
+			}
+			if(c == '\0' || NULL == strchr("\"\\/bfnrt", c)) goto label_error;
+			push_char(parser, c);
+			parser->lex = LEX_STRING;
+			continue;
+		case LEX_UNICODE:
+			if(!is_digit(c) && !((c | 0x20) >= 'a' && (c | 0x20) <= 'f')) goto label_error;
+			if(++parser->unicode_digits == 4) parser->lex = LEX_STRING;
+			continue;
+		case LEX_NUMBER:
+			rc = number_push(parser, c);
+			if(rc < 0) goto label_error;
+			if(0 == rc) continue;
+			if(end_token(parser)) goto label_error;
+			break;
+		case LEX_LITERAL:
+			if(c >= 'a' && c <= 'z') {
+				push_char(parser, c);
+				continue;
+			}
+			if(end_token(parser)) goto label_error;
+			break;
+		default:
+			break;
+		}
+
+		// between tokens
+		switch(c) {
+		case ' ': case '\t': case '\n': case '\r':
+			continue;
+		case '"':
+			begin_token(parser, LEX_STRING);
+			continue;
+		case '{': case '}': case '[': case ']': case ':': case ',':
+			if(on_token(parser, c)) goto label_error;
+			continue;
+		default:
+			break;
+		}
+		if(c == '-' || is_digit(c)) {
+			parser->lex = LEX_NUMBER;
+			begin_number(parser, c);
+			continue;
+		}
+		if(c < 'a' || c > 'z') goto label_error;
+		begin_token(parser, LEX_LITERAL);
+		push_char(parser, c);
+	}
+	return 0;
+
+label_error:
+	parser->error = 1;
+	return -1;
+}
+
+int ai_detections_parser_finish(ai_detections_parser_t *parser)
+{
+	if(parser->error) return -1;
+	if(parser->lex == LEX_NUMBER || parser->lex == LEX_LITERAL) {	// a scalar root value
+		if(end_token(parser)) {
+			parser->error = 1;
+			return -1;
+		}
+	}
+	if(!parser->done || parser->lex != LEX_NONE) return -1;
+	return parser->has_detections?0:-1;
+}
+
+int ai_detections_parse(ai_detections_t *detections, const char *data, size_t length)
+{
+	ai_detections_parser_t parser[1];
+	ai_detections_parser_init(parser, detections);
+	if(ai_detections_parser_feed(parser, data, length)) return -1;
+	return ai_detections_parser_finish(parser);
+}
+
+#if defined(_TEST_AI_DETECTIONS) && defined(_STAND_ALONE)
+static const char s_document[] = 
+	"{ \"model\": \"yolo \\\"v5\\\" \\\\ \\/ \\u00e9\\n\", \n"
+	"  \"meta\": { \"detections\": [ { \"left\": 9 } ], \"list\": [ 1, [ true, false, null ], { \"a\": { } } ] },\n"
+	"  \"detections\": [\n"
+	"    { \"class_index\": 3, \"score\": 0.875, \"left\": 0.125, \"top\": 2.5e-1, \"width\": 5E-1, \"height\": 1.0e+0 },\n"
+	"    { \"extra\": { \"left\": 7, \"nested\": [ { \"top\": 8 } ] }, \"class_index\": 0, \"left\": -0.0, \"top\": 0,"
+	"      \"width\": 0.30000000000000000000000000000000000000000000000000000000000000000000000000000000001,"
+	"      \"height\": 100000000000000000000000000000000000000000000000000000000000000000000000000000000e-81 },\n"
+	"    { \"class\\u005findex\": 5, \"class_index\": 12, \"score\": 1e-3, \"left\": 0.5, \"top\": 0.5, \"width\": 0.25, \"height\": 0.25, \"tags\": [ \"a\\\"]}\" ] }\n"
+	"  ],\n"
+	"  \"elapsed\": 12.5\n"
+	"}\n";
+
+static const ai_detection_t s_expected[] = {
+	{ .class_index = 3, .score = 0.875, .left = 0.125, .top = 0.25, .width = 0.5, .height = 1.0 },
+	{ .class_index = 0, .score = 1.0, .left = 0.0, .top = 0.0, .width = 0.3, .height = 0.1 },
+	{ .class_index = 12, .score = 0.001, .left = 0.5, .top = 0.5, .width = 0.25, .height = 0.25 },
+};
+#define NUM_EXPECTED (sizeof(s_expected) / sizeof(s_expected[0]))
+
+static void check_detections(const ai_detections_t *detections)
+{
+	assert(detections->length == NUM_EXPECTED);
+	for(size_t i = 0; i < NUM_EXPECTED; ++i) {
+		const ai_detection_t *det = &detections->data[i], *expected = &s_expected[i];
+		assert(det->class_index == expected->class_index);
+		assert(fabs(det->score - expected->score) < 1e-12);
+		assert(fabs(det->left - expected->left) < 1e-12);
+		assert(fabs(det->top - expected->top) < 1e-12);
+		assert(fabs(det->width - expected->width) < 1e-12);
+		assert(fabs(det->height - expected->height) < 1e-12);
+	}
+}
+
+static int parse_chunks(ai_detections_t *detections, const char *data, size_t length, size_t split1, size_t split2)
+{
+	ai_detections_parser_t parser[1];
+	ai_detections_parser_init(parser, detections);
+	if(ai_detections_parser_feed(parser, data, split1)) return -1;
+	if(ai_detections_parser_feed(parser, data + split1, split2 - split1)) return -1;
+	if(ai_detections_parser_feed(parser, data + split2, length - split2)) return -1;
+	return ai_detections_parser_finish(parser);
+}
+
+static void test_chunks(void)
+{
+	ai_detections_t detections[1];
+	memset(detections, 0, sizeof(detections));
+	size_t length = sizeof(s_document) - 1;
+	
+	// one pass, then every way of cutting the document in 3 chunks
+	int rc = ai_detections_parse(detections, s_document, length);
+	assert(0 == rc);
+	check_detections(detections);
+	for(size_t split1 = 0; split1 <= length; ++split1) {
+		for(size_t split2 = split1; split2 <= length; split2 += 7) {
+			rc = parse_chunks(detections, s_document, length, split1, split2);
+			assert(0 == rc);
+			check_detections(detections);
+		}
+	}
+	
+	// byte by byte
+	ai_detections_parser_t parser[1];
+	ai_detections_parser_init(parser, detections);
+	for(size_t i = 0; i < length; ++i) {
+		rc = ai_detections_parser_feed(parser, s_document + i, 1);
+		assert(0 == rc);
+	}
+	rc = ai_detections_parser_finish(parser);
+	assert(0 == rc);
+	check_detections(detections);
+	
+	ai_detections_clear(detections);
+	printf("%s(): %zu bytes, all splits ok\n", __FUNCTION__, length);
+}
+
+static void test_invalid(void)
+{
+	static const char *s_valid[] = {
+		"{\"detections\":[]}",
+		" {\"detections\" : [ ] } \r\n\t",
+		"{\"detections\":[{\"left\":-0.5e-2}],\"x\":[[[]]]}",
+	};
+	static const char *s_invalid[] = {
+		"",
+		"{}",								// no detections
+		"[]",
+		"{\"detections\":{}}",
+		"{\"detections\":[]} x",			// trailing garbage
+		"{\"detections\":[]}{}",
+		"{\"detections\":[]}1",
+		"{\"detections\":[]",				// incomplete
+		"{\"detections\":[],}",
+		"{\"detections\":[1,]}",
+		"{\"detections\" []}",
+		"{detections:[]}",
+		"{\"detections\":[{\"left\":01}]}",	// numbers
+		"{\"detections\":[{\"left\":1.}]}",
+		"{\"detections\":[{\"left\":.5}]}",
+		"{\"detections\":[{\"left\":-}]}",
+		"{\"detections\":[{\"left\":1e}]}",
+		"{\"detections\":[{\"left\":1e+}]}",
+		"{\"detections\":[{\"left\":+1}]}",
+		"{\"detections\":[{\"left\":1-2}]}",
+		"{\"detections\":[{\"left\":nul}]}",	// literals
+		"{\"detections\":[{\"left\":True}]}",
+		"{\"detections\":[\"\\x\"]}",		// escapes
+		"{\"detections\":[\"\\u12g4\"]}",
+		"{\"detections\":[\"a\nb\"]}",		// control character
+		"{\"detections\":[]]",
+		"{\"detections\":[}",
+	};
+	ai_detections_t detections[1];
+	memset(detections, 0, sizeof(detections));
+	for(size_t i = 0; i < sizeof(s_valid) / sizeof(s_valid[0]); ++i) {
+		int rc = ai_detections_parse(detections, s_valid[i], strlen(s_valid[i]));
+		if(rc) fprintf(stderr, "[ERROR]: rejected: '%s'\n", s_valid[i]);
+		assert(0 == rc);
+	}
+	for(size_t i = 0; i < sizeof(s_invalid) / sizeof(s_invalid[0]); ++i) {
+		int rc = ai_detections_parse(detections, s_invalid[i], strlen(s_invalid[i]));
+		if(0 == rc) fprintf(stderr, "[ERROR]: accepted: '%s'\n", s_invalid[i]);
+		assert(-1 == rc);
+	}
+	
+	// long numbers
+	char doc[4096] = "";
+	int cb = snprintf(doc, sizeof(doc), "{\"detections\":[{\"left\":0.");
+	for(int i = 0; i < 500; ++i) doc[cb++] = '0';
+	cb += snprintf(doc + cb, sizeof(doc) - cb, "25e500,\"top\":");
+	for(int i = 0; i < 400; ++i) doc[cb++] = (i == 0)?'7':'0';
+	cb += snprintf(doc + cb, sizeof(doc) - cb, "e-400,\"width\":-123456789012345678901234567890}]}");
+	int rc = ai_detections_parse(detections, doc, cb);
+	assert(0 == rc && detections->length == 1);
+	assert(fabs(detections->data[0].left - 0.25) < 1e-12);
+	assert(fabs(detections->data[0].top - 0.7) < 1e-12);
+	assert(fabs(detections->data[0].width / -123456789012345678901234567890.0 - 1.0) < 1e-12);
+	
+	ai_detections_clear(detections);
+	printf("%s(): ok\n", __FUNCTION__);
+}
+
+static void test_json(void)
+{
+	ai_detections_t detections[1], copy[1];
+	memset(detections, 0, sizeof(detections));
+	memset(copy, 0, sizeof(copy));
+	int rc = ai_detections_parse(detections, s_document, sizeof(s_document) - 1);
+	assert(0 == rc);
+	
+	json_object *jresult = ai_detections_to_json(detections);
+	rc = ai_detections_from_json(copy, jresult);
+	assert(0 == rc);
+	check_detections(copy);
+	json_object_put(jresult);
+	
+	ai_detections_clear(copy);
+	ai_detections_clear(detections);
+	printf("%s(): ok\n", __FUNCTION__);
+}
+
+int main(int argc, char **argv)
+{
+	test_chunks();
+	test_invalid();
+	test_json();
+	return 0;
+}
+#endif
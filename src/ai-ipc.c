@@ -0,0 +1,377 @@
+/*
+ * ai-ipc.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ai-ipc.h"
+
+#define AI_IPC_RING_ALIGN	(64)
+
+/*************************************************
+ * message i/o
+*************************************************/
+static int send_all(int sock, struct msghdr *msg)
+{
+	while(1) {
+		ssize_t cb = sendmsg(sock, msg, MSG_NOSIGNAL);
+		if(cb < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+
+		// partial write: skip what has been sent, the fd (if any) went with the first byte
+		msg->msg_control = NULL;
+		msg->msg_controllen = 0;
+		while(cb > 0 && msg->msg_iovlen > 0) {
+			struct iovec *iov = msg->msg_iov;
+			if((size_t)cb < iov->iov_len) {
+				iov->iov_base = (char *)iov->iov_base + cb;
+				iov->iov_len -= cb;
+				cb = 0;
+				break;
+			}
+			cb -= iov->iov_len;
+			++msg->msg_iov;
+			--msg->msg_iovlen;
+		}
+		while(msg->msg_iovlen > 0 && msg->msg_iov->iov_len == 0) {
+			++msg->msg_iov;
+			--msg->msg_iovlen;
+		}
+		if(msg->msg_iovlen == 0) return 0;
+	}
+}
+
+int ai_ipc_send_msg(int sock, uint32_t type, uint32_t id, const void *payload, uint32_t length, int pass_fd)
+{
+	ai_ipc_header_t header = {
+		.magic = AI_IPC_MAGIC,
+		.type = type,
+		.id = id,
+		.length = length,
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &header, .iov_len = sizeof(header) },
+		{ .iov_base = (void *)payload, .iov_len = payload?length:0 },
+	};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	}control;
+	if(pass_fd >= 0) {
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+	}
+	return send_all(sock, &msg);
+}
+
+static int recv_all(int sock, void *data, size_t length, int *p_fd)
+{
+	unsigned char *p = data;
+	while(length > 0) {
+		struct iovec iov = { .iov_base = p, .iov_len = length };
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		union {
+			struct cmsghdr align;
+			char buf[CMSG_SPACE(sizeof(int))];
+		}control;
+		if(p_fd) {
+			msg.msg_control = control.buf;
+			msg.msg_controllen = sizeof(control.buf);
+		}
+
+		ssize_t cb = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+		if(cb < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		if(cb == 0) return -1;	// closed
+
+		if(p_fd) {
+			for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+				if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+					memcpy(p_fd, CMSG_DATA(cmsg), sizeof(int));
+					p_fd = NULL;
+					break;
+				}
+			}
+		}
+		p += cb;
+		length -= cb;
+	}
+	return 0;
+}
+
+int ai_ipc_recv_msg(int sock, ai_ipc_header_t *header, void *payload, uint32_t max_length, int *p_fd)
+{
+	if(p_fd) *p_fd = -1;
+	if(recv_all(sock, header, sizeof(*header), p_fd)) return -1;
+	if(header->magic != AI_IPC_MAGIC || header->length > max_length) return -1;
+	if(header->length > 0 && recv_all(sock, payload, header->length, NULL)) return -1;
+	return 0;
+}
+
+/*************************************************
+ * client
+*************************************************/
+static void disconnect(ai_ipc_client_t *ipc)
+{
+	if(ipc->sock >= 0) close(ipc->sock);
+	ipc->sock = -1;
+}
+
+static int connect_server(ai_ipc_client_t *ipc)
+{
+	if(ipc->sock >= 0) return 0;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(ipc->socket_path) >= sizeof(addr.sun_path)) return -1;
+	strcpy(addr.sun_path, ipc->socket_path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(sock < 0) return -1;
+	if(ipc->timeout > 0) {
+		struct timeval tv = { .tv_sec = ipc->timeout };
+		setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	}
+	if(connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(sock);
+		return -1;
+	}
+
+	// the ring is sealed at its size: the server can map it without fearing a truncation
+	int fd = memfd_create("ai-ipc-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(fd < 0) {
+		close(sock);
+		return -1;
+	}
+	int rc = ftruncate(fd, ipc->ring_size);
+	if(0 == rc) rc = fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+	unsigned char *ring = MAP_FAILED;
+	if(0 == rc) ring = mmap(NULL, ipc->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(ring == MAP_FAILED) rc = -1;
+
+	if(0 == rc) {
+		ai_ipc_hello_t hello = { .ring_size = ipc->ring_size };
+		rc = ai_ipc_send_msg(sock, AI_IPC_HELLO, 0, &hello, sizeof(hello), fd);
+	}
+	close(fd);	// the mappings keep the memory
+
+	if(rc) {
+		if(ring != MAP_FAILED) munmap(ring, ipc->ring_size);
+		close(sock);
+		return -1;
+	}
+
+	if(ipc->ring) munmap(ipc->ring, ipc->ring_size);
+	ipc->ring = ring;
+	ipc->sock = sock;
+	return 0;
+}
+
+ai_ipc_client_t *ai_ipc_client_new(const char *socket_path, size_t ring_size)
+{
+	assert(socket_path);
+	if(ring_size < 1024 * 1024) ring_size = 1024 * 1024;
+
+	ai_ipc_client_t *ipc = calloc(1, sizeof(*ipc));
+	assert(ipc);
+	ipc->socket_path = strdup(socket_path);
+	ipc->ring_size = ring_size;
+	ipc->sock = -1;
+	pthread_mutex_init(&ipc->mutex, NULL);
+	return ipc;
+}
+
+void ai_ipc_client_set_timeout(ai_ipc_client_t *ipc, int timeout)
+{
+	pthread_mutex_lock(&ipc->mutex);
+	ipc->timeout = (timeout > 0)?timeout:0;
+	disconnect(ipc);	// applied to the next connection
+	pthread_mutex_unlock(&ipc->mutex);
+}
+
+void ai_ipc_client_free(ai_ipc_client_t *ipc)
+{
+	if(NULL == ipc) return;
+	disconnect(ipc);
+	if(ipc->ring) munmap(ipc->ring, ipc->ring_size);
+	pthread_mutex_destroy(&ipc->mutex);
+	free(ipc->socket_path);
+	free(ipc);
+}
+
+static json_object *parse_result(const ai_ipc_result_t *result, const ai_ipc_detection_t *detections)
+{
+	if(result->status != 0) return NULL;
+
+	json_object *jdetections = json_object_new_array();
+	for(uint32_t i = 0; i < result->num_detections; ++i) {
+		const ai_ipc_detection_t *det = &detections[i];
+		json_object *jdet = json_object_new_object();
+		json_object_object_add(jdet, "class_index", json_object_new_int(det->class_index));
+		json_object_object_add(jdet, "score", json_object_new_double(det->score));
+		json_object_object_add(jdet, "left", json_object_new_double(det->left));
+		json_object_object_add(jdet, "top", json_object_new_double(det->top));
+		json_object_object_add(jdet, "width", json_object_new_double(det->width));
+		json_object_object_add(jdet, "height", json_object_new_double(det->height));
+		json_object_array_add(jdetections, jdet);
+	}
+	json_object *jresult = json_object_new_object();
+	json_object_object_add(jresult, "detections", jdetections);
+	return jresult;
+}
+
+/*
+ * predict_chunk(): sends images[first ...] while they fit into the ring, then collects their results,
+ *   returns the number of images consumed, -1 on a connection error.
+ */
+static ssize_t predict_chunk(ai_ipc_client_t *ipc, const bgra_image_t **images, size_t first, size_t num_images, json_object **results)
+{
+	size_t offset = 0;
+	size_t index = first;
+	size_t num_sent = 0;
+	for(; index < num_images; ++index) {
+		const bgra_image_t *image = images[index];
+		if(NULL == image || NULL == image->data) continue;
+
+		size_t stride = image->width * 4;
+		size_t size = stride * image->height;
+		if(size > ipc->ring_size) {
+			fprintf(stderr, "[ERROR]: %s(): image %zu (%d x %d) does not fit into the ring.\n",
+				__FUNCTION__, index, image->width, image->height);
+			continue;
+		}
+		if(offset + size > ipc->ring_size) break;	// next chunk
+
+		size_t src_stride = image->stride?image->stride:stride;
+		unsigned char *dst = ipc->ring + offset;
+		if(src_stride == stride) memcpy(dst, image->data, size);
+		else for(int y = 0; y < image->height; ++y) memcpy(dst + y * stride, image->data + y * src_stride, stride);
+
+		ai_ipc_image_t request = {
+			.offset = offset,
+			.width = image->width,
+			.height = image->height,
+			.stride = stride,
+			.format = AI_IPC_FORMAT_BGRA8,
+		};
+		if(ai_ipc_send_msg(ipc->sock, AI_IPC_PREDICT, (uint32_t)index, &request, sizeof(request), -1)) return -1;
+		++num_sent;
+		offset += (size + AI_IPC_RING_ALIGN - 1) / AI_IPC_RING_ALIGN * AI_IPC_RING_ALIGN;
+	}
+
+	static const size_t max_payload = sizeof(ai_ipc_result_t) + AI_IPC_MAX_DETECTIONS * sizeof(ai_ipc_detection_t);
+	unsigned char *payload = malloc(max_payload);
+	assert(payload);
+
+	int rc = 0;
+	for(size_t i = 0; i < num_sent; ++i) {
+		ai_ipc_header_t header;
+		rc = ai_ipc_recv_msg(ipc->sock, &header, payload, max_payload, NULL);
+		if(rc) break;
+
+		const ai_ipc_result_t *result = (const ai_ipc_result_t *)payload;
+		if(header.type != AI_IPC_RESULT || header.id < first || header.id >= index
+			|| header.length < sizeof(*result)
+			|| header.length != sizeof(*result) + result->num_detections * sizeof(ai_ipc_detection_t))
+		{
+			rc = -1;
+			break;
+		}
+		if(results[header.id]) json_object_put(results[header.id]);
+		results[header.id] = parse_result(result, (const ai_ipc_detection_t *)(result + 1));
+	}
+	int err = errno;
+	free(payload);
+	errno = err;
+
+	if(rc) return -1;
+	if(index == first) ++index;	// only skipped images
+	return index - first;
+}
+
+int ai_ipc_predict(ai_ipc_client_t *ipc, const bgra_image_t **images, size_t num_images, json_object **results)
+{
+	assert(ipc && images && results);
+	memset(results, 0, num_images * sizeof(*results));
+
+	pthread_mutex_lock(&ipc->mutex);
+	size_t index = 0;
+	int reconnects = 0;
+	while(index < num_images) {
+		ssize_t count = -1;
+		if(0 == connect_server(ipc)) count = predict_chunk(ipc, images, index, num_images, results);
+		if(count < 0) {
+			// a stalled server: the late replies would be taken for the next ones
+			int timed_out = (errno == EAGAIN || errno == EWOULDBLOCK);
+			disconnect(ipc);
+			if(timed_out) {
+				fprintf(stderr, "[ERROR]: %s(): no reply from %s within %d s.\n", __FUNCTION__, ipc->socket_path, ipc->timeout);
+				break;
+			}
+			
+			// the server may have been restarted: one more try on a new connection
+			if(++reconnects > 1) break;
+			continue;
+		}
+		index += count;
+	}
+	pthread_mutex_unlock(&ipc->mutex);
+
+	int rc = 0;
+	for(size_t i = 0; i < num_images; ++i) if(NULL == results[i]) rc = -1;
+	return rc;
+}
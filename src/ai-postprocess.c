@@ -0,0 +1,700 @@
+/*
+ * ai-postprocess.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ai-postprocess.h"
+#include "utils.h"
+
+ai_postprocess_t *ai_postprocess_init(ai_postprocess_t *pp)
+{
+	if(NULL == pp) pp = calloc(1, sizeof(*pp));
+	assert(pp);
+	memset(pp, 0, sizeof(*pp));
+	pp->merge = AI_MERGE_NMS;
+	pp->iou_threshold = 0.5;
+	return pp;
+}
+
+void ai_postprocess_cleanup(ai_postprocess_t *pp)
+{
+	if(NULL == pp) return;
+	free(pp->class_thresholds);
+	pp->class_thresholds = NULL;
+	pp->num_classes = 0;
+}
+
+int ai_postprocess_parse_merge(const char *name)
+{
+	if(NULL == name) return -1;
+	if(0 == strcasecmp(name, "none")) return AI_MERGE_NONE;
+	if(0 == strcasecmp(name, "nms")) return AI_MERGE_NMS;
+	if(0 == strcasecmp(name, "wbf")) return AI_MERGE_WBF;
+	return -1;
+}
+
+int ai_postprocess_load(ai_postprocess_t *pp, json_object *jconfig)
+{
+	assert(pp);
+	if(NULL == jconfig) return -1;
+
+	pp->score_threshold = json_get_value_default(jconfig, double, ai-score-threshold, pp->score_threshold);
+	pp->iou_threshold = json_get_value_default(jconfig, double, ai-iou-threshold, pp->iou_threshold);
+	pp->class_agnostic = json_get_value_default(jconfig, int, ai-class-agnostic, pp->class_agnostic);
+	pp->max_detections = json_get_value_default(jconfig, int, ai-max-detections, pp->max_detections);
+
+	const char *merge = json_get_value(jconfig, string, ai-merge);
+	if(merge) {
+		int mode = ai_postprocess_parse_merge(merge);
+		if(mode < 0) fprintf(stderr, "[WARNING]: %s(): unknown ai-merge '%s'\n", __FUNCTION__, merge);
+		else pp->merge = mode;
+	}
+
+	json_object *jthresholds = NULL;
+	if(json_object_object_get_ex(jconfig, "ai-class-thresholds", &jthresholds)
+		&& json_object_is_type(jthresholds, json_type_array))
+	{
+		int num_classes = json_object_array_length(jthresholds);
+		free(pp->class_thresholds);
+		pp->class_thresholds = NULL;
+		pp->num_classes = 0;
+		if(num_classes > 0) {
+			pp->class_thresholds = calloc(num_classes, sizeof(*pp->class_thresholds));
+			assert(pp->class_thresholds);
+			for(int i = 0; i < num_classes; ++i) {
+				json_object *jthreshold = json_object_array_get_idx(jthresholds, i);
+				pp->class_thresholds[i] = jthreshold?json_object_get_double(jthreshold):-1;
+			}
+			pp->num_classes = num_classes;
+		}
+	}
+	return 0;
+}
+
+/*************************************************
+ * sorting
+*************************************************/
+static int compare_score(const void *a, const void *b)	// score desc
+{
+	const ai_detection_t *det_a = a, *det_b = b;
+	if(det_a->score > det_b->score) return -1;
+	if(det_a->score < det_b->score) return 1;
+	return det_a->class_index - det_b->class_index;
+}
+
+static int compare_class_score(const void *a, const void *b)	// class asc, score desc
+{
+	const ai_detection_t *det_a = a, *det_b = b;
+	if(det_a->class_index != det_b->class_index) return (det_a->class_index < det_b->class_index)?-1:1;
+	return compare_score(a, b);
+}
+
+static void sort_detections(ai_detections_t *detections, int by_class)
+{
+	if(detections->length < 2) return;
+	qsort(detections->data, detections->length, sizeof(*detections->data), by_class?compare_class_score:compare_score);
+}
+
+/*************************************************
+ * box_set: kept / fused boxes of one class, structure of arrays
+ *   small sets are scanned 4 boxes at a time (sse2); once a set is large, 
+ *   a uniform grid over the (normalized) image narrows the scan to the boxes nearby
+*************************************************/
+typedef struct rect
+{
+	float x1, y1, x2, y2;
+	float area;
+}rect_t;
+
+static rect_t to_rect(const ai_detection_t *det)
+{
+	rect_t r = {
+		.x1 = det->left,
+		.y1 = det->top,
+		.x2 = det->left + det->width,
+		.y2 = det->top + det->height,
+	};
+	r.area = (det->width > 0 && det->height > 0)?(float)(det->width * det->height):0.0f;
+	return r;
+}
+
+#define BOX_GRID_SIZE		(32)
+#define BOX_GRID_MIN_BOXES	(128)	// fewer: linear scan
+#define BOX_GRID_MAX_CELLS	(16)	// larger boxes are checked by every query
+
+typedef struct index_list
+{
+	int *data;
+	int count;
+	int max_size;
+}index_list_t;
+
+typedef struct box_grid
+{
+	int enabled;
+	index_list_t cells[BOX_GRID_SIZE * BOX_GRID_SIZE];	// boxes overlapping the cell
+	index_list_t large;
+	unsigned int *stamps;	// [max_size of the set], last query that checked the box
+	unsigned int query;
+}box_grid_t;
+
+typedef struct box_set
+{
+	float *x1, *y1, *x2, *y2, *area;
+	int count;
+	int max_size;
+	box_grid_t *grid;
+}box_set_t;
+
+static void index_list_add(index_list_t *list, int index)
+{
+	if(list->count > 0 && list->data[list->count - 1] == index) return;	// re-registered, same cell
+	if(list->count >= list->max_size) {
+		int new_size = list->max_size?(list->max_size * 2):16;
+		int *data = realloc(list->data, new_size * sizeof(*data));
+		assert(data);
+		list->data = data;
+		list->max_size = new_size;
+	}
+	list->data[list->count++] = index;
+}
+
+static inline int grid_cell(float x)
+{
+	int cell = (int)(x * BOX_GRID_SIZE);
+	if(x < 0 || cell < 0) return 0;
+	return (cell >= BOX_GRID_SIZE)?(BOX_GRID_SIZE - 1):cell;
+}
+
+static void grid_insert(box_grid_t *grid, const rect_t *r, int index)
+{
+	int cx0 = grid_cell(r->x1), cx1 = grid_cell(r->x2);
+	int cy0 = grid_cell(r->y1), cy1 = grid_cell(r->y2);
+	if((cx1 - cx0 + 1) * (cy1 - cy0 + 1) > BOX_GRID_MAX_CELLS) {
+		index_list_add(&grid->large, index);
+		return;
+	}
+	for(int cy = cy0; cy <= cy1; ++cy) {
+		for(int cx = cx0; cx <= cx1; ++cx) index_list_add(&grid->cells[cy * BOX_GRID_SIZE + cx], index);
+	}
+}
+
+static void box_set_reset(box_set_t *set)
+{
+	set->count = 0;
+	box_grid_t *grid = set->grid;
+	if(NULL == grid || !grid->enabled) return;
+	for(int i = 0; i < BOX_GRID_SIZE * BOX_GRID_SIZE; ++i) grid->cells[i].count = 0;
+	grid->large.count = 0;
+	grid->enabled = 0;
+}
+
+static void box_set_clear(box_set_t *set)
+{
+	free(set->x1);
+	free(set->y1);
+	free(set->x2);
+	free(set->y2);
+	free(set->area);
+	if(set->grid) {
+		for(int i = 0; i < BOX_GRID_SIZE * BOX_GRID_SIZE; ++i) free(set->grid->cells[i].data);
+		free(set->grid->large.data);
+		free(set->grid->stamps);
+		free(set->grid);
+	}
+	memset(set, 0, sizeof(*set));
+}
+
+static void box_set_update(box_set_t *set, int index, const rect_t *r)
+{
+	set->x1[index] = r->x1;
+	set->y1[index] = r->y1;
+	set->x2[index] = r->x2;
+	set->y2[index] = r->y2;
+	set->area[index] = r->area;
+	
+	// a moved (fused) box is registered in its new cells too, stale cells only cost a check
+	if(set->grid && set->grid->enabled) grid_insert(set->grid, r, index);
+}
+
+static int box_set_add(box_set_t *set, const rect_t *r)
+{
+	if(set->count >= set->max_size) {
+		int new_size = set->max_size?(set->max_size * 2):256;
+		float **arrays[] = { &set->x1, &set->y1, &set->x2, &set->y2, &set->area };
+		for(size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+			float *data = realloc(*arrays[i], new_size * sizeof(*data));
+			assert(data);
+			*arrays[i] = data;
+		}
+		if(set->grid) {
+			unsigned int *stamps = realloc(set->grid->stamps, new_size * sizeof(*stamps));
+			assert(stamps);
+			memset(stamps + set->max_size, 0, (new_size - set->max_size) * sizeof(*stamps));
+			set->grid->stamps = stamps;
+		}
+		set->max_size = new_size;
+	}
+	int index = set->count++;
+	box_set_update(set, index, r);
+	
+	if(set->count >= BOX_GRID_MIN_BOXES && (NULL == set->grid || !set->grid->enabled)) {
+		if(NULL == set->grid) {
+			set->grid = calloc(1, sizeof(*set->grid));
+			assert(set->grid);
+			set->grid->stamps = calloc(set->max_size, sizeof(*set->grid->stamps));
+			assert(set->grid->stamps);
+		}
+		set->grid->enabled = 1;
+		for(int i = 0; i < set->count; ++i) {
+			rect_t box = { set->x1[i], set->y1[i], set->x2[i], set->y2[i], set->area[i] };
+			grid_insert(set->grid, &box, i);
+		}
+	}
+	return index;
+}
+
+static inline float box_set_iou(const box_set_t *set, int index, const rect_t *r)
+{
+	float w = ((set->x2[index] < r->x2)?set->x2[index]:r->x2) - ((set->x1[index] > r->x1)?set->x1[index]:r->x1);
+	float h = ((set->y2[index] < r->y2)?set->y2[index]:r->y2) - ((set->y1[index] > r->y1)?set->y1[index]:r->y1);
+	if(w <= 0 || h <= 0) return 0.0f;
+	float inter = w * h;
+	float area_union = set->area[index] + r->area - inter;
+	return (area_union > 0)?(inter / area_union):0.0f;
+}
+
+static int grid_find_overlap(box_set_t *set, const rect_t *r, float threshold, int first_only)
+{
+	box_grid_t *grid = set->grid;
+	if(++grid->query == 0) {	// wrapped
+		memset(grid->stamps, 0, set->max_size * sizeof(*grid->stamps));
+		grid->query = 1;
+	}
+	
+	int best = -1;
+	float best_iou = threshold;
+	int cx0 = grid_cell(r->x1), cx1 = grid_cell(r->x2);
+	int cy0 = grid_cell(r->y1), cy1 = grid_cell(r->y2);
+	for(int cell = -1; cell < (cx1 - cx0 + 1) * (cy1 - cy0 + 1); ++cell) {
+		const index_list_t *list = &grid->large;
+		if(cell >= 0) list = &grid->cells[(cy0 + cell / (cx1 - cx0 + 1)) * BOX_GRID_SIZE + cx0 + cell % (cx1 - cx0 + 1)];
+		
+		for(int i = 0; i < list->count; ++i) {
+			int index = list->data[i];
+			if(grid->stamps[index] == grid->query) continue;
+			grid->stamps[index] = grid->query;
+			
+			float iou = box_set_iou(set, index, r);
+			if(iou > best_iou || (iou == best_iou && best >= 0 && index < best)) {
+				if(first_only) return index;
+				best_iou = iou;
+				best = index;
+			}
+		}
+	}
+	return best;
+}
+
+/*
+ * find_overlap(): the box of the set with the largest iou > threshold, -1: none
+ *   first_only: any of them (nms only needs to know whether there is one)
+ */
+static int find_overlap(box_set_t *set, const rect_t *r, float threshold, int first_only)
+{
+	if(set->grid && set->grid->enabled) return grid_find_overlap(set, r, threshold, first_only);
+	
+	int best = -1;
+	float best_iou = threshold;
+	int i = 0;
+
+#ifdef __SSE2__
+	// iou > t  <==>  intersection > t * union
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 x1 = _mm_set1_ps(r->x1), y1 = _mm_set1_ps(r->y1);
+	const __m128 x2 = _mm_set1_ps(r->x2), y2 = _mm_set1_ps(r->y2);
+	const __m128 area = _mm_set1_ps(r->area);
+	for(; i + 4 <= set->count; i += 4) {
+		__m128 w = _mm_sub_ps(_mm_min_ps(x2, _mm_loadu_ps(set->x2 + i)), _mm_max_ps(x1, _mm_loadu_ps(set->x1 + i)));
+		__m128 h = _mm_sub_ps(_mm_min_ps(y2, _mm_loadu_ps(set->y2 + i)), _mm_max_ps(y1, _mm_loadu_ps(set->y1 + i)));
+		__m128 inter = _mm_mul_ps(_mm_max_ps(w, zero), _mm_max_ps(h, zero));
+		__m128 area_union = _mm_sub_ps(_mm_add_ps(area, _mm_loadu_ps(set->area + i)), inter);
+		int mask = _mm_movemask_ps(_mm_cmpgt_ps(inter, _mm_mul_ps(_mm_set1_ps(best_iou), area_union)));
+		if(0 == mask) continue;
+
+		for(int k = 0; k < 4; ++k) {
+			if(0 == (mask & (1 << k))) continue;
+			if(first_only) return i + k;
+			float iou = box_set_iou(set, i + k, r);
+			if(iou > best_iou) {
+				best_iou = iou;
+				best = i + k;
+			}
+		}
+	}
+#endif
+
+	for(; i < set->count; ++i) {
+		float iou = box_set_iou(set, i, r);
+		if(iou > best_iou) {
+			if(first_only) return i;
+			best_iou = iou;
+			best = i;
+		}
+	}
+	return best;
+}
+
+/*************************************************
+ * threshold, nms, wbf
+*************************************************/
+ssize_t ai_detections_threshold(ai_detections_t *detections, const ai_postprocess_t *pp)
+{
+	ssize_t count = 0;
+	for(ssize_t i = 0; i < detections->length; ++i) {
+		const ai_detection_t *det = &detections->data[i];
+		double threshold = pp->score_threshold;
+		if(det->class_index >= 0 && det->class_index < pp->num_classes && pp->class_thresholds[det->class_index] >= 0) {
+			threshold = pp->class_thresholds[det->class_index];
+		}
+		if(det->score < threshold) continue;
+		detections->data[count++] = *det;
+	}
+	detections->length = count;
+	return count;
+}
+
+ssize_t ai_detections_nms(ai_detections_t *detections, double iou_threshold, int class_agnostic)
+{
+	sort_detections(detections, !class_agnostic);
+
+	box_set_t kept[1];
+	memset(kept, 0, sizeof(kept));
+
+	ssize_t count = 0;
+	for(ssize_t i = 0; i < detections->length; ++i) {
+		ai_detection_t det = detections->data[i];
+		if(!class_agnostic && i > 0 && det.class_index != detections->data[i - 1].class_index) box_set_reset(kept);
+
+		rect_t r = to_rect(&det);
+		if(find_overlap(kept, &r, (float)iou_threshold, 1) >= 0) continue;	// suppressed by a better box
+		box_set_add(kept, &r);
+		detections->data[count++] = det;
+	}
+	detections->length = count;
+	box_set_clear(kept);
+
+	sort_detections(detections, 0);
+	return count;
+}
+
+typedef struct cluster
+{
+	int class_index;		// of the best box
+	int count;
+	double sum_score;
+	double sum_weights;
+	double x1, y1, x2, y2;	// score-weighted sums
+}cluster_t;
+
+static void flush_clusters(ai_detections_t *fused, const cluster_t *clusters, int num_clusters, int num_lists)
+{
+	for(int i = 0; i < num_clusters; ++i) {
+		const cluster_t *c = &clusters[i];
+		double x1 = c->x1 / c->sum_weights, y1 = c->y1 / c->sum_weights;
+		double x2 = c->x2 / c->sum_weights, y2 = c->y2 / c->sum_weights;
+
+		// boxes found by fewer models than the ensemble are down-weighted
+		int num_votes = (c->count < num_lists)?c->count:num_lists;
+		ai_detection_t det = {
+			.class_index = c->class_index,
+			.score = c->sum_score / c->count * num_votes / num_lists,
+			.left = x1,
+			.top = y1,
+			.width = x2 - x1,
+			.height = y2 - y1,
+		};
+		ai_detections_append(fused, &det);
+	}
+}
+
+/*
+ * ai_detections_fuse(): weighted box fusion,
+ *   every box joins the fused box (of its class) it overlaps most, or starts a new one;
+ *   the coordinates are averaged with the scores as weights.
+ */
+ssize_t ai_detections_fuse(ai_detections_t *fused, const ai_detections_t *lists, int num_lists, double iou_threshold, int class_agnostic)
+{
+	assert(fused && lists && num_lists > 0);
+	ai_detections_t all[1];
+	memset(all, 0, sizeof(all));
+	for(int i = 0; i < num_lists; ++i) {
+		for(ssize_t k = 0; k < lists[i].length; ++k) ai_detections_append(all, &lists[i].data[k]);
+	}
+	sort_detections(all, !class_agnostic);
+	ai_detections_reset(fused);
+
+	box_set_t boxes[1];	// fused coordinates of the clusters
+	memset(boxes, 0, sizeof(boxes));
+	cluster_t *clusters = NULL;
+	int max_clusters = 0;
+
+	for(ssize_t i = 0; i < all->length; ++i) {
+		const ai_detection_t *det = &all->data[i];
+		if(!class_agnostic && i > 0 && det->class_index != all->data[i - 1].class_index) {
+			flush_clusters(fused, clusters, boxes->count, num_lists);
+			box_set_reset(boxes);
+		}
+
+		rect_t r = to_rect(det);
+		double weight = (det->score > 1e-6)?det->score:1e-6;
+		int index = find_overlap(boxes, &r, (float)iou_threshold, 0);
+		if(index < 0) {
+			index = box_set_add(boxes, &r);
+			if(index >= max_clusters) {
+				max_clusters = boxes->max_size;
+				clusters = realloc(clusters, max_clusters * sizeof(*clusters));
+				assert(clusters);
+			}
+			memset(&clusters[index], 0, sizeof(clusters[index]));
+			clusters[index].class_index = det->class_index;
+		}
+
+		cluster_t *c = &clusters[index];
+		++c->count;
+		c->sum_score += det->score;
+		c->sum_weights += weight;
+		c->x1 += r.x1 * weight;
+		c->y1 += r.y1 * weight;
+		c->x2 += r.x2 * weight;
+		c->y2 += r.y2 * weight;
+
+		if(c->count > 1) {
+			rect_t merged = {
+				.x1 = c->x1 / c->sum_weights, .y1 = c->y1 / c->sum_weights,
+				.x2 = c->x2 / c->sum_weights, .y2 = c->y2 / c->sum_weights,
+			};
+			merged.area = (merged.x2 - merged.x1) * (merged.y2 - merged.y1);
+			box_set_update(boxes, index, &merged);
+		}
+	}
+	flush_clusters(fused, clusters, boxes->count, num_lists);
+
+	free(clusters);
+	box_set_clear(boxes);
+	ai_detections_clear(all);
+
+	sort_detections(fused, 0);
+	return fused->length;
+}
+
+/*************************************************
+ * pipeline
+*************************************************/
+static void limit_detections(const ai_postprocess_t *pp, ai_detections_t *detections)	// sorted by score
+{
+	if(pp->max_detections > 0 && detections->length > pp->max_detections) detections->length = pp->max_detections;
+}
+
+int ai_postprocess_apply(const ai_postprocess_t *pp, ai_detections_t *detections)
+{
+	if(NULL == pp || NULL == detections) return -1;
+
+	ai_detections_threshold(detections, pp);
+	switch(pp->merge) {
+	case AI_MERGE_NMS:
+		ai_detections_nms(detections, pp->iou_threshold, pp->class_agnostic);
+		break;
+	case AI_MERGE_WBF: {
+			ai_detections_t fused[1];
+			memset(fused, 0, sizeof(fused));
+			ai_detections_fuse(fused, detections, 1, pp->iou_threshold, pp->class_agnostic);
+			ai_detections_clear(detections);
+			*detections = *fused;
+		}
+		break;
+	default:
+		if(pp->max_detections > 0) sort_detections(detections, 0);
+		break;
+	}
+	limit_detections(pp, detections);
+	return 0;
+}
+
+int ai_postprocess_apply_ensemble(const ai_postprocess_t *pp, ai_detections_t *fused, ai_detections_t *lists, int num_lists)
+{
+	if(NULL == pp || NULL == fused || NULL == lists || num_lists < 1) return -1;
+
+	for(int i = 0; i < num_lists; ++i) ai_detections_threshold(&lists[i], pp);
+	ai_detections_fuse(fused, lists, num_lists, pp->iou_threshold, pp->class_agnostic);
+	limit_detections(pp, fused);
+	return 0;
+}
+
+#if defined(_TEST_AI_POSTPROCESS) && defined(_STAND_ALONE)
+#include <math.h>
+
+// the iou of the box sets, computed the same way (float)
+static float reference_iou(const ai_detection_t *a, const ai_detection_t *b)
+{
+	rect_t ra = to_rect(a), rb = to_rect(b);
+	float w = ((ra.x2 < rb.x2)?ra.x2:rb.x2) - ((ra.x1 > rb.x1)?ra.x1:rb.x1);
+	float h = ((ra.y2 < rb.y2)?ra.y2:rb.y2) - ((ra.y1 > rb.y1)?ra.y1:rb.y1);
+	if(w <= 0 || h <= 0) return 0.0f;
+	float inter = w * h;
+	float area_union = ra.area + rb.area - inter;
+	return (area_union > 0)?(inter / area_union):0.0f;
+}
+
+// greedy nms, every pair compared
+static void reference_nms(ai_detections_t *detections, double iou_threshold, int class_agnostic)
+{
+	sort_detections(detections, 0);
+	ssize_t count = 0;
+	for(ssize_t i = 0; i < detections->length; ++i) {
+		const ai_detection_t *det = &detections->data[i];
+		int suppressed = 0;
+		for(ssize_t k = 0; k < count && !suppressed; ++k) {
+			const ai_detection_t *kept = &detections->data[k];
+			if(!class_agnostic && kept->class_index != det->class_index) continue;
+			suppressed = (reference_iou(kept, det) > (float)iou_threshold);
+		}
+		if(!suppressed) detections->data[count++] = *det;
+	}
+	detections->length = count;
+}
+
+static void random_detections(ai_detections_t *detections, int count, int num_classes, double max_size)
+{
+	ai_detections_reset(detections);
+	for(int i = 0; i < count; ++i) {
+		ai_detection_t det = {
+			.class_index = rand() % num_classes,
+			.score = (double)rand() / RAND_MAX,
+			.width = 0.01 + (double)rand() / RAND_MAX * max_size,
+			.height = 0.01 + (double)rand() / RAND_MAX * max_size,
+		};
+		det.left = (double)rand() / RAND_MAX * (1.0 - det.width);
+		det.top = (double)rand() / RAND_MAX * (1.0 - det.height);
+		ai_detections_append(detections, &det);
+	}
+}
+
+static void test_nms(void)
+{
+	ai_detections_t detections[1], expected[1];
+	memset(detections, 0, sizeof(detections));
+	memset(expected, 0, sizeof(expected));
+	
+	// small sets (linear scan) and large ones (grid), large boxes too (checked by every query)
+	static const int s_counts[] = { 0, 1, 7, 50, 300, 2000 };
+	static const double s_thresholds[] = { 0.0, 0.3, 0.5, 0.9 };
+	srand(12345);
+	for(size_t n = 0; n < sizeof(s_counts) / sizeof(s_counts[0]); ++n) {
+		for(size_t t = 0; t < sizeof(s_thresholds) / sizeof(s_thresholds[0]); ++t) {
+			for(int class_agnostic = 0; class_agnostic <= 1; ++class_agnostic) {
+				random_detections(detections, s_counts[n], 5, (n & 1)?0.6:0.15);
+				ai_detections_reset(expected);
+				for(ssize_t i = 0; i < detections->length; ++i) ai_detections_append(expected, &detections->data[i]);
+				
+				ssize_t count = ai_detections_nms(detections, s_thresholds[t], class_agnostic);
+				reference_nms(expected, s_thresholds[t], class_agnostic);
+				assert(count == detections->length);
+				assert(detections->length == expected->length);
+				for(ssize_t i = 0; i < expected->length; ++i) {
+					assert(0 == memcmp(&detections->data[i], &expected->data[i], sizeof(expected->data[i])));
+				}
+			}
+		}
+	}
+	ai_detections_clear(detections);
+	ai_detections_clear(expected);
+	printf("%s(): ok\n", __FUNCTION__);
+}
+
+static void test_fuse(void)
+{
+	// two models: the same object, one box found by one model only, an overlapping box of another class
+	ai_detection_t model_a[] = {
+		{ .class_index = 0, .score = 0.9, .left = 0.10, .top = 0.10, .width = 0.20, .height = 0.20 },
+		{ .class_index = 1, .score = 0.8, .left = 0.60, .top = 0.60, .width = 0.10, .height = 0.10 },
+	};
+	ai_detection_t model_b[] = {
+		{ .class_index = 0, .score = 0.6, .left = 0.12, .top = 0.10, .width = 0.20, .height = 0.20 },
+		{ .class_index = 2, .score = 0.5, .left = 0.10, .top = 0.10, .width = 0.20, .height = 0.20 },
+	};
+	ai_detections_t lists[2] = {
+		{ .max_size = 2, .length = 2, .data = model_a },
+		{ .max_size = 2, .length = 2, .data = model_b },
+	};
+	ai_detections_t fused[1];
+	memset(fused, 0, sizeof(fused));
+	
+	ssize_t count = ai_detections_fuse(fused, lists, 2, 0.5, 0);
+	assert(count == 3 && fused->length == 3);
+	
+	// score-weighted coordinates, scores scaled by the number of models that found the box
+	const ai_detection_t *det = &fused->data[0];
+	assert(det->class_index == 0);
+	assert(fabs(det->score - 0.75) < 1e-6);
+	assert(fabs(det->left - (0.10 * 0.9 + 0.12 * 0.6) / 1.5) < 1e-6);
+	assert(fabs(det->top - 0.10) < 1e-6);
+	assert(fabs(det->width - 0.20) < 1e-6);
+	assert(fabs(det->height - 0.20) < 1e-6);
+	
+	det = &fused->data[1];
+	assert(det->class_index == 1 && fabs(det->score - 0.4) < 1e-6);
+	assert(fabs(det->left - 0.60) < 1e-6 && fabs(det->width - 0.10) < 1e-6);
+	
+	det = &fused->data[2];
+	assert(det->class_index == 2 && fabs(det->score - 0.25) < 1e-6);
+	
+	// class agnostic: the box of class 2 joins the cluster of the best box
+	count = ai_detections_fuse(fused, lists, 2, 0.5, 1);
+	assert(count == 2);
+	det = &fused->data[0];
+	assert(det->class_index == 0);
+	assert(fabs(det->score - (0.9 + 0.6 + 0.5) / 3) < 1e-6);
+	assert(fabs(det->left - (0.10 * 0.9 + 0.12 * 0.6 + 0.10 * 0.5) / 2.0) < 1e-6);
+	
+	ai_detections_clear(fused);
+	printf("%s(): ok\n", __FUNCTION__);
+}
+
+int main(int argc, char **argv)
+{
+	test_nms();
+	test_fuse();
+	return 0;
+}
+#endif
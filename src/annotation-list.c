@@ -26,7 +26,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
-#include "common.h"
+#include "annotation-list.h"
+#include "utils.h"
 
 
 
@@ -256,6 +257,35 @@ void annotation_list_dump(const annotation_list_t * list)
 	return;
 }
 
+/*
+ * annotation_list_add_ai_detections():
+ *   appends the boxes parsed from an ai-server result (normalized left, top, width, height),
+ *   returns the number of boxes added.
+ */
+ssize_t annotation_list_add_ai_detections(annotation_list_t * list, const ai_detections_t * detections)
+{
+	assert(list);
+	if(NULL == detections) return -1;
+	
+	list->resize(list, list->length + detections->length);
+	ssize_t count = 0;
+	for(ssize_t i = 0; i < detections->length; ++i)
+	{
+		const ai_detection_t * det = &detections->data[i];
+		annotation_data_t data[1] = {{
+			.klass = det->class_index,
+			.x = det->left + det->width / 2.0,		// center_x
+			.y = det->top + det->height / 2.0,		// center_y
+			.width = det->width,
+			.height = det->height,
+		}};
+		
+		int rc = list->update(list, -1, data);
+		if(0 == rc) ++count;
+	}
+	return count;
+}
+
 #if defined(_TEST_ANNOTATION_LIST) && defined(_STAND_ALONE)
 
 
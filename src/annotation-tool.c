@@ -136,7 +136,9 @@ void global_params_dump(global_params_t * params)
 	}
 	
 	if(params->ai) {
-		printf("ai: %p, server_url: %s\n", params->ai, params->ai->ai_server_url);
+		printf("ai: %p, server_url: %s\n", params->ai, ai_client_get_url(params->ai));
+		int num_endpoints = ai_client_get_num_endpoints(params->ai);
+		for(int i = 1; i < num_endpoints; ++i) printf("\treplica: %s\n", ai_client_get_endpoint_url(params->ai, i));
 	}
 	return;
 }
@@ -158,6 +160,17 @@ int global_params_load_config(global_params_t * params, json_object * jconfig)
 	const char * ext_name = json_get_value_default(jconfig, string, ext_name, ".txt");
 	const char * working_path = json_get_value_default(jconfig, string, working_path, ".");
 	const char * font_name = json_get_value_default(jconfig, string, font-name, "DejaVu Sans Mono");
+	double lod_min_box_size = json_get_value_default(jconfig, double, lod-min-box-size, 3);
+	double lod_min_label_size = json_get_value_default(jconfig, double, lod-min-label-size, 12);
+	int render_threads = json_get_value_default(jconfig, int, render-threads, 0);
+	int render_tile_size = json_get_value_default(jconfig, int, render-tile-size, 256);
+	int server_side_surfaces = json_get_value_default(jconfig, int, server-side-surfaces, 1);
+	int measure_uploads = json_get_value_default(jconfig, int, measure-uploads, 0);
+	int num_viewports = json_get_value_default(jconfig, int, viewports, 1);
+	int loupe_size = json_get_value_default(jconfig, int, loupe-size, 160);
+	double loupe_zoom = json_get_value_default(jconfig, double, loupe-zoom, 8);
+	int edge_snap_radius = json_get_value_default(jconfig, int, edge-snap-radius, 8);
+	if(getenv("ANNOTATION_TOOLS_MEASURE_UPLOADS")) measure_uploads = atoi(getenv("ANNOTATION_TOOLS_MEASURE_UPLOADS"));
 
 	assert(fg_color && bg_color && sel_color && font_color && ext_name && working_path);
 
@@ -170,13 +183,56 @@ int global_params_load_config(global_params_t * params, json_object * jconfig)
 	params->line_size = line_size;
 	params->font_size = font_size;
 	params->font_name = font_name;
+	params->lod_min_box_size = lod_min_box_size;
+	params->lod_min_label_size = lod_min_label_size;
+	params->render_threads = render_threads;
+	params->render_tile_size = render_tile_size;
+	params->server_side_surfaces = server_side_surfaces;
+	params->measure_uploads = measure_uploads;
+	params->num_viewports = num_viewports;
+	params->loupe_size = loupe_size;
+	params->loupe_zoom = loupe_zoom;
+	params->edge_snap_radius = edge_snap_radius;
 	
-	const char *ai_server_url = json_get_value(jconfig, string, ai-server-url);
-	if(ai_server_url) {
-		struct ai_client *ai = ai_client_init(NULL, params);
+	json_object *jserver_urls = NULL;	// a url or a list of replicas
+	json_object_object_get_ex(jconfig, "ai-server-url", &jserver_urls);
+	if(jserver_urls) {
+		struct ai_client *ai = ai_client_new(params);
 		if(ai) {
 			params->ai = ai;
-			ai->set_url(ai, ai_server_url);
+			ai_client_options_t options;
+			ai_client_get_options(ai, &options, sizeof(options));
+			options.ipc_ring_size = (size_t)json_get_value_default(jconfig, int, ai-ipc-ring-mb, 64) * 1024 * 1024;
+			options.eject_ms = json_get_value_default(jconfig, int, ai-eject-ms, 10000);
+			
+			// letterboxed to the model input size before upload, 0: original bytes
+			options.input_size = json_get_value_default(jconfig, int, ai-input-size, 0);
+			options.jpeg_quality = json_get_value_default(jconfig, int, ai-jpeg-quality, 90);
+			
+			// very large images: predicted as overlapping tiles, the boxes merged in image coordinates
+			options.tile_size = json_get_value_default(jconfig, int, ai-tile-size, 0);
+			options.tile_overlap = json_get_value_default(jconfig, double, ai-tile-overlap, 0.2);
+			options.tile_concurrency = json_get_value_default(jconfig, int, ai-tile-concurrency, 4);
+			
+			options.max_connections = json_get_value_default(jconfig, int, ai-max-connections, 4);
+			if(options.max_connections < options.tile_concurrency) options.max_connections = options.tile_concurrency;
+			options.timeout = json_get_value_default(jconfig, int, ai-timeout, 30);
+			options.max_retries = json_get_value_default(jconfig, int, ai-max-retries, 2);
+			options.retry_base_ms = json_get_value_default(jconfig, int, ai-retry-base-ms, 200);
+			ai_client_set_options(ai, &options, sizeof(options));
+			ai_client_load_endpoints(ai, jserver_urls);
+			
+			// results of already seen images are reused (per server and model version)
+			const char *model_version = json_get_value_default(jconfig, string, ai-model-version, "");
+			const char *cache_dir = json_get_value(jconfig, string, ai-cache-dir);
+			int cache_size_mb = json_get_value_default(jconfig, int, ai-cache-size-mb, 64);
+			ai_client_set_model_version(ai, model_version?model_version:"");
+			if(cache_size_mb > 0) ai_client_set_cache(ai, ai_cache_new(cache_dir, (int64_t)cache_size_mb * 1024 * 1024));
+			
+			// score thresholds and merging of overlapping boxes before they are added to the labels
+			ai_postprocess_t *postprocess = ai_postprocess_init(NULL);
+			ai_postprocess_load(postprocess, jconfig);
+			ai_client_set_postprocess(ai, postprocess);
 		}
 	}
 	
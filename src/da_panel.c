@@ -33,9 +33,30 @@
 
 #include "common.h"
 #include "da_panel.h"
+#include "label-badges.h"
+#include "tile-renderer.h"
 
 static gboolean on_da_key_pressed(GtkWidget * da, GdkEventKey * event, da_panel_t * panel)
 {
+	double cx = panel->width / 2;
+	double cy = panel->height / 2;
+	switch(event->keyval)
+	{
+	case GDK_KEY_plus: case GDK_KEY_equal: case GDK_KEY_KP_Add:
+		da_panel_zoom_at(panel, panel->zoom * 2, cx, cy);
+		return TRUE;
+	case GDK_KEY_minus: case GDK_KEY_KP_Subtract:
+		da_panel_zoom_at(panel, panel->zoom / 2, cx, cy);
+		return TRUE;
+	case GDK_KEY_0: case GDK_KEY_KP_0:
+		da_panel_zoom_at(panel, 1.0, cx, cy);	// fit to window
+		return TRUE;
+	case GDK_KEY_m: case GDK_KEY_M:
+		da_panel_set_loupe(panel, !panel->loupe_enabled);
+		return TRUE;
+	default:
+		break;
+	}
 	return FALSE;
 }
 static gboolean on_da_key_released(GtkWidget * da, GdkEventKey * event, da_panel_t * panel)
@@ -51,8 +72,47 @@ static gboolean on_da_triple_clicks(GtkWidget * da, GdkEventButton * event, da_p
 }
 
 #include <math.h>
-#define LINE_WIDTH_THRESHOLD ( 5.0 / 480.0 )
-enum border_type pt_on_border(double x, double y, const annotation_data_t * bbox)
+
+/*
+ * viewport transform:
+ *   the image is fit to the viewport (auto_scale) and then magnified by 'zoom',
+ *   (scroll_x, scroll_y) is the viewport origin in content pixels.
+ */
+#define DA_PANEL_MIN_ZOOM	(1.0)
+#define DA_PANEL_MAX_ZOOM	(64.0)
+
+static inline double content_width(const da_panel_t * panel) 
+{
+	int width = (panel->auto_scale || panel->image_width < 1)?panel->width:panel->image_width;
+	return (double)width * panel->zoom;
+}
+static inline double content_height(const da_panel_t * panel) 
+{ 
+	int height = (panel->auto_scale || panel->image_height < 1)?panel->height:panel->image_height;
+	return (double)height * panel->zoom;
+}
+
+static inline void viewport_to_image(const da_panel_t * panel, double sx, double sy, double * x, double * y)
+{
+	*x = (sx + panel->scroll_x) / content_width(panel);
+	*y = (sy + panel->scroll_y) / content_height(panel);
+}
+
+static inline void image_to_viewport(const da_panel_t * panel, double x, double y, double * sx, double * sy)
+{
+	*sx = x * content_width(panel) - panel->scroll_x;
+	*sy = y * content_height(panel) - panel->scroll_y;
+}
+
+// cairo transform: normalized image coordinates --> viewport
+static inline void set_image_transform(const da_panel_t * panel, cairo_t * cr)
+{
+	cairo_translate(cr, -panel->scroll_x, -panel->scroll_y);
+	cairo_scale(cr, content_width(panel), content_height(panel));
+}
+
+#define BORDER_THRESHOLD_PIXELS ( 5.0 )
+enum border_type pt_on_border(double x, double y, const annotation_data_t * bbox, double tx, double ty)
 {
 	enum border_type border = border_type_unknown;
 
@@ -61,29 +121,38 @@ enum border_type pt_on_border(double x, double y, const annotation_data_t * bbox
 	double x2 = x1 + bbox->width;
 	double y2 = y1 + bbox->height;
 
-	if(fabs(y - y1) <= LINE_WIDTH_THRESHOLD)
+	if(fabs(y - y1) <= ty)
 	{
-		if(fabs(x - x1) <= LINE_WIDTH_THRESHOLD) return border_type_top_left;
-		if(fabs(x - x2) <= LINE_WIDTH_THRESHOLD) return border_type_top_right;
+		if(fabs(x - x1) <= tx) return border_type_top_left;
+		if(fabs(x - x2) <= tx) return border_type_top_right;
 		if(x > x1 && x < x2) return border_type_top;
 	}
 
-	if(fabs(y - y2) <= LINE_WIDTH_THRESHOLD)
+	if(fabs(y - y2) <= ty)
 	{
-		if(fabs(x - x1) <= LINE_WIDTH_THRESHOLD) return border_type_bottom_left;
-		if(fabs(x - x2) <= LINE_WIDTH_THRESHOLD) return border_type_bottom_right;
+		if(fabs(x - x1) <= tx) return border_type_bottom_left;
+		if(fabs(x - x2) <= tx) return border_type_bottom_right;
 		if(x > x1 && x < x2) return border_type_bottom;
 	}
 
 	if( y > y1 && y < y2)
 	{
-		if(fabs(x - x1) <= LINE_WIDTH_THRESHOLD) return border_type_left;
-		if(fabs(x - x2) <= LINE_WIDTH_THRESHOLD) return border_type_right;
+		if(fabs(x - x1) <= tx) return border_type_left;
+		if(fabs(x - x2) <= tx) return border_type_right;
 	}
 
 	return border;
 }
 
+// hit-test in viewport coordinates
+static enum border_type hit_test_border(const da_panel_t * panel, double sx, double sy, const annotation_data_t * bbox)
+{
+	double x = 0, y = 0;
+	viewport_to_image(panel, sx, sy, &x, &y);
+	return pt_on_border(x, y, bbox, 
+		BORDER_THRESHOLD_PIXELS / content_width(panel), 
+		BORDER_THRESHOLD_PIXELS / content_height(panel));
+}
 
 
 static gboolean on_da_double_clicked(GtkWidget * da, GdkEventButton * event, da_panel_t * panel)
@@ -92,24 +161,16 @@ static gboolean on_da_double_clicked(GtkWidget * da, GdkEventButton * event, da_
 	printf("%s(x1=%d, y1 = %d)... ==>> delete annotation \n", __FUNCTION__, button->x1, button->y1);
 	button->clicks = 0;
 
-	int width = panel->width;
-	int height = panel->height;
-
-	double x = event->x;
-	double y = event->y;
-
 	annotation_list_t * list = panel->annotations;
-	if(NULL == list) return FALSE;
-
-	x /= (double)width;
-	y /= (double)height;
+	if(NULL == list || panel->width < 1 || panel->height < 1) return FALSE;
 
 	for(ssize_t i = 0; i < list->length; ++i)
 	{
 		annotation_data_t * bbox = list->data[i];
 		assert(bbox);
+		if(!da_panel_is_class_visible(panel, bbox->klass)) continue;
 		
-		enum border_type border = pt_on_border(x, y, bbox);
+		enum border_type border = hit_test_border(panel, event->x, event->y, bbox);
 		printf("\t== border: %d\n", border);
 		if(border != border_type_unknown)
 		{
@@ -118,10 +179,9 @@ static gboolean on_da_double_clicked(GtkWidget * da, GdkEventButton * event, da_
 				bbox->width, bbox->height,
 				(int)border
 			);
+			annotation_data_t removed[1] = { *bbox };
 			list->remove(list, i);
-			panel->cur_index = -1;
-			gtk_widget_queue_draw(panel->da);
-			shell_redraw(panel->shell);
+			shell_notify_annotation_removed(panel->shell, i, removed);
 			break;
 		}
 	}
@@ -138,6 +198,7 @@ static gboolean on_da_clicked(GtkWidget * da, GdkEventButton * event, da_panel_t
 
 	panel->mode = graphic_mode_none;
 	panel->cur_index = -1;	// reset selection states
+	shell_set_active_panel(panel->shell, panel);	// before the combo box changes the class of the selection
 	button_state_t * button = &panel->buttons[event->button];
 	
 	button->x1 = (int)event->x;
@@ -151,16 +212,14 @@ static gboolean on_da_clicked(GtkWidget * da, GdkEventButton * event, da_panel_t
 	annotation_list_t * list = panel->annotations;
 	if(list && panel->width > 1 && panel->height > 1 && panel->image_width > 0)
 	{
-		double x = event->x / (double)(panel->width);
-		double y = event->y / (double)(panel->height);
-
 		enum border_type border = border_type_unknown;
 		int cur_index = -1;
 		for(int i = 0; i < list->length; ++i)
 		{
 			annotation_data_t * bbox = list->data[i];
 			assert(bbox);
-			border = pt_on_border(x, y, bbox);
+			if(!da_panel_is_class_visible(panel, bbox->klass)) continue;
+			border = hit_test_border(panel, event->x, event->y, bbox);
 			if(border != border_type_unknown)
 			{
 				cur_index = i;
@@ -186,6 +245,7 @@ static gboolean on_da_button_pressed(GtkWidget * da, GdkEventButton * event, da_
 	if(index < 1 || index > 3) return FALSE;
 	button_state_t * button = &panel->buttons[index];
 
+	if(!gtk_widget_has_focus(da)) gtk_widget_grab_focus(da);
 	panel->button_index = index;
 
 	if(button->clicks++ == 0)
@@ -207,18 +267,17 @@ static gboolean on_da_button_pressed(GtkWidget * da, GdkEventButton * event, da_
 
 static int add_annotation(da_panel_t * panel, const int_rect * bbox)
 {
-	int image_width = panel->width;
-	int image_height = panel->height;
-	if(image_width <= 0 || image_height <= 0) return -1;
-
+	if(panel->width <= 0 || panel->height <= 0) return -1;
 
-	double x = (double)bbox->x / (double)image_width;
-	double y = (double)bbox->y / (double)image_height;
-	double cx = (double)bbox->cx / (double)image_width;
-	double cy = (double)bbox->cy / (double)image_height;
+	double x = 0, y = 0;
+	viewport_to_image(panel, bbox->x, bbox->y, &x, &y);
+	double cx = (double)bbox->cx / content_width(panel);
+	double cy = (double)bbox->cy / content_height(panel);
 
 	annotation_data_t data[1];
 	memset(data, 0, sizeof(data));
+	annotation_data_t before[1];
+	memset(before, 0, sizeof(before));
 
 	if(panel->def_class >= 0) data->klass = panel->def_class;
 	data->x = x + cx / 2;		// center_x
@@ -237,12 +296,14 @@ static int add_annotation(da_panel_t * panel, const int_rect * bbox)
 
 	
 
-	int rc = annotations->update(annotations, panel->cur_index, data);
+	int cur_index = panel->cur_index;
+	int has_before = (cur_index >= 0 && cur_index < annotations->length);
+	if(has_before) *before = *annotations->data[cur_index];
+	
+	int rc = annotations->update(annotations, cur_index, data);
 	assert(0 == rc);
 
-
-	
-	shell_redraw(panel->shell);
+	shell_notify_annotation_changed(panel->shell, has_before?before:NULL, data);
 	
 	return rc;
 	
@@ -344,6 +405,52 @@ static gboolean on_da_button_released(GtkWidget * da, GdkEventButton * event, da
 	return FALSE;
 }
 
+/*
+ * edge snapping: the dragged borders of the selection move to the strongest image edge nearby,
+ * the edge maps are cached in the (shared) da_image.
+ */
+#define EDGE_SNAP_TILE_SIZE (128)
+#define EDGE_SNAP_MIN_STRENGTH (64)	// average Sobel response along the border (~16 gray levels step)
+static void snap_selection(da_panel_t * panel, enum border_type border, int_rect * bbox)
+{
+	const global_params_t * params = global_params_get_default();
+	da_image_t * image = panel->image;
+	if(NULL == image || params->edge_snap_radius <= 0 || bbox->cx <= 0 || bbox->cy <= 0) return;
+	
+	int snap_left = (border == border_type_left || border == border_type_top_left || border == border_type_bottom_left);
+	int snap_right = (border == border_type_right || border == border_type_top_right || border == border_type_bottom_right);
+	int snap_top = (border == border_type_top || border == border_type_top_left || border == border_type_top_right);
+	int snap_bottom = (border == border_type_bottom || border == border_type_bottom_left || border == border_type_bottom_right);
+	
+	// selection --> image pixels
+	int image_width = image->bgra->width;
+	int image_height = image->bgra->height;
+	double x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	viewport_to_image(panel, bbox->x, bbox->y, &x1, &y1);
+	viewport_to_image(panel, bbox->x + bbox->cx, bbox->y + bbox->cy, &x2, &y2);
+	int left = x1 * image_width, right = x2 * image_width;
+	int top = y1 * image_height, bottom = y2 * image_height;
+	
+	// the search radius is given in screen pixels
+	int radius_x = ceil(params->edge_snap_radius * image_width / content_width(panel));
+	int radius_y = ceil(params->edge_snap_radius * image_height / content_height(panel));
+	
+	img_gradient_t * grad = image->gradient;
+	if(snap_left) left = img_gradient_snap_x(grad, left, top, bottom - 1, radius_x, EDGE_SNAP_MIN_STRENGTH);
+	if(snap_right) right = img_gradient_snap_x(grad, right, top, bottom - 1, radius_x, EDGE_SNAP_MIN_STRENGTH);
+	if(snap_top) top = img_gradient_snap_y(grad, top, left, right - 1, radius_y, EDGE_SNAP_MIN_STRENGTH);
+	if(snap_bottom) bottom = img_gradient_snap_y(grad, bottom, left, right - 1, radius_y, EDGE_SNAP_MIN_STRENGTH);
+	if(right <= left || bottom <= top) return;
+	
+	image_to_viewport(panel, (double)left / image_width, (double)top / image_height, &x1, &y1);
+	image_to_viewport(panel, (double)right / image_width, (double)bottom / image_height, &x2, &y2);
+	bbox->x = round(x1);
+	bbox->y = round(y1);
+	bbox->cx = round(x2) - bbox->x;
+	bbox->cy = round(y2) - bbox->y;
+	return;
+}
+
 static gboolean resize_bbox(da_panel_t * panel, GdkEventMotion * event, double x, double y)
 {
 	int index = panel->button_index;
@@ -365,8 +472,8 @@ static gboolean resize_bbox(da_panel_t * panel, GdkEventMotion * event, double x
 	// @todo:
 	annotation_data_t * data = list->data[cur_index];
 	assert(data);
-	int width = panel->width;
-	int height = panel->height;
+	double width = content_width(panel);
+	double height = content_height(panel);
 	
 	int x1 = button->x1;
 	int y1 = button->y1;
@@ -378,10 +485,12 @@ static gboolean resize_bbox(da_panel_t * panel, GdkEventMotion * event, double x
 
 	int_rect * bbox = panel->selection;
 	assert(bbox);
-	bbox->x = (data->x - data->width / 2) * (double)width;
-	bbox->y = (data->y - data->height / 2) * (double)height;
-	bbox->cx = data->width * (double)width;
-	bbox->cy = data->height * (double)height;
+	double left = 0, top = 0;
+	image_to_viewport(panel, data->x - data->width / 2, data->y - data->height / 2, &left, &top);
+	bbox->x = left;
+	bbox->y = top;
+	bbox->cx = data->width * width;
+	bbox->cy = data->height * height;
 	
 	switch(border)
 	{
@@ -434,11 +543,14 @@ static gboolean resize_bbox(da_panel_t * panel, GdkEventMotion * event, double x
 		break;
 	}
 	
+	if(!(event->state & GDK_SHIFT_MASK)) snap_selection(panel, border, bbox);	// shift: free dragging
+	
 	gtk_widget_queue_draw(panel->da);
 	gtk_main_iteration();
 	return FALSE;
 }
 
+static void move_loupe(da_panel_t * panel, int x, int y);
 static gboolean on_da_motion_notify(GtkWidget * da, GdkEventMotion * event, da_panel_t * panel)
 {
 	int index = panel->button_index;
@@ -451,28 +563,24 @@ static gboolean on_da_motion_notify(GtkWidget * da, GdkEventMotion * event, da_p
 		gdk_window_get_device_position(event->window, event->device,
 			&x, &y, &masks);
 	}
+	move_loupe(panel, x, y);
 
 	if(panel->cur_index >= 0 && panel->selected_border != border_type_unknown)
 	{
 		return resize_bbox(panel, event, x, y);
 	}
 	
-	int width = panel->width;
-	int height = panel->height;
-	
 	enum border_type border = border_type_unknown;
 	annotation_list_t * list = panel->annotations;
-	if(list)
+	if(list && panel->width > 0 && panel->height > 0 && (index < 1 || index > 3))	// hover only, the cursor is overridden while dragging
 	{
-		double _x = (double)x / (double)width;
-		double _y = (double)y / (double)height;
-			
 		for(int i = 0; i < list->length; ++i)
 		{
 			annotation_data_t * bbox = list->data[i];
 			assert(bbox);
+			if(!da_panel_is_class_visible(panel, bbox->klass)) continue;
 
-			border = pt_on_border(_x, _y, bbox);
+			border = hit_test_border(panel, x, y, bbox);
 			if(border != border_type_unknown)
 			{
 				
@@ -523,7 +631,84 @@ static gboolean on_da_motion_notify(GtkWidget * da, GdkEventMotion * event, da_p
 	return FALSE;
 }
 
-static void draw_annotations(da_panel_t * panel, cairo_t * cr)
+static inline void draw_label(da_panel_t * panel, cairo_t * cr, const global_params_t * params, const annotation_data_t * data)
+{
+	// also called by the render workers: the badges are rendered beforehand on the main thread (prepare_overlay)
+	const label_badge_t * badge = label_badges_peek(panel->badges, data->klass);
+	if(NULL == badge) return;
+
+	// device coordinates, one blit per label
+	double x = 0, y = 0;
+	image_to_viewport(panel, data->x - data->width / 2, data->y - data->height / 2, &x, &y);
+	x = floor(x);
+	y = floor(y);
+	cairo_set_source_surface(cr, badge->surface, x, y);
+	cairo_rectangle(cr, x, y, badge->width, badge->height);
+	cairo_fill(cr);
+	return;
+}
+
+static void draw_annotation(da_panel_t * panel, cairo_t * cr, const global_params_t * params, const annotation_data_t * data)
+{
+	static const double dashes[2] = { 0.01, 0.005 };
+	GdkRGBA line_color = params->fg_color;
+
+	cairo_save(cr);
+	set_image_transform(panel, cr);
+	cairo_set_line_width(cr, params->line_size / content_height(panel));
+	cairo_set_source_rgba(cr, line_color.red, line_color.green, line_color.blue, line_color.alpha);
+	cairo_set_dash(cr, dashes, 2, 0);
+	
+	cairo_rectangle(cr,
+		data->x - data->width / 2,
+		data->y - data->height / 2,
+		data->width, data->height);
+	cairo_stroke(cr);
+	cairo_restore(cr);
+
+	draw_label(panel, cr, params, data);
+	return;
+}
+
+/*
+ * get_visible_region(): the part of the image shown in 'area' (viewport coordinates),
+ * converted to normalized image coordinates { x1, y1, x2, y2 } and expanded by 'margin' pixels.
+ */
+static void get_visible_region(const da_panel_t * panel, const int_rect * area, double margin, double region[4])
+{
+	viewport_to_image(panel, area->x - margin, area->y - margin, &region[0], &region[1]);
+	viewport_to_image(panel, area->x + area->cx + margin, area->y + area->cy + margin, &region[2], &region[3]);
+	return;
+}
+
+int da_panel_is_class_visible(const da_panel_t * panel, int klass)
+{
+	if(klass < 0 || klass >= panel->hidden_classes_size * 32) return 1;
+	return !(panel->hidden_classes[klass / 32] & ((uint32_t)1 << (klass % 32)));
+}
+
+void da_panel_set_class_visible(da_panel_t * panel, int klass, int visible)
+{
+	if(klass < 0) return;
+	if(klass >= panel->hidden_classes_size * 32)
+	{
+		if(visible) return;
+		int new_size = klass / 32 + 1;
+		uint32_t * hidden_classes = realloc(panel->hidden_classes, new_size * sizeof(*hidden_classes));
+		assert(hidden_classes);
+		memset(hidden_classes + panel->hidden_classes_size, 0, (new_size - panel->hidden_classes_size) * sizeof(*hidden_classes));
+		panel->hidden_classes = hidden_classes;
+		panel->hidden_classes_size = new_size;
+	}
+	
+	if(visible) panel->hidden_classes[klass / 32] &= ~((uint32_t)1 << (klass % 32));
+	else panel->hidden_classes[klass / 32] |= ((uint32_t)1 << (klass % 32));
+	
+	da_panel_invalidate_overlay(panel);
+	return;
+}
+
+static annotation_list_t * get_annotations(da_panel_t * panel)
 {
 	annotation_list_t * list = panel->annotations;
 	if(NULL == list) {
@@ -531,246 +716,1244 @@ static void draw_annotations(da_panel_t * panel, cairo_t * cr)
 			assert(list);
 			panel->annotations = list;
 	}
-	if(NULL == list) return;
+	return list;
+}
 
-	int width = panel->width;
-	int height = panel->height;
+/*
+ * render_overlay_area(): 
+ * 	render 'area' (viewport coordinates) of the retained annotation layer, 'cr' is clipped to 'area' and cleared.
+ *  The box at overlay_skip_index (the one being edited) is excluded and drawn live by draw_annotations().
+ *  Runs on the tile renderer's worker threads: no GTK calls here.
+ */
+static void render_overlay_area(da_panel_t * panel, cairo_t * cr, const int_rect * area)
+{
+	annotation_list_t * list = panel->annotations;
+	if(NULL == list) return;
+	if(area->cx <= 0 || area->cy <= 0) return;
 
 	const global_params_t * params = global_params_get_default();
 	assert(params);
+	assert(params->labels && params->num_labels > 0);
+	int skip_index = panel->overlay_skip_index;
+	
+	double width = content_width(panel);
+	double height = content_height(panel);
+	
 	// TODO: load color themes
-	GdkRGBA line_color;
-	double line_width = 0.005;
-
-	line_color = params->fg_color;
-	assert(height > 0);
-
-	line_width = params->line_size / (double)height;	// scale to viewport size
+	GdkRGBA line_color = params->fg_color;
+	double line_width = params->line_size / height;	// scale to viewport size
+	debug_printf("%s()::length = %d, area = { %d, %d, %d, %d }\n", __FUNCTION__, (int)list->length,
+		area->x, area->y, area->cx, area->cy);
 	
-	//~ line_color.red = 0;
-	//~ line_color.green = 0;
-	//~ line_color.blue = 1;
-	//~ line_color.alpha = 1;
-
-	cairo_set_line_width(cr, line_width);
-	debug_printf("%s()::length = %d\n", __FUNCTION__, (int)list->length);
-
-
-	cairo_save(cr);
-	cairo_scale(cr, (double)width, (double)height);
-	double dashes[2] = { 0.01, 0.005 };
-
+	double region[4];	// visible region (normalized): x1, y1, x2, y2
+	get_visible_region(panel, area, params->line_size, region);
+	
+	// LOD: boxes smaller than min_box pixels are aggregated into one dot per screen cell,
+	// cells are aligned to the content (not the viewport) so that scrolled strips match.
+	int cell_size = (params->lod_min_box_size > 1)?(int)params->lod_min_box_size:1;
+	int col0 = (int)floor((area->x + panel->scroll_x) / cell_size);
+	int row0 = (int)floor((area->y + panel->scroll_y) / cell_size);
+	int grid_width = (int)floor((area->x + area->cx - 1 + panel->scroll_x) / cell_size) - col0 + 1;
+	int grid_height = (int)floor((area->y + area->cy - 1 + panel->scroll_y) / cell_size) - row0 + 1;
+	uint32_t * cells = calloc(((size_t)grid_width * grid_height + 31) / 32, sizeof(*cells));
+	assert(cells);
 	
-	const char ** labels = params->labels;
-	assert(labels && params->num_labels > 0);
+	ssize_t num_labels = 0;
+	ssize_t * label_indices = malloc((list->length + 1) * sizeof(*label_indices));
+	assert(label_indices);
 	
+	// pass 1: all boxes share one path and one stroke
+	cairo_save(cr);
+	set_image_transform(panel, cr);
+	cairo_set_line_width(cr, line_width);
+	cairo_set_source_rgba(cr, line_color.red, line_color.green, line_color.blue, line_color.alpha);
+	ssize_t num_small_boxes = 0;
 	for(ssize_t i = 0; i < list->length; ++i)
 	{
+		if(i == skip_index) continue;
+		
 		annotation_data_t * data = list->data[i];
 		assert(data);
-		cairo_set_source_rgba(cr, line_color.red, line_color.green, line_color.blue, line_color.alpha);
-
-		if(i == panel->cur_index) cairo_set_dash(cr, dashes, 2, 0);
-		else cairo_set_dash(cr, NULL, 0, 0);
+		if(!da_panel_is_class_visible(panel, data->klass)) continue;
 		
-		cairo_rectangle(cr,
-			data->x - data->width / 2,
-			data->y - data->height / 2,
-			data->width, data->height);
-		cairo_stroke(cr);
-
-		if(data->klass <= params->num_labels)
+		double x1 = data->x - data->width / 2;
+		double y1 = data->y - data->height / 2;
+		double x2 = x1 + data->width;
+		double y2 = y1 + data->height;
+		if(x2 < region[0] || x1 > region[2] || y2 < region[1] || y1 > region[3]) continue;	// culled
+		
+		double cx = data->width * width;	// size in screen pixels
+		double cy = data->height * height;
+		if(cx < params->lod_min_box_size && cy < params->lod_min_box_size)
 		{
-			cairo_text_extents_t extents;
-			memset(&extents, 0, sizeof(extents));
-			
-			GdkRGBA font_color = params->font_color;
-			
-			cairo_set_font_size(cr, params->font_size / (double)height);
-			cairo_select_font_face(cr, params->font_name, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-
-
-			const char * label = _(labels[data->klass]);
-			cairo_text_extents(cr, label, &extents);
-
-			double x = data->x - data->width / 2;
-			double y = data->y - data->height / 2;
+			int col = (int)floor(data->x * width / cell_size) - col0;
+			int row = (int)floor(data->y * height / cell_size) - row0;
+			if(col < 0 || col >= grid_width || row < 0 || row >= grid_height) continue;
 			
-			cairo_set_source_rgba(cr, 0, 0, 0, 0.4);
-			cairo_rectangle(cr, x, y, extents.width, extents.height);
-			cairo_fill(cr);
-
-			cairo_set_source_rgb(cr, font_color.red, font_color.green, font_color.blue);
-			cairo_move_to(cr, x, y + extents.height);
-			cairo_show_text(cr, label);
+			size_t cell = (size_t)row * grid_width + col;
+			cells[cell / 32] |= (uint32_t)1 << (cell % 32);
+			++num_small_boxes;
+			continue;
 		}
 		
-		debug_printf("== draw_annotation[%d]: klass=%d, { %.3f, %.3f, %.3f, %.3f }, font_name=%s\n",
-			(int)i,
-			(int)data->klass,
-			data->x, data->y, data->width, data->height,
-			params->font_name
-			);
+		cairo_rectangle(cr, x1, y1, data->width, data->height);
+		if(cy >= params->lod_min_label_size) label_indices[num_labels++] = i;
 	}
+	cairo_stroke(cr);
+	cairo_restore(cr);
 	
+	if(num_small_boxes > 0)
+	{
+		for(int row = 0; row < grid_height; ++row)
+		{
+			for(int col = 0; col < grid_width; ++col)
+			{
+				size_t cell = (size_t)row * grid_width + col;
+				if(cells[cell / 32] & ((uint32_t)1 << (cell % 32))) 
+				{
+					cairo_rectangle(cr, 
+						(col0 + col) * cell_size - panel->scroll_x, 
+						(row0 + row) * cell_size - panel->scroll_y, 
+						cell_size, cell_size);
+				}
+			}
+		}
+		cairo_fill(cr);
+	}
+	free(cells);
 
-	cairo_restore(cr);
+	// pass 2: label badges (device coordinates)
+	for(ssize_t i = 0; i < num_labels; ++i)
+	{
+		draw_label(panel, cr, params, list->data[label_indices[i]]);
+	}
+	free(label_indices);
 	return;
 }
 
-
-static gboolean on_da_draw(GtkWidget * da, cairo_t * cr, da_panel_t * panel)
+/*
+ * render_scaled_area(): the scaled image, 'cr' is clipped to 'area' (viewport coordinates).
+ *  Runs on the tile renderer's worker threads: no GTK calls here.
+ */
+static void render_scaled_area(da_panel_t * panel, cairo_t * cr, const int_rect * area)
 {
-	debug_printf("%s()...\n", __FUNCTION__);
+	cairo_set_source_rgb(cr, 0.2, 0.3, 0.4);
+	cairo_paint(cr);
+	
 	cairo_surface_t * surface = panel->surface;
-	if(NULL == surface || panel->width < 1 || panel->height < 1 || panel->image_width < 1 || panel->image_height < 1)
-	{
-		cairo_set_source_rgb(cr, 0.2, 0.3, 0.4);
-		cairo_paint(cr);
+	if(NULL == surface || panel->image_width < 1 || panel->image_height < 1) return;
+	
+	set_image_transform(panel, cr);
+	cairo_scale(cr, 1.0 / (double)panel->image_width, 1.0 / (double)panel->image_height);
+	cairo_set_source_surface(cr, surface, 0, 0);
+	
+	// show the pixel grid when zoomed in
+	if(content_width(panel) >= panel->image_width * 4) cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+	cairo_paint(cr);
+	return;
+}
 
-	}else
+// map the pixels of 'area' with the display LUT / CLAHE, in place
+static void adjust_area(da_panel_t * panel, cairo_t * cr, const int_rect * area)
+{
+	cairo_surface_t * target = cairo_get_target(cr);
+	double x = area->x, y = area->y;
+	cairo_user_to_device(cr, &x, &y);
+	int dx = (int)x, dy = (int)y;
+	assert(dx >= 0 && dy >= 0 
+		&& dx + area->cx <= cairo_image_surface_get_width(target) 
+		&& dy + area->cy <= cairo_image_surface_get_height(target));
+	
+	cairo_surface_flush(target);
+	int stride = cairo_image_surface_get_stride(target);
+	unsigned char * data = cairo_image_surface_get_data(target) + (size_t)dy * stride + dx * 4;
+	
+	if(panel->display->clahe && panel->display_clahe->luts)
 	{
-		cairo_save(cr);
-		double sx = 1.0;
-		double sy = 1.0;
-		if(panel->auto_scale)
-		{
-			sx = (double)panel->width / (double)panel->image_width;
-			sy = (double)panel->height / (double)panel->image_height;
-			cairo_scale(cr, sx, sy);
-		}
-		cairo_set_source_surface(cr, surface, 0, 0);
-		cairo_paint(cr);
-
-		cairo_restore(cr);
-
-		// draw current annotations
-		draw_annotations(panel, cr);
+		double u0 = 0, v0 = 0;
+		viewport_to_image(panel, area->x + 0.5, area->y + 0.5, &u0, &v0);
+		bgra_apply_clahe(data, area->cx, area->cy, stride, panel->display_clahe, 
+			u0, v0, 1.0 / content_width(panel), 1.0 / content_height(panel));
 	}
+	bgra_apply_lut(data, area->cx, area->cy, stride, panel->display_lut);
+	cairo_surface_mark_dirty_rectangle(target, dx, dy, area->cx, area->cy);
+	return;
+}
 
-	int_rect * bbox = panel->selection;
-	if(bbox->cx > 0 && bbox->cy > 0)
+/*
+ * render_background_area(): the scaled image, mapped by the display adjustments if any.
+ *  Slider changes only re-run the mapping from the cached 'scaled' layer.
+ */
+static void render_background_area(da_panel_t * panel, cairo_t * cr, const int_rect * area)
+{
+	if(!panel->display_adjusted)
 	{
-		char msg[200] = "";
-		snprintf(msg, sizeof(msg), "bbox: { %d, %d, %d, %d }", bbox->x, bbox->y, bbox->cx, bbox->cy);
-
-		global_params_t * params = global_params_get_default();
-		GdkRGBA sel_color = params->sel_color;
-		GdkRGBA font_color = params->font_color;
-		GdkRGBA bg_color = params->bg_color;
-		
-		const char * font_face = params->font_name;
-		double line_size = params->line_size;
-		double font_size = params->font_size;
-		assert(font_size > 0);
-		assert(line_size > 0);
-		assert(font_face && font_face[0]);
-
-		
-		cairo_set_source_rgb(cr, sel_color.red, sel_color.green, sel_color.blue);
-		cairo_set_line_width(cr, line_size);
-		cairo_rectangle(cr, bbox->x, bbox->y, bbox->cx, bbox->cy);
-		cairo_stroke(cr);
-
+		render_scaled_area(panel, cr, area);
+		return;
+	}
+	
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, panel->scaled->image, 0, 0);
+	cairo_paint(cr);
+	adjust_area(panel, cr, area);
+	return;
+}
 
-		double x = 10;
-		double y = 30;
-		
-		cairo_text_extents_t extents;
-		memset(&extents, 0, sizeof(extents));
+/******************************************************************************
+ * layers: viewport-sized surfaces, rendered tile by tile on the worker pool
+******************************************************************************/
+typedef void (* layer_render_func)(da_panel_t * panel, cairo_t * cr, const int_rect * area);
 
-		cairo_select_font_face(cr, font_face, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-		cairo_set_font_size(cr, font_size);
-		
-		cairo_text_extents(cr, msg, &extents);
-		cairo_set_source_rgba(cr, bg_color.red, bg_color.green, bg_color.blue, 0.4);
+struct layer_tile_context
+{
+	da_panel_t * panel;
+	layer_render_func render;
+};
 
-		fprintf(stderr, "text range: width=%.2f, height = %.2f\n", extents.width, extents.height);
-		cairo_rectangle(cr, x - 5, y - 5 - extents.height, extents.width + 10, extents.height + 10);
-		cairo_fill(cr);
+static void render_layer_tile(void * user_data, cairo_t * cr, const cairo_rectangle_int_t * tile)
+{
+	struct layer_tile_context * ctx = user_data;
+	int_rect area[1] = {{ tile->x, tile->y, tile->width, tile->height }};
+	ctx->render(ctx->panel, cr, area);
+	return;
+}
 
-		cairo_move_to(cr, x, y);
-		cairo_set_source_rgb(cr, font_color.red, font_color.green, font_color.blue);
-		
-		cairo_show_text(cr, msg);
+/*
+ * render_layer_area(): 
+ *   re-render 'area' (viewport coordinates) of a layer, 
+ *   split into tiles on the worker pool, or in place when the renderer is single-threaded.
+ */
+static void render_layer_area(da_panel_t * panel, cairo_surface_t * layer, const int_rect * area, layer_render_func render)
+{
+	if(area->cx <= 0 || area->cy <= 0) return;
+	
+	tile_renderer_t * renderer = panel->renderer;
+	if(renderer && renderer->num_threads > 0)
+	{
+		struct layer_tile_context ctx = { panel, render };
+		cairo_rectangle_int_t rect = { area->x, area->y, area->cx, area->cy };
+		renderer->render(renderer, layer, &rect, render_layer_tile, &ctx);
+		return;
 	}
 	
-	return FALSE;
+	cairo_t * cr = cairo_create(layer);
+	cairo_rectangle(cr, area->x, area->y, area->cx, area->cy);
+	cairo_clip(cr);
+	
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	
+	render(panel, cr, area);
+	cairo_destroy(cr);
+	return;
 }
-static void on_da_realize(GtkWidget * da, da_panel_t * panel)
+
+static void damage_layer(da_layer_t * layer, const int_rect * area)
 {
-	debug_printf("%s()...\n", __FUNCTION__);
+	if(area->cx <= 0 || area->cy <= 0) return;
+	cairo_rectangle_int_t rect = { area->x, area->y, area->cx, area->cy };
+	if(NULL == layer->damage) layer->damage = cairo_region_create();
+	cairo_region_union_rectangle(layer->damage, &rect);
 	return;
 }
 
-static void on_da_resize(GtkWidget * da, GdkRectangle * allocation, da_panel_t * panel)
+static void layer_clear(da_layer_t * layer)
 {
-	debug_printf("%s()...\n", __FUNCTION__);
-	
-	panel->width = allocation->width;
-	panel->height = allocation->height;
-
-	gtk_widget_queue_draw(da);
+	if(layer->image) cairo_surface_destroy(layer->image);
+	if(layer->device) cairo_surface_destroy(layer->device);
+	if(layer->invalid) cairo_region_destroy(layer->invalid);
+	if(layer->damage) cairo_region_destroy(layer->damage);
+	layer->image = NULL;
+	layer->device = NULL;
+	layer->invalid = NULL;
+	layer->damage = NULL;
+	layer->dirty = 1;
 	return;
 }
 
-
-
-static void da_panel_draw(struct da_panel * panel, const bgra_image_t * frame)
+static cairo_surface_t * get_layer_surface(da_panel_t * panel, da_layer_t * layer, cairo_format_t format)
 {
-	cairo_surface_t * surface = panel->surface;
-	if(NULL == surface || frame->width != panel->image_width || frame->height != panel->height)
-	{
-		panel->surface = NULL;
-		if(surface) cairo_surface_destroy(surface);
-
-		bgra_image_t * image = bgra_image_init(panel->image, frame->width, frame->height, frame->data);
-		assert(image && image->data && image->width == frame->width && image->height == frame->height);
-
-		surface = cairo_image_surface_create_for_data(image->data, CAIRO_FORMAT_RGB24,
-			image->width, image->height,
-			(image->stride > 0)?image->stride:(image->width * 4)
-		);
-		assert(surface && cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
-		panel->surface = surface;
-		panel->image_width = image->width;
-		panel->image_height = image->height;
-	}else
+	int width = panel->width;
+	int height = panel->height;
+	assert(width > 0 && height > 0);
+	
+	cairo_surface_t * image = layer->image;
+	if(image && (cairo_image_surface_get_width(image) != width || cairo_image_surface_get_height(image) != height))
 	{
-		bgra_image_t * image = bgra_image_init(panel->image, frame->width, frame->height, frame->data);
-		assert(image && image->data && image->width == frame->width && image->height == frame->height);
-		cairo_surface_mark_dirty(surface);
+		layer_clear(layer);
+		image = NULL;
 	}
-	gtk_widget_queue_draw(panel->da);
-	return;
+	if(NULL == image)
+	{
+		image = cairo_image_surface_create(format, width, height);
+		assert(image && cairo_surface_status(image) == CAIRO_STATUS_SUCCESS);
+		layer->image = image;
+		layer->dirty = 1;
+	}
+	return image;
 }
 
-static inline void clear_selections(struct da_panel * panel)
+static void invalidate_layer(da_layer_t * layer, const int_rect * area)
 {
-	int_rect * bbox = panel->selection;
-	bbox->cx = 0;
-	bbox->cy = 0;
-	panel->cur_index = -1;
+	if(area->cx <= 0 || area->cy <= 0) return;
+	cairo_rectangle_int_t rect = { area->x, area->y, area->cx, area->cy };
+	if(NULL == layer->invalid) layer->invalid = cairo_region_create();
+	cairo_region_union_rectangle(layer->invalid, &rect);
 	return;
 }
 
-static int da_panel_load_image(struct da_panel * panel, const char * path_name)
+static void render_layer(da_panel_t * panel, da_layer_t * layer, layer_render_func render)
 {
-	bgra_image_t image[1];
-	memset(image, 0, sizeof(image));
-
-	clear_selections(panel);
+	int_rect area[1] = {{ 0, 0, panel->width, panel->height }};
+	render_layer_area(panel, layer->image, area, render);
+	cairo_surface_flush(layer->image);
+	damage_layer(layer, area);
 	
-	int rc = bgra_image_load_from_file(image, path_name);
+	if(layer->invalid) cairo_region_destroy(layer->invalid);
+	layer->invalid = NULL;
+	layer->dirty = 0;
+	return;
+}
 
-//	if(!rc) goto label_cleanup;
-	assert(0 == rc);
-	panel->draw(panel, image);
+// re-render the invalidated rects only
+static void render_layer_invalid(da_panel_t * panel, da_layer_t * layer, layer_render_func render)
+{
+	if(NULL == layer->invalid) return;
 	
-//~ label_cleanup:
-	bgra_image_clear(image);
-
-	shell_redraw(panel->shell);
+	int num_rects = cairo_region_num_rectangles(layer->invalid);
+	for(int i = 0; i < num_rects; ++i)
+	{
+		cairo_rectangle_int_t rect;
+		cairo_region_get_rectangle(layer->invalid, i, &rect);
+		
+		int_rect area[1] = {{ rect.x, rect.y, rect.width, rect.height }};
+		render_layer_area(panel, layer->image, area, render);
+		damage_layer(layer, area);
+	}
+	cairo_surface_flush(layer->image);
+	
+	cairo_region_destroy(layer->invalid);
+	layer->invalid = NULL;
+	return;
+}
+
+/*
+ * paint_layer(): 
+ *   upload the damaged parts of the layer (if any) to its device surface, then paint from there. 
+ *   Painting the client-side image instead sends every visible pixel to the display on each frame.
+ */
+static void paint_layer(da_panel_t * panel, cairo_t * cr, da_layer_t * layer)
+{
+	cairo_surface_t * image = layer->image;
+	int width = cairo_image_surface_get_width(image);
+	int height = cairo_image_surface_get_height(image);
+	
+	GdkWindow * window = gtk_widget_get_window(panel->da);
+	if(panel->server_side_surfaces && window && NULL == layer->device)
+	{
+		cairo_content_t content = (cairo_image_surface_get_format(image) == CAIRO_FORMAT_RGB24)?
+			CAIRO_CONTENT_COLOR:CAIRO_CONTENT_COLOR_ALPHA;
+		layer->device = gdk_window_create_similar_surface(window, content, width, height);
+		
+		int_rect area[1] = {{ 0, 0, width, height }};
+		damage_layer(layer, area);
+	}
+	
+	if(NULL == layer->device)
+	{
+		if(panel->measure_uploads)
+		{
+			double x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+			cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+			if(x1 < 0) x1 = 0;
+			if(y1 < 0) y1 = 0;
+			if(x2 > width) x2 = width;
+			if(y2 > height) y2 = height;
+			if(x2 > x1 && y2 > y1) panel->frame_upload_bytes += (size_t)((x2 - x1) * (y2 - y1)) * 4;
+		}
+		cairo_set_source_surface(cr, image, 0, 0);
+		cairo_paint(cr);
+		return;
+	}
+	
+	if(layer->damage)
+	{
+		cairo_t * device_cr = cairo_create(layer->device);
+		cairo_set_operator(device_cr, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source_surface(device_cr, image, 0, 0);
+		
+		int num_rects = cairo_region_num_rectangles(layer->damage);
+		for(int i = 0; i < num_rects; ++i)
+		{
+			cairo_rectangle_int_t rect;
+			cairo_region_get_rectangle(layer->damage, i, &rect);
+			cairo_rectangle(device_cr, rect.x, rect.y, rect.width, rect.height);
+			panel->frame_upload_bytes += (size_t)rect.width * rect.height * 4;
+		}
+		cairo_fill(device_cr);
+		cairo_destroy(device_cr);
+		
+		cairo_region_destroy(layer->damage);
+		layer->damage = NULL;
+	}
+	
+	cairo_set_source_surface(cr, layer->device, 0, 0);
+	cairo_paint(cr);
+	return;
+}
+
+/*
+ * scroll_layer(): 
+ *   shift a retained layer by (dx, dy) and render the newly exposed strips only,
+ *   the device surface is shifted on the display side, only the strips are uploaded.
+ */
+static void scroll_layer(da_panel_t * panel, da_layer_t * layer, int dx, int dy, layer_render_func render)
+{
+	cairo_surface_t * image = layer->image;
+	if(NULL == image || layer->dirty) return;
+	
+	int width = panel->width;
+	int height = panel->height;
+	if(abs(dx) >= width || abs(dy) >= height)
+	{
+		layer->dirty = 1;
+		return;
+	}
+	
+	cairo_surface_t * shifted = cairo_image_surface_create(cairo_image_surface_get_format(image), width, height);
+	assert(shifted && cairo_surface_status(shifted) == CAIRO_STATUS_SUCCESS);
+	
+	cairo_t * cr = cairo_create(shifted);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, image, -dx, -dy);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+	
+	int_rect strips[2] = {
+		{ (dx > 0)?(width - dx):0, 0, abs(dx), height },
+		{ 0, (dy > 0)?(height - dy):0, width, abs(dy) },
+	};
+	render_layer_area(panel, shifted, &strips[0], render);
+	render_layer_area(panel, shifted, &strips[1], render);
+	cairo_surface_flush(shifted);
+	
+	cairo_surface_destroy(image);
+	layer->image = shifted;
+	
+	if(layer->device)
+	{
+		cairo_surface_t * device = cairo_surface_create_similar(layer->device, cairo_surface_get_content(layer->device), width, height);
+		cr = cairo_create(device);
+		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source_surface(cr, layer->device, -dx, -dy);
+		cairo_paint(cr);
+		cairo_destroy(cr);
+		
+		cairo_surface_destroy(layer->device);
+		layer->device = device;
+	}
+	
+	cairo_rectangle_int_t bounds = { 0, 0, width, height };
+	if(layer->invalid)
+	{
+		cairo_region_translate(layer->invalid, -dx, -dy);
+		cairo_region_intersect_rectangle(layer->invalid, &bounds);
+	}
+	if(layer->damage)
+	{
+		cairo_region_translate(layer->damage, -dx, -dy);
+		cairo_region_intersect_rectangle(layer->damage, &bounds);
+	}
+	damage_layer(layer, &strips[0]);
+	damage_layer(layer, &strips[1]);
+	return;
+}
+
+// everything the workers read is resolved here, on the main thread
+static void prepare_overlay(da_panel_t * panel)
+{
+	const global_params_t * params = global_params_get_default();
+	assert(params);
+	
+	get_annotations(panel);
+	panel->scale_factor = gtk_widget_get_scale_factor(panel->da);
+	for(int klass = 0; klass < params->num_labels; ++klass)
+	{
+		label_badges_get(panel->badges, params, klass, panel->scale_factor);
+	}
+	return;
+}
+
+static void render_overlay(da_panel_t * panel, int skip_index)
+{
+	get_layer_surface(panel, panel->overlay, CAIRO_FORMAT_ARGB32);
+	
+	panel->overlay_skip_index = skip_index;
+	prepare_overlay(panel);
+	render_layer(panel, panel->overlay, render_overlay_area);
+	return;
+}
+
+static void invalidate_background(da_panel_t * panel)
+{
+	panel->scaled->dirty = 1;
+	panel->background->dirty = 1;
+	return;
+}
+
+// LUT, CLAHE and the unadjusted 'scaled' layer are prepared on the main thread
+static void prepare_background(da_panel_t * panel)
+{
+	panel->display_adjusted = (NULL != panel->image) && !img_adjustments_is_identity(panel->display);
+	if(!panel->display_adjusted)
+	{
+		if(panel->scaled->image) layer_clear(panel->scaled);
+		return;
+	}
+	
+	bgra_image_t * bgra = panel->image->bgra;
+	if(panel->display_lut_dirty)
+	{
+		img_lut_build(panel->display_lut, panel->display, bgra);
+		panel->display_lut_dirty = 0;
+	}
+	if(panel->display->clahe && panel->display_clahe_dirty)
+	{
+		img_clahe_build(panel->display_clahe, bgra, 8, 8, panel->display->clahe_clip_limit);
+		panel->display_clahe_dirty = 0;
+	}
+	
+	get_layer_surface(panel, panel->scaled, CAIRO_FORMAT_RGB24);
+	if(panel->scaled->dirty)
+	{
+		render_layer(panel, panel->scaled, render_scaled_area);
+		panel->background->dirty = 1;
+	}
+	return;
+}
+
+void da_panel_set_display_adjustments(da_panel_t * panel, const img_adjustments_t * adj)
+{
+	assert(panel && adj);
+	img_adjustments_t * display = panel->display;
+	if(adj->clahe != display->clahe || adj->clahe_clip_limit != display->clahe_clip_limit) panel->display_clahe_dirty = 1;
+	
+	*display = *adj;
+	panel->display_lut_dirty = 1;
+	panel->background->dirty = 1;	// re-mapped from the cached 'scaled' layer, no re-scaling
+	gtk_widget_queue_draw(panel->da);
+	return;
+}
+
+void da_panel_set_window_level(da_panel_t * panel, int window_center, int window_width)
+{
+	assert(panel);
+	if(NULL == panel->image || NULL == panel->image->raw->data) return;
+	
+	// the image may already have been remapped through another view sharing it
+	da_image_set_window(panel->image, window_center, window_width);
+	invalidate_background(panel);
+	panel->display_lut_dirty = 1;
+	panel->display_clahe_dirty = 1;
+	gtk_widget_queue_draw(panel->da);
+	return;
+}
+
+static void draw_background(da_panel_t * panel, cairo_t * cr)
+{
+	prepare_background(panel);
+	get_layer_surface(panel, panel->background, CAIRO_FORMAT_RGB24);
+	if(panel->background->dirty) render_layer(panel, panel->background, render_background_area);
+	
+	paint_layer(panel, cr, panel->background);
+	return;
+}
+
+/*
+ * invalidate_annotation(): 
+ *   mark the viewport area covered by a box (with its border, label and LOD cell) for re-rendering.
+ */
+static int invalidate_annotation(da_panel_t * panel, const annotation_data_t * data, int_rect * area)
+{
+	const global_params_t * params = global_params_get_default();
+	assert(params);
+	
+	double x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	image_to_viewport(panel, data->x - data->width / 2, data->y - data->height / 2, &x1, &y1);
+	image_to_viewport(panel, data->x + data->width / 2, data->y + data->height / 2, &x2, &y2);
+	
+	double margin = params->line_size + ((params->lod_min_box_size > 1)?params->lod_min_box_size:1) + 1;
+	const label_badge_t * badge = label_badges_get(panel->badges, params, data->klass, panel->scale_factor);
+	if(badge)
+	{
+		if(x2 < floor(x1) + badge->width) x2 = floor(x1) + badge->width;
+		if(y2 < floor(y1) + badge->height) y2 = floor(y1) + badge->height;
+	}
+	
+	area->x = (int)floor(x1 - margin);
+	area->y = (int)floor(y1 - margin);
+	area->cx = (int)ceil(x2 + margin) - area->x;
+	area->cy = (int)ceil(y2 + margin) - area->y;
+	
+	// clip to the viewport
+	if(area->x < 0) { area->cx += area->x; area->x = 0; }
+	if(area->y < 0) { area->cy += area->y; area->y = 0; }
+	if(area->x + area->cx > panel->width) area->cx = panel->width - area->x;
+	if(area->y + area->cy > panel->height) area->cy = panel->height - area->y;
+	if(area->cx <= 0 || area->cy <= 0) return -1;
+	
+	invalidate_layer(panel->overlay, area);
+	return 0;
+}
+
+static void draw_annotations(da_panel_t * panel, cairo_t * cr)
+{
+	annotation_list_t * list = get_annotations(panel);
+	if(NULL == list) return;
+	assert(panel->height > 0);
+
+	int cur_index = panel->cur_index;
+	if(cur_index >= list->length) cur_index = -1;
+	
+	// the static boxes are only re-rendered when the annotation list (or the edited box) changes
+	da_layer_t * overlay = panel->overlay;
+	get_layer_surface(panel, overlay, CAIRO_FORMAT_ARGB32);
+	if(overlay->dirty)
+	{
+		render_overlay(panel, cur_index);
+	}else
+	{
+		// the static boxes are kept, only the ones moving in or out of the live layer are re-rendered
+		int skip_index = panel->overlay_skip_index;
+		if(cur_index != skip_index)
+		{
+			int_rect area[1];
+			if(skip_index >= 0 && skip_index < list->length) invalidate_annotation(panel, list->data[skip_index], area);
+			if(cur_index >= 0) invalidate_annotation(panel, list->data[cur_index], area);
+			panel->overlay_skip_index = cur_index;
+		}
+		if(overlay->invalid)
+		{
+			prepare_overlay(panel);
+			render_layer_invalid(panel, overlay, render_overlay_area);
+		}
+	}
+
+	paint_layer(panel, cr, panel->overlay);
+	
+	if(cur_index < 0) return;
+
+	// draw the actively edited box on top of the overlay
+	const global_params_t * params = global_params_get_default();
+	assert(params);
+	
+	annotation_data_t * data = list->data[cur_index];
+	assert(data);
+	label_badges_get(panel->badges, params, data->klass, panel->scale_factor);
+	draw_annotation(panel, cr, params, data);
+	return;
+}
+
+void da_panel_damage_annotation(da_panel_t * panel, const annotation_data_t * data)
+{
+	if(NULL == panel || NULL == data) return;
+	if(NULL == panel->overlay->image || panel->overlay->dirty) return;	// fully re-rendered on the next draw
+	
+	int_rect area[1];
+	if(0 == invalidate_annotation(panel, data, area)) 
+	{
+		gtk_widget_queue_draw_area(panel->da, area->x, area->y, area->cx, area->cy);
+	}
+	return;
+}
+
+/*
+ * da_panel_annotation_removed(): 
+ *   the box at 'index' has been removed from the shared list, 
+ *   the selection and the box kept out of the overlay follow the shifted indices.
+ */
+void da_panel_annotation_removed(da_panel_t * panel, ssize_t index)
+{
+	if(NULL == panel || index < 0) return;
+	if(panel->cur_index == index) panel->cur_index = -1;
+	else if(panel->cur_index > index) --panel->cur_index;
+	
+	if(panel->overlay_skip_index == index) panel->overlay_skip_index = -1;
+	else if(panel->overlay_skip_index > index) --panel->overlay_skip_index;
+	return;
+}
+
+void da_panel_invalidate_overlay(da_panel_t * panel)
+{
+	if(NULL == panel) return;
+	panel->overlay->dirty = 1;
+	gtk_widget_queue_draw(panel->da);
+	return;
+}
+
+/******************************************************************************
+ * magnifier loupe: 
+ *   samples the full-resolution image around the pointer, 
+ *   only the loupe area is queued for redraw when the pointer moves.
+******************************************************************************/
+static void get_loupe_rect(const da_panel_t * panel, int x, int y, int_rect * rect)
+{
+	const global_params_t * params = global_params_get_default();
+	int size = (params->loupe_size > 0)?params->loupe_size:160;
+	
+	rect->x = x - size / 2;
+	rect->y = y - size / 2;
+	rect->cx = size;
+	rect->cy = size;
+	return;
+}
+
+static void move_loupe(da_panel_t * panel, int x, int y)
+{
+	panel->pointer_x = x;
+	panel->pointer_y = y;
+	if(!panel->loupe_enabled) return;
+	
+	int_rect * old_rect = panel->loupe_rect;
+	if(old_rect->cx > 0) gtk_widget_queue_draw_area(panel->da, old_rect->x - 1, old_rect->y - 1, old_rect->cx + 2, old_rect->cy + 2);
+	
+	get_loupe_rect(panel, x, y, old_rect);
+	gtk_widget_queue_draw_area(panel->da, old_rect->x - 1, old_rect->y - 1, old_rect->cx + 2, old_rect->cy + 2);
+	return;
+}
+
+void da_panel_set_loupe(da_panel_t * panel, int enabled)
+{
+	assert(panel);
+	panel->loupe_enabled = enabled;
+	if(enabled)
+	{
+		move_loupe(panel, panel->pointer_x, panel->pointer_y);
+		return;
+	}
+	
+	int_rect * rect = panel->loupe_rect;
+	if(rect->cx > 0) gtk_widget_queue_draw_area(panel->da, rect->x - 1, rect->y - 1, rect->cx + 2, rect->cy + 2);
+	rect->cx = 0;
+	rect->cy = 0;
+	return;
+}
+
+static gboolean on_da_leave_notify(GtkWidget * da, GdkEventCrossing * event, da_panel_t * panel)
+{
+	int_rect * rect = panel->loupe_rect;
+	if(rect->cx > 0) gtk_widget_queue_draw_area(panel->da, rect->x - 1, rect->y - 1, rect->cx + 2, rect->cy + 2);
+	rect->cx = 0;
+	rect->cy = 0;
+	return FALSE;
+}
+
+static void draw_loupe(da_panel_t * panel, cairo_t * cr)
+{
+	int_rect * rect = panel->loupe_rect;
+	if(!panel->loupe_enabled || rect->cx <= 0 || NULL == panel->surface) return;
+	
+	const global_params_t * params = global_params_get_default();
+	double zoom = (params->loupe_zoom > 0)?params->loupe_zoom:8;
+	
+	// the source pixel under the pointer
+	double x = 0, y = 0;
+	viewport_to_image(panel, panel->pointer_x, panel->pointer_y, &x, &y);
+	x *= panel->image_width;
+	y *= panel->image_height;
+	double cx = rect->x + rect->cx / 2.0;
+	double cy = rect->y + rect->cy / 2.0;
+	
+	cairo_save(cr);
+	cairo_rectangle(cr, rect->x, rect->y, rect->cx, rect->cy);
+	cairo_clip(cr);
+	cairo_set_source_rgb(cr, 0.2, 0.3, 0.4);
+	cairo_paint(cr);
+	
+	// only the (cx * cy) destination pixels are sampled from the full-resolution surface
+	cairo_save(cr);
+	cairo_translate(cr, cx, cy);
+	cairo_scale(cr, zoom, zoom);
+	cairo_translate(cr, -x, -y);
+	cairo_set_source_surface(cr, panel->surface, 0, 0);
+	cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+	cairo_paint(cr);
+	
+	// the visible boxes, in source pixels
+	annotation_list_t * list = panel->annotations;
+	double half_width = rect->cx / zoom / 2;
+	double half_height = rect->cy / zoom / 2;
+	double x1 = (x - half_width) / panel->image_width;
+	double y1 = (y - half_height) / panel->image_height;
+	double x2 = (x + half_width) / panel->image_width;
+	double y2 = (y + half_height) / panel->image_height;
+	
+	GdkRGBA line_color = params->fg_color;
+	cairo_set_source_rgba(cr, line_color.red, line_color.green, line_color.blue, line_color.alpha);
+	cairo_set_line_width(cr, 1.0 / zoom);
+	for(ssize_t i = 0; list && i < list->length; ++i)
+	{
+		const annotation_data_t * data = list->data[i];
+		if(!da_panel_is_class_visible(panel, data->klass)) continue;
+		
+		double left = data->x - data->width / 2;
+		double top = data->y - data->height / 2;
+		if(left > x2 || top > y2 || left + data->width < x1 || top + data->height < y1) continue;
+		cairo_rectangle(cr, left * panel->image_width, top * panel->image_height, 
+			data->width * panel->image_width, data->height * panel->image_height);
+	}
+	cairo_stroke(cr);
+	cairo_restore(cr);
+	
+	// crosshair and frame
+	cairo_set_line_width(cr, 1);
+	cairo_set_source_rgba(cr, 1, 1, 1, 0.8);
+	cairo_move_to(cr, rect->x, floor(cy) + 0.5);
+	cairo_line_to(cr, rect->x + rect->cx, floor(cy) + 0.5);
+	cairo_move_to(cr, floor(cx) + 0.5, rect->y);
+	cairo_line_to(cr, floor(cx) + 0.5, rect->y + rect->cy);
+	cairo_stroke(cr);
+	
+	cairo_set_source_rgb(cr, 0, 0, 0);
+	cairo_rectangle(cr, rect->x + 0.5, rect->y + 0.5, rect->cx - 1, rect->cy - 1);
+	cairo_stroke(cr);
+	cairo_restore(cr);
+	return;
+}
+
+/******************************************************************************
+ * viewport: zoom and pan
+******************************************************************************/
+static void update_adjustments(da_panel_t * panel)
+{
+	if(panel->width < 1 || panel->height < 1) return;
+	
+	double width = panel->width;
+	double height = panel->height;
+	
+	panel->updating_adjustments = 1;
+	if(panel->hadj) gtk_adjustment_configure(panel->hadj, panel->scroll_x, 
+		0, content_width(panel), 
+		width / 10, width * 0.9, width);
+	if(panel->vadj) gtk_adjustment_configure(panel->vadj, panel->scroll_y, 
+		0, content_height(panel), 
+		height / 10, height * 0.9, height);
+	panel->updating_adjustments = 0;
+	return;
+}
+
+static void clamp_scroll_position(const da_panel_t * panel, double * x, double * y)
+{
+	double max_x = content_width(panel) - (double)panel->width;
+	double max_y = content_height(panel) - (double)panel->height;
+	
+	// integer positions: scrolled pixels can be reused as-is
+	*x = round(*x);
+	*y = round(*y);
+	if(*x > max_x) *x = floor(max_x);
+	if(*y > max_y) *y = floor(max_y);
+	if(*x < 0) *x = 0;
+	if(*y < 0) *y = 0;
+	return;
+}
+
+void da_panel_scroll_to(da_panel_t * panel, double x, double y)
+{
+	clamp_scroll_position(panel, &x, &y);
+	int dx = (int)(x - panel->scroll_x);
+	int dy = (int)(y - panel->scroll_y);
+	if(0 == dx && 0 == dy) return;
+	
+	panel->scroll_x = x;
+	panel->scroll_y = y;
+	update_adjustments(panel);
+	
+	if(panel->display_adjusted) scroll_layer(panel, panel->scaled, dx, dy, render_scaled_area);
+	scroll_layer(panel, panel->background, dx, dy, render_background_area);
+	if(panel->overlay->image && !panel->overlay->dirty) prepare_overlay(panel);
+	scroll_layer(panel, panel->overlay, dx, dy, render_overlay_area);
+	
+	GdkWindow * window = gtk_widget_get_window(panel->da);
+	int has_live_items = (panel->cur_index >= 0) || (panel->selection->cx > 0 && panel->selection->cy > 0)
+		|| (panel->loupe_rect->cx > 0);
+	if(window && !has_live_items && !panel->overlay->dirty && !panel->background->dirty)
+	{
+		// move the already rendered content, only the exposed strips are redrawn
+		gdk_window_scroll(window, -dx, -dy);
+	}else
+	{
+		gtk_widget_queue_draw(panel->da);
+	}
+	return;
+}
+
+/*
+ * da_panel_zoom_at(): set zoom level, keeping the image point under (sx, sy) fixed.
+ */
+void da_panel_zoom_at(da_panel_t * panel, double zoom, double sx, double sy)
+{
+	if(zoom < DA_PANEL_MIN_ZOOM) zoom = DA_PANEL_MIN_ZOOM;
+	if(zoom > DA_PANEL_MAX_ZOOM) zoom = DA_PANEL_MAX_ZOOM;
+	if(zoom == panel->zoom || panel->width < 1 || panel->height < 1) return;
+	
+	double x = 0, y = 0;
+	viewport_to_image(panel, sx, sy, &x, &y);
+	
+	panel->zoom = zoom;
+	double scroll_x = x * content_width(panel) - sx;
+	double scroll_y = y * content_height(panel) - sy;
+	clamp_scroll_position(panel, &scroll_x, &scroll_y);
+	panel->scroll_x = scroll_x;
+	panel->scroll_y = scroll_y;
+	
+	update_adjustments(panel);
+	invalidate_background(panel);
+	da_panel_invalidate_overlay(panel);
+	return;
+}
+
+static void on_adjustment_value_changed(GtkAdjustment * adj, da_panel_t * panel)
+{
+	if(panel->updating_adjustments) return;
+	
+	double x = panel->scroll_x;
+	double y = panel->scroll_y;
+	if(adj == panel->hadj) x = gtk_adjustment_get_value(adj);
+	else y = gtk_adjustment_get_value(adj);
+	
+	da_panel_scroll_to(panel, x, y);
+	return;
+}
+
+void da_panel_set_adjustments(da_panel_t * panel, GtkAdjustment * hadj, GtkAdjustment * vadj)
+{
+	assert(panel);
+	if(hadj) {
+		g_object_ref(hadj);
+		g_signal_connect(hadj, "value-changed", G_CALLBACK(on_adjustment_value_changed), panel);
+	}
+	if(vadj) {
+		g_object_ref(vadj);
+		g_signal_connect(vadj, "value-changed", G_CALLBACK(on_adjustment_value_changed), panel);
+	}
+	panel->hadj = hadj;
+	panel->vadj = vadj;
+	update_adjustments(panel);
+	return;
+}
+
+#define ZOOM_STEP (1.25)
+#define SCROLL_STEP (48.0)
+static gboolean on_da_scroll(GtkWidget * da, GdkEventScroll * event, da_panel_t * panel)
+{
+	double dx = 0, dy = 0;
+	switch(event->direction)
+	{
+	case GDK_SCROLL_UP: 	dy = -1; break;
+	case GDK_SCROLL_DOWN: 	dy = 1; break;
+	case GDK_SCROLL_LEFT: 	dx = -1; break;
+	case GDK_SCROLL_RIGHT: 	dx = 1; break;
+	default:
+		return FALSE;
+	}
+	
+	if(event->state & GDK_CONTROL_MASK)	// zoom to cursor
+	{
+		double zoom = (dy < 0)?(panel->zoom * ZOOM_STEP):(panel->zoom / ZOOM_STEP);
+		da_panel_zoom_at(panel, zoom, event->x, event->y);
+		return TRUE;
+	}
+	
+	if(event->state & GDK_SHIFT_MASK) { dx = dy; dy = 0; }
+	da_panel_scroll_to(panel, panel->scroll_x + dx * SCROLL_STEP, panel->scroll_y + dy * SCROLL_STEP);
+	return TRUE;
+}
+
+static gboolean on_da_draw(GtkWidget * da, cairo_t * cr, da_panel_t * panel)
+{
+	debug_printf("%s()...\n", __FUNCTION__);
+	cairo_surface_t * surface = panel->surface;
+	if(NULL == surface || panel->width < 1 || panel->height < 1 || panel->image_width < 1 || panel->image_height < 1)
+	{
+		cairo_set_source_rgb(cr, 0.2, 0.3, 0.4);
+		cairo_paint(cr);
+
+	}else
+	{
+		draw_background(panel, cr);
+
+		// draw current annotations
+		draw_annotations(panel, cr);
+	}
+
+	int_rect * bbox = panel->selection;
+	if(bbox->cx > 0 && bbox->cy > 0)
+	{
+		char msg[200] = "";
+		snprintf(msg, sizeof(msg), "bbox: { %d, %d, %d, %d }", bbox->x, bbox->y, bbox->cx, bbox->cy);
+
+		global_params_t * params = global_params_get_default();
+		GdkRGBA sel_color = params->sel_color;
+		GdkRGBA font_color = params->font_color;
+		GdkRGBA bg_color = params->bg_color;
+		
+		const char * font_face = params->font_name;
+		double line_size = params->line_size;
+		double font_size = params->font_size;
+		assert(font_size > 0);
+		assert(line_size > 0);
+		assert(font_face && font_face[0]);
+
+		
+		cairo_set_source_rgb(cr, sel_color.red, sel_color.green, sel_color.blue);
+		cairo_set_line_width(cr, line_size);
+		cairo_rectangle(cr, bbox->x, bbox->y, bbox->cx, bbox->cy);
+		cairo_stroke(cr);
+
+
+		double x = 10;
+		double y = 30;
+		
+		cairo_text_extents_t extents;
+		memset(&extents, 0, sizeof(extents));
+
+		cairo_select_font_face(cr, font_face, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+		cairo_set_font_size(cr, font_size);
+		
+		cairo_text_extents(cr, msg, &extents);
+		cairo_set_source_rgba(cr, bg_color.red, bg_color.green, bg_color.blue, 0.4);
+
+		fprintf(stderr, "text range: width=%.2f, height = %.2f\n", extents.width, extents.height);
+		cairo_rectangle(cr, x - 5, y - 5 - extents.height, extents.width + 10, extents.height + 10);
+		cairo_fill(cr);
+
+		cairo_move_to(cr, x, y);
+		cairo_set_source_rgb(cr, font_color.red, font_color.green, font_color.blue);
+		
+		cairo_show_text(cr, msg);
+	}
+	
+	draw_loupe(panel, cr);
+	
+	if(panel->measure_uploads)
+	{
+		fprintf(stderr, "[%s] frame %u: %lu bytes uploaded (%s)\n", __FUNCTION__, 
+			++panel->frame_count, (unsigned long)panel->frame_upload_bytes,
+			panel->server_side_surfaces?"server-side surfaces":"client-side surfaces");
+		panel->frame_upload_bytes = 0;
+	}
+	return FALSE;
+}
+static void on_da_realize(GtkWidget * da, da_panel_t * panel)
+{
+	debug_printf("%s()...\n", __FUNCTION__);
+	return;
+}
+
+static void on_da_resize(GtkWidget * da, GdkRectangle * allocation, da_panel_t * panel)
+{
+	debug_printf("%s()...\n", __FUNCTION__);
+	
+	panel->width = allocation->width;
+	panel->height = allocation->height;
+	invalidate_background(panel);
+	panel->overlay->dirty = 1;
+	
+	double scroll_x = panel->scroll_x;
+	double scroll_y = panel->scroll_y;
+	clamp_scroll_position(panel, &scroll_x, &scroll_y);
+	panel->scroll_x = scroll_x;
+	panel->scroll_y = scroll_y;
+	update_adjustments(panel);
+
+	gtk_widget_queue_draw(da);
+	return;
+}
+
+
+
+/******************************************************************************
+ * da_image: shared decoded image
+******************************************************************************/
+da_image_t * da_image_new(bgra_image_t * frame)
+{
+	assert(frame && frame->data && frame->width > 0 && frame->height > 0);
+	da_image_t * image = calloc(1, sizeof(*image));
+	assert(image);
+	
+	image->refs = 1;
+	*image->bgra = *frame;
+	memset(frame, 0, sizeof(*frame));
+	
+	bgra_image_t * bgra = image->bgra;
+	image->surface = cairo_image_surface_create_for_data(bgra->data, CAIRO_FORMAT_RGB24,
+		bgra->width, bgra->height,
+		(bgra->stride > 0)?bgra->stride:(bgra->width * 4)
+	);
+	assert(image->surface && cairo_surface_status(image->surface) == CAIRO_STATUS_SUCCESS);
+	
+	img_gradient_init(image->gradient, image->bgra, EDGE_SNAP_TILE_SIZE);
+	return image;
+}
+
+da_image_t * da_image_new_gray16(gray16_image_t * raw)
+{
+	assert(raw && raw->data && raw->width > 0 && raw->height > 0);
+	int min_value = 0, max_value = 0;
+	gray16_image_get_range(raw, &min_value, &max_value);
+	
+	int window_width = max_value - min_value + 1;
+	int window_center = min_value + window_width / 2;
+	
+	bgra_image_t bgra[1];
+	memset(bgra, 0, sizeof(bgra));
+	int rc = gray16_image_to_bgra(raw, bgra, window_center, window_width);
+	assert(0 == rc);
+	
+	da_image_t * image = da_image_new(bgra);
+	*image->raw = *raw;
+	memset(raw, 0, sizeof(*raw));
+	image->window_center = window_center;
+	image->window_width = window_width;
+	return image;
+}
+
+/*
+ * da_image_set_window(): re-map the raw samples into the display buffer (no re-decoding),
+ * the views sharing the image must be invalidated by the caller.
+ */
+int da_image_set_window(da_image_t * image, int window_center, int window_width)
+{
+	assert(image);
+	if(NULL == image->raw->data) return 0;
+	if(window_width < 1) window_width = 1;
+	if(window_center == image->window_center && window_width == image->window_width) return 0;
+	
+	cairo_surface_flush(image->surface);
+	int rc = gray16_image_to_bgra(image->raw, image->bgra, window_center, window_width);
+	assert(0 == rc);
+	cairo_surface_mark_dirty(image->surface);
+	img_gradient_reset(image->gradient);
+	
+	image->window_center = window_center;
+	image->window_width = window_width;
+	return 1;
+}
+
+da_image_t * da_image_ref(da_image_t * image)
+{
+	if(image) __sync_add_and_fetch(&image->refs, 1);
+	return image;
+}
+
+void da_image_unref(da_image_t * image)
+{
+	if(NULL == image) return;
+	if(__sync_sub_and_fetch(&image->refs, 1) > 0) return;
+	
+	cairo_surface_destroy(image->surface);
+	img_gradient_cleanup(image->gradient);
+	bgra_image_clear(image->bgra);
+	gray16_image_clear(image->raw);
+	free(image);
+	return;
+}
+
+static void da_panel_draw(struct da_panel * panel, const bgra_image_t * frame)
+{
+	da_image_t * image = panel->image;
+	if(image && image->refs == 1 && NULL == image->raw->data && frame->width == image->bgra->width && frame->height == image->bgra->height)
+	{
+		// not shared: update in place
+		bgra_image_init(image->bgra, frame->width, frame->height, frame->data);
+		cairo_surface_mark_dirty(image->surface);
+		img_gradient_reset(image->gradient);
+		invalidate_background(panel);
+		panel->display_lut_dirty = 1;	// statistics of the new frame
+		panel->display_clahe_dirty = 1;
+		gtk_widget_queue_draw(panel->da);
+		return;
+	}
+	
+	bgra_image_t copy[1];
+	memset(copy, 0, sizeof(copy));
+	bgra_image_t * bgra = bgra_image_init(copy, frame->width, frame->height, frame->data);
+	assert(bgra && bgra->data);
+	
+	image = da_image_new(copy);
+	da_panel_set_image(panel, image);
+	da_image_unref(image);
+	return;
+}
+
+static inline void clear_selections(struct da_panel * panel)
+{
+	int_rect * bbox = panel->selection;
+	bbox->cx = 0;
+	bbox->cy = 0;
+	panel->cur_index = -1;
+	return;
+}
+
+/*
+ * da_panel_set_image(): show a (shared) decoded image, the panel keeps a reference.
+ */
+void da_panel_set_image(da_panel_t * panel, da_image_t * image)
+{
+	assert(panel);
+	if(image == panel->image) return;
+	
+	clear_selections(panel);
+	da_image_ref(image);
+	da_image_unref(panel->image);
+	
+	panel->image = image;
+	panel->surface = image?image->surface:NULL;
+	panel->image_width = image?image->bgra->width:0;
+	panel->image_height = image?image->bgra->height:0;
+	invalidate_background(panel);
+	panel->display_lut_dirty = 1;
+	panel->display_clahe_dirty = 1;
+	gtk_widget_queue_draw(panel->da);
+	return;
+}
+
+/*
+ * da_image_load(): decode a file (16-bit grayscale png or any format of bgra_image_load_from_file),
+ *   makes no GTK calls: may run on a worker thread.
+ */
+da_image_t * da_image_load(const char * path_name)
+{
+	gray16_image_t raw[1];
+	memset(raw, 0, sizeof(raw));
+	if(0 == gray16_image_load_png(raw, path_name)) return da_image_new_gray16(raw);
+	gray16_image_clear(raw);
+	
+	bgra_image_t bgra[1];
+	memset(bgra, 0, sizeof(bgra));
+	int rc = bgra_image_load_from_file(bgra, path_name);
+	if(rc || NULL == bgra->data)
+	{
+		bgra_image_clear(bgra);
+		return NULL;
+	}
+	
+	// decoded once, the buffer is handed over to the shared image
+	return da_image_new(bgra);
+}
+
+static int da_panel_load_image(struct da_panel * panel, const char * path_name)
+{
+	clear_selections(panel);
+	
+	da_image_t * image = da_image_load(path_name);
+	if(NULL == image) return -1;
+	
+	da_panel_set_image(panel, image);
+	da_image_unref(image);
+
+	shell_redraw(panel->shell);
 	return 0;
 }
 
@@ -800,6 +1983,8 @@ da_panel_t * da_panel_new(int min_width, int min_height, struct shell_context *
 		GDK_POINTER_MOTION_HINT_MASK |
 		GDK_KEY_PRESS_MASK |
 		GDK_KEY_RELEASE_MASK |
+		GDK_SCROLL_MASK |
+		GDK_LEAVE_NOTIFY_MASK |
 		0;
 	gtk_widget_set_events(da, events);
 	g_signal_connect(da, "button-press-event", G_CALLBACK(on_da_button_pressed), panel);
@@ -810,6 +1995,9 @@ da_panel_t * da_panel_new(int min_width, int min_height, struct shell_context *
 	g_signal_connect(da, "size-allocate", G_CALLBACK(on_da_resize), panel);
 	g_signal_connect(da, "draw", G_CALLBACK(on_da_draw), panel);
 	g_signal_connect(da, "realize", G_CALLBACK(on_da_realize), panel);
+	g_signal_connect(da, "scroll-event", G_CALLBACK(on_da_scroll), panel);
+	g_signal_connect(da, "leave-notify-event", G_CALLBACK(on_da_leave_notify), panel);
+	gtk_widget_set_can_focus(da, TRUE);
 
 	gtk_frame_set_shadow_type(GTK_FRAME(frame), GTK_SHADOW_ETCHED_IN);
 
@@ -817,6 +2005,22 @@ da_panel_t * da_panel_new(int min_width, int min_height, struct shell_context *
 	panel->da = da;
 	panel->shell = shell;
 	panel->auto_scale = 1;
+	panel->zoom = 1.0;
+	panel->cur_index = -1;
+	panel->overlay_skip_index = -1;
+	panel->overlay->dirty = 1;
+	panel->badges = label_badges_init(NULL);
+	panel->scale_factor = 1;
+	invalidate_background(panel);
+	img_adjustments_init(panel->display);
+	panel->display_lut_dirty = 1;
+	panel->display_clahe_dirty = 1;
+	
+	const global_params_t * params = global_params_get_default();
+	assert(params);
+	panel->renderer = tile_renderer_new(params->render_threads, params->render_tile_size);
+	panel->server_side_surfaces = params->server_side_surfaces;
+	panel->measure_uploads = params->measure_uploads;
 
 	GdkDisplay * display = gtk_widget_get_display(da);
 	panel->cursors[border_type_unknown] 	= gdk_cursor_new_from_name(display, "default");
@@ -837,12 +2041,35 @@ void da_panel_free(da_panel_t * panel)
 {
 	if(NULL == panel) return;
 
-	if(panel->surface)
+	da_image_unref(panel->image);
+	panel->image = NULL;
+	panel->surface = NULL;
+	layer_clear(panel->background);
+	layer_clear(panel->overlay);
+	layer_clear(panel->scaled);
+	img_clahe_cleanup(panel->display_clahe);
+	if(panel->renderer)
 	{
-		cairo_surface_destroy(panel->surface);
-		panel->surface = NULL;
+		tile_renderer_free(panel->renderer);
+		panel->renderer = NULL;
+	}
+	if(panel->hadj) { g_signal_handlers_disconnect_by_data(panel->hadj, panel); g_object_unref(panel->hadj); }
+	if(panel->vadj) { g_signal_handlers_disconnect_by_data(panel->vadj, panel); g_object_unref(panel->vadj); }
+	panel->hadj = NULL;
+	panel->vadj = NULL;
+	
+	if(panel->hidden_classes)
+	{
+		free(panel->hidden_classes);
+		panel->hidden_classes = NULL;
+		panel->hidden_classes_size = 0;
+	}
+	if(panel->badges)
+	{
+		label_badges_cleanup(panel->badges);
+		free(panel->badges);
+		panel->badges = NULL;
 	}
-	bgra_image_clear(panel->image);
 	free(panel);
 }
 
@@ -864,8 +2091,9 @@ void da_panel_set_annotation(da_panel_t * panel, int klass)
 
 	annotation_data_t * data = list->data[cur_index];
 	assert(data);
+	annotation_data_t before[1] = { *data };	// the old badge may be wider than the new one
 	data->klass = klass;
 
 	gtk_widget_queue_draw(panel->da);
-	shell_redraw(panel->shell);
+	shell_notify_annotation_changed(panel->shell, before, data);
 }
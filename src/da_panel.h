@@ -2,6 +2,7 @@
 #define _DA_PANEL_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -46,6 +47,42 @@ typedef struct int_rect
 	int x, y, cx, cy;
 }int_rect;
 
+/*
+ * da_image: a decoded image shared (reference-counted) by all the views showing it.
+ * 16-bit sources keep their raw samples, 'bgra' is then the window/level mapped display buffer.
+ */
+typedef struct da_image
+{
+	long refs;
+	bgra_image_t bgra[1];
+	cairo_surface_t * surface;	// wraps bgra->data
+	
+	gray16_image_t raw[1];		// raw->data == NULL: 8-bit source
+	int window_center;
+	int window_width;
+	
+	img_gradient_t gradient[1];	// edge maps of 'bgra' for border snapping, tiles computed on demand
+}da_image_t;
+da_image_t * da_image_new(bgra_image_t * frame);	// takes over frame->data
+da_image_t * da_image_new_gray16(gray16_image_t * raw);	// takes over raw->data, window: full range
+da_image_t * da_image_load(const char * path_name);		// NULL: not a supported image, thread-safe
+int da_image_set_window(da_image_t * image, int window_center, int window_width);	// 1: remapped
+da_image_t * da_image_ref(da_image_t * image);
+void da_image_unref(da_image_t * image);
+
+/*
+ * da_layer: a viewport-sized layer, rendered client-side and uploaded once 
+ * into a surface similar to the window (server-side on X11), repaints reuse the upload.
+ */
+typedef struct da_layer
+{
+	cairo_surface_t * image;	// client-side, rendered by the tile renderer
+	cairo_surface_t * device;	// similar to the window
+	cairo_region_t * invalid;	// parts of 'image' to be re-rendered
+	cairo_region_t * damage;	// parts of 'image' not uploaded yet
+	int dirty;					// 'image' has to be re-rendered
+}da_layer_t;
+
 typedef struct da_panel
 {
 	GtkWidget * frame;
@@ -55,15 +92,51 @@ typedef struct da_panel
 	int width;		// viewport width
 	int height;		// viewport height
 
-	cairo_surface_t * surface;
+	da_image_t * image;			// shared with the other views
+	cairo_surface_t * surface;	// image->surface
+	da_layer_t background[1];	// scaled image
+	da_layer_t overlay[1];		// retained annotation layer
+	da_layer_t scaled[1];		// scaled image before the display adjustments (only used when adjusted)
+	
+	// display adjustments: applied to the visible pixels only, cached in the background layer
+	img_adjustments_t display[1];
+	img_lut_t display_lut[1];
+	img_clahe_t display_clahe[1];
+	int display_adjusted;
+	int display_lut_dirty;
+	int display_clahe_dirty;
+	int overlay_skip_index;		// the box drawn live on top of the overlay
+	struct label_badges * badges;	// pre-rendered class labels
+	uint32_t * hidden_classes;		// bitmask, 1: hidden
+	int hidden_classes_size;		// number of uint32_t words
+	struct tile_renderer * renderer;	// renders the layers on a worker pool
+	int scale_factor;				// widget scale factor, cached for the worker threads
+	int server_side_surfaces;		// 0: paint the client-side layers directly
+	int measure_uploads;			// report the bytes sent to the display per frame
+	size_t frame_upload_bytes;
+	unsigned int frame_count;
+	
 	int image_width;
 	int image_height;
 
 	int auto_scale;
 	int keep_ratio;
+	
+	// viewport transform
+	double zoom;		// 1.0: fit to window
+	double scroll_x;	// viewport origin (content pixels)
+	double scroll_y;
+	GtkAdjustment * hadj;
+	GtkAdjustment * vadj;
+	int updating_adjustments;
+	
+	// magnifier loupe
+	int loupe_enabled;
+	int_rect loupe_rect[1];		// last drawn area (viewport), cx == 0: not shown
+	int pointer_x;
+	int pointer_y;
 
 
-	bgra_image_t image[1];
 	void (* draw)(struct da_panel * panel, const bgra_image_t * frame);
 	int (* load_image)(struct da_panel * panel, const char * path_name);
 
@@ -86,6 +159,19 @@ da_panel_t * da_panel_new(int min_width, int min_height, struct shell_context *s
 void da_panel_free(da_panel_t * panel);
 
 void da_panel_set_annotation(da_panel_t * panel, int klass);
+void da_panel_invalidate_overlay(da_panel_t * panel);	// call when the annotation list has been changed
+void da_panel_damage_annotation(da_panel_t * panel, const annotation_data_t * data);	// only the area covered by 'data' has been changed
+void da_panel_annotation_removed(da_panel_t * panel, ssize_t index);	// shifts the selection, call before damaging the removed box
+void da_panel_set_image(da_panel_t * panel, da_image_t * image);
+int da_panel_is_class_visible(const da_panel_t * panel, int klass);
+void da_panel_set_class_visible(da_panel_t * panel, int klass, int visible);
+
+void da_panel_set_adjustments(da_panel_t * panel, GtkAdjustment * hadj, GtkAdjustment * vadj);
+void da_panel_scroll_to(da_panel_t * panel, double x, double y);	// content pixels
+void da_panel_zoom_at(da_panel_t * panel, double zoom, double sx, double sy);	// (sx, sy): fixed point in viewport
+void da_panel_set_loupe(da_panel_t * panel, int enabled);
+void da_panel_set_display_adjustments(da_panel_t * panel, const img_adjustments_t * adj);
+void da_panel_set_window_level(da_panel_t * panel, int window_center, int window_width);	// 16-bit images only
 
 #ifndef _xor_sort
 #define _xor_sort(a, b)	do { if(a > b) { a^=b; b^=a; a^=b; } } while(0)
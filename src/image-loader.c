@@ -0,0 +1,194 @@
+/*
+ * image-loader.c
+ *
+ * Copyright 2020 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <glib.h>
+#include "image-loader.h"
+
+static inline int is_current(const image_loader_t * loader, unsigned long token)
+{
+	return token == __atomic_load_n(&loader->token, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * main thread:
+ *   takes all the queued results at once, they are delivered in completion order.
+ */
+static gboolean deliver_results(image_loader_t * loader)
+{
+	image_load_result_t * list = __atomic_exchange_n(&loader->results, NULL, __ATOMIC_ACQ_REL);
+
+	image_load_result_t * ordered = NULL;
+	while(list)
+	{
+		image_load_result_t * next = list->next;
+		list->next = ordered;
+		ordered = list;
+		list = next;
+	}
+
+	while(ordered)
+	{
+		image_load_result_t * result = ordered;
+		ordered = result->next;
+
+		if(is_current(loader, result->token) && loader->on_loaded)
+		{
+			loader->on_loaded(loader, result, loader->user_data);
+		}else if(result->image)
+		{
+			loader->free_image(result->image);	// cancelled while decoding
+		}
+		free(result->path_name);
+		free(result);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+// worker thread
+static void push_result(image_loader_t * loader, image_load_result_t * result)
+{
+	image_load_result_t * head = __atomic_load_n(&loader->results, __ATOMIC_RELAXED);
+	do {
+		result->next = head;
+	}while(!__atomic_compare_exchange_n(&loader->results, &head, result, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	// one idle callback per transition from empty to non-empty
+	if(NULL == head) g_idle_add((GSourceFunc)deliver_results, loader);
+	return;
+}
+
+static void * worker_thread(void * user_data)
+{
+	image_loader_t * loader = user_data;
+
+	pthread_mutex_lock(&loader->mutex);
+	while(!loader->quit)
+	{
+		if(NULL == loader->pending)
+		{
+			pthread_cond_wait(&loader->cond, &loader->mutex);
+			continue;
+		}
+
+		char * path_name = loader->pending;
+		unsigned long token = loader->pending_token;
+		loader->pending = NULL;
+		pthread_mutex_unlock(&loader->mutex);
+
+		void * image = NULL;
+		if(is_current(loader, token)) image = loader->decode(path_name);
+
+		if(!is_current(loader, token))
+		{
+			// a newer request arrived while decoding: drop the stale image
+			if(image) loader->free_image(image);
+			free(path_name);
+		}else
+		{
+			image_load_result_t * result = calloc(1, sizeof(*result));
+			assert(result);
+			result->token = token;
+			result->path_name = path_name;
+			result->image = image;
+			push_result(loader, result);
+		}
+
+		pthread_mutex_lock(&loader->mutex);
+	}
+	pthread_mutex_unlock(&loader->mutex);
+	return NULL;
+}
+
+static unsigned long image_loader_load(image_loader_t * loader, const char * path_name)
+{
+	assert(loader && path_name);
+	char * pending = strdup(path_name);
+	assert(pending);
+
+	pthread_mutex_lock(&loader->mutex);
+	unsigned long token = __atomic_add_fetch(&loader->token, 1, __ATOMIC_ACQ_REL);
+	free(loader->pending);	// not started yet
+	loader->pending = pending;
+	loader->pending_token = token;
+	pthread_cond_signal(&loader->cond);
+	pthread_mutex_unlock(&loader->mutex);
+	return token;
+}
+
+static void image_loader_cancel(image_loader_t * loader)
+{
+	pthread_mutex_lock(&loader->mutex);
+	__atomic_add_fetch(&loader->token, 1, __ATOMIC_ACQ_REL);
+	free(loader->pending);
+	loader->pending = NULL;
+	pthread_mutex_unlock(&loader->mutex);
+	return;
+}
+
+image_loader_t * image_loader_new(image_decode_func decode, image_free_func free_image, image_loaded_func on_loaded, void * user_data)
+{
+	assert(decode && free_image);
+	image_loader_t * loader = calloc(1, sizeof(*loader));
+	assert(loader);
+
+	loader->decode = decode;
+	loader->free_image = free_image;
+	loader->on_loaded = on_loaded;
+	loader->user_data = user_data;
+	loader->load = image_loader_load;
+	loader->cancel = image_loader_cancel;
+
+	pthread_mutex_init(&loader->mutex, NULL);
+	pthread_cond_init(&loader->cond, NULL);
+
+	int rc = pthread_create(&loader->th, NULL, worker_thread, loader);
+	assert(0 == rc);
+	return loader;
+}
+
+void image_loader_free(image_loader_t * loader)
+{
+	if(NULL == loader) return;
+
+	image_loader_cancel(loader);
+	pthread_mutex_lock(&loader->mutex);
+	loader->quit = 1;
+	pthread_cond_broadcast(&loader->cond);
+	pthread_mutex_unlock(&loader->mutex);
+	pthread_join(loader->th, NULL);
+
+	while(g_idle_remove_by_data(loader));
+	loader->on_loaded = NULL;
+	deliver_results(loader);	// frees the undelivered images
+
+	pthread_mutex_destroy(&loader->mutex);
+	pthread_cond_destroy(&loader->cond);
+	free(loader);
+	return;
+}
@@ -0,0 +1,59 @@
+#ifndef ANNOTATION_TOOLS_IMAGE_LOADER_H_
+#define ANNOTATION_TOOLS_IMAGE_LOADER_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * image_loader: decodes images on a worker thread.
+ *   Only the latest request matters: each load() gets a new token, requests
+ *   that are not current any more are skipped or their results discarded.
+ *   Results are delivered on the GTK main thread from an idle callback.
+ */
+typedef void * (* image_decode_func)(const char * path_name);	// worker thread, NULL: failed
+typedef void (* image_free_func)(void * image);
+
+typedef struct image_load_result
+{
+	struct image_load_result * next;
+	unsigned long token;
+	char * path_name;
+	void * image;	// NULL: decoding failed
+}image_load_result_t;
+
+struct image_loader;
+typedef void (* image_loaded_func)(struct image_loader * loader, const image_load_result_t * result, void * user_data);
+
+typedef struct image_loader
+{
+	pthread_t th;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int quit;
+
+	char * pending;					// the next file to decode (replaces older requests)
+	unsigned long pending_token;
+	unsigned long token;			// the current request: the cancellation token of all the older ones
+
+	image_load_result_t * results;	// lock-free LIFO: worker --> main thread
+
+	image_decode_func decode;
+	image_free_func free_image;
+	image_loaded_func on_loaded;	// main thread, takes over result->image
+	void * user_data;
+
+	unsigned long (* load)(struct image_loader * loader, const char * path_name);	// returns the token of the request
+	void (* cancel)(struct image_loader * loader);
+}image_loader_t;
+
+image_loader_t * image_loader_new(image_decode_func decode, image_free_func free_image, image_loaded_func on_loaded, void * user_data);
+void image_loader_free(image_loader_t * loader);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,164 @@
+/*
+ * label-badges.c
+ * 
+ * Copyright 2020 chehw <htc.chehw@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "common.h"
+#include "label-badges.h"
+
+#define LABEL_BADGE_PADDING	(2)
+
+label_badges_t * label_badges_init(label_badges_t * cache)
+{
+	if(NULL == cache) cache = calloc(1, sizeof(*cache));
+	assert(cache);
+	memset(cache, 0, sizeof(*cache));
+	return cache;
+}
+
+void label_badges_invalidate(label_badges_t * cache)
+{
+	if(NULL == cache) return;
+	if(cache->badges)
+	{
+		for(int i = 0; i < cache->num_labels; ++i)
+		{
+			if(cache->badges[i].surface) cairo_surface_destroy(cache->badges[i].surface);
+		}
+		free(cache->badges);
+		cache->badges = NULL;
+	}
+	if(cache->font_name)
+	{
+		free(cache->font_name);
+		cache->font_name = NULL;
+	}
+	cache->labels = NULL;
+	cache->num_labels = 0;
+	cache->font_size = 0;
+	cache->scale = 0;
+	return;
+}
+
+void label_badges_cleanup(label_badges_t * cache)
+{
+	label_badges_invalidate(cache);
+}
+
+static int check_cache_key(label_badges_t * cache, const global_params_t * params, int scale)
+{
+	if(NULL == cache->badges) return 0;
+	if(cache->labels != params->labels || cache->num_labels != params->num_labels) return 0;
+	if(cache->scale != scale || cache->font_size != params->font_size) return 0;
+	if(NULL == cache->font_name || NULL == params->font_name || strcmp(cache->font_name, params->font_name) != 0) return 0;
+	if(!gdk_rgba_equal(&cache->font_color, &params->font_color)) return 0;
+	return 1;
+}
+
+static int render_badge(label_badge_t * badge, const global_params_t * params, const char * label, int scale)
+{
+	// measure text with a scratch context
+	cairo_surface_t * scratch = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+	cairo_t * cr = cairo_create(scratch);
+	cairo_select_font_face(cr, params->font_name, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cr, params->font_size);
+
+	cairo_text_extents_t extents;
+	memset(&extents, 0, sizeof(extents));
+	cairo_text_extents(cr, label, &extents);
+	cairo_destroy(cr);
+	cairo_surface_destroy(scratch);
+
+	int width = (int)ceil(extents.width) + LABEL_BADGE_PADDING * 2;
+	int height = (int)ceil(extents.height) + LABEL_BADGE_PADDING * 2;
+
+	cairo_surface_t * surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width * scale, height * scale);
+	if(NULL == surface || cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+	{
+		if(surface) cairo_surface_destroy(surface);
+		return -1;
+	}
+	cairo_surface_set_device_scale(surface, scale, scale);
+
+	cr = cairo_create(surface);
+	cairo_set_source_rgba(cr, 0, 0, 0, 0.4);
+	cairo_paint(cr);
+
+	GdkRGBA font_color = params->font_color;
+	cairo_select_font_face(cr, params->font_name, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cr, params->font_size);
+	cairo_set_source_rgb(cr, font_color.red, font_color.green, font_color.blue);
+	cairo_move_to(cr, LABEL_BADGE_PADDING - extents.x_bearing, LABEL_BADGE_PADDING - extents.y_bearing);
+	cairo_show_text(cr, label);
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+
+	badge->surface = surface;
+	badge->width = width;
+	badge->height = height;
+	return 0;
+}
+
+const label_badge_t * label_badges_get(label_badges_t * cache, const global_params_t * params, int klass, int scale)
+{
+	assert(cache && params);
+	if(klass < 0 || klass >= params->num_labels || NULL == params->labels) return NULL;
+	if(scale < 1) scale = 1;
+
+	if(!check_cache_key(cache, params, scale))
+	{
+		label_badges_invalidate(cache);
+		
+		cache->badges = calloc(params->num_labels, sizeof(*cache->badges));
+		assert(cache->badges);
+		cache->labels = params->labels;
+		cache->num_labels = params->num_labels;
+		cache->font_name = params->font_name?strdup(params->font_name):NULL;
+		cache->font_size = params->font_size;
+		cache->font_color = params->font_color;
+		cache->scale = scale;
+	}
+
+	label_badge_t * badge = &cache->badges[klass];
+	if(NULL == badge->surface)
+	{
+		// gettext() is only called once per class
+		int rc = render_badge(badge, params, _(params->labels[klass]), scale);
+		if(rc) return NULL;
+	}
+	return badge;
+}
+
+const label_badge_t * label_badges_peek(const label_badges_t * cache, int klass)
+{
+	assert(cache);
+	if(NULL == cache->badges || klass < 0 || klass >= cache->num_labels) return NULL;
+	
+	const label_badge_t * badge = &cache->badges[klass];
+	return badge->surface?badge:NULL;
+}
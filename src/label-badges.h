@@ -0,0 +1,49 @@
+#ifndef ANNOTATION_TOOLS_LABEL_BADGES_H_
+#define ANNOTATION_TOOLS_LABEL_BADGES_H_
+
+#include <stdio.h>
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * label badge: pre-rasterized (translated) class name and its background rectangle
+ */
+typedef struct label_badge
+{
+	cairo_surface_t * surface;
+	int width;		// logical size (device pixels / scale)
+	int height;
+}label_badge_t;
+
+/*
+ * label_badges_t: 
+ *   badges cache indexed by class, valid for one (labels, font_name, font_size, font_color, scale) key.
+ *   The cache is dropped automatically when any of the key fields changes.
+ */
+typedef struct label_badges
+{
+	const char ** labels;
+	int num_labels;
+	char * font_name;
+	double font_size;
+	GdkRGBA font_color;
+	int scale;		// window scale factor
+
+	label_badge_t * badges;	// [num_labels]
+}label_badges_t;
+
+label_badges_t * label_badges_init(label_badges_t * cache);
+void label_badges_cleanup(label_badges_t * cache);
+void label_badges_invalidate(label_badges_t * cache);
+const label_badge_t * label_badges_get(label_badges_t * cache, const global_params_t * params, int klass, int scale);	// main thread: renders missing badges
+
+// render threads: read-only lookup of a badge rendered by label_badges_get(), NULL if there is none
+const label_badge_t * label_badges_peek(const label_badges_t * cache, int klass);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
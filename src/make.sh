@@ -4,6 +4,8 @@ CC="gcc -std=gnu99 -g -Wall -D_DEBUG -D_STAND_ALONE "
 LINKER=${CC}
 
 CFLAGS=" -I../src -I../include "
+
+# standalone tests of single files, the library itself is built by the top-level Makefile (make core)
 LIBS=" -lm -lpthread -ljson-c "
 
 
@@ -22,6 +24,25 @@ function build()
 			local rc=$?
 			echo -e " --> ret=${rc}" "\e[39m"
 			;;
+		ai-detections)
+			echo -e "\e[32m" "build: ${CC} ${CFLAGS} -D_TEST_AI_DETECTIONS -o ${target} ${target}.c ${LIBS} ..."
+			${CC} ${CFLAGS} -D_TEST_AI_DETECTIONS -o ${target} ${target}.c ${LIBS}
+			local rc=$?
+			echo -e " --> ret=${rc}" "\e[39m"
+			;;
+		ai-postprocess)
+			echo -e "\e[32m" "build: ${CC} ${CFLAGS} -D_TEST_AI_POSTPROCESS -o ${target} ${target}.c ai-detections.c ${LIBS} ..."
+			${CC} ${CFLAGS} -D_TEST_AI_POSTPROCESS -o ${target} ${target}.c ai-detections.c ${LIBS}
+			local rc=$?
+			echo -e " --> ret=${rc}" "\e[39m"
+			;;
+		img_gray16)
+			local deps="../utils/img_proc.c -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)"
+			echo -e "\e[32m" "build: ${CC} ${CFLAGS} -D_TEST_IMG_GRAY16 -o ${target} ../utils/${target}.c ${deps} ${LIBS} ..."
+			${CC} ${CFLAGS} -D_TEST_IMG_GRAY16 -o ${target} ../utils/${target}.c ${deps} ${LIBS}
+			local rc=$?
+			echo -e " --> ret=${rc}" "\e[39m"
+			;;
 		*)
 			return 1
 			;;
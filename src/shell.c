@@ -35,6 +35,7 @@
 #include "utils.h"
 
 #include "ai-client.h"
+#include "image-loader.h"
 
 #include "shell.h"
 #include "shell_private.h"
@@ -43,56 +44,66 @@
 
 const char * get_app_path(void);
 int show_error_message(struct shell_context *priv, const char *fmt, ...);
+void statusbar_set_info(GtkWidget *statusbar, const char *fmt, ...);
+static void redraw_annotations(shell_private_t * priv);
+static void flush_auto_save(struct shell_context *shell);
 
-int auto_parse_image(struct ai_client *ai, const char *image_file, const char *annotation_file)
+static void on_prediction_done(struct ai_client *ai, int rc, const ai_detections_t *detections, void *user_data)
 {
-	if(NULL == ai) return -1;
+	struct shell_context *shell = user_data;
+	assert(shell && shell->priv);
+	struct shell_private *priv = shell->priv;
+	priv->ai_request = NULL;
+	
+	if(rc || NULL == detections) {
+		statusbar_set_info(priv->statusbar, _("prediction failed: %s"), priv->image_file);
+		return;
+	}
+	
+	// parsed straight into the list, boxes drawn while waiting are kept
+	annotation_list_t * list = priv->properties->annotations;
+	ssize_t count = annotation_list_add_ai_detections(list, detections);
+	if(count < 0) {
+		statusbar_set_info(priv->statusbar, _("invalid prediction result: %s"), priv->image_file);
+		return;
+	}
+	shell_redraw(shell);	// saves the merged list
+	statusbar_set_info(priv->statusbar, _("%s: %d detections"), priv->image_file, (int)count);
+	return;
+}
+
+static void cancel_prediction(struct shell_private *priv)
+{
+	if(NULL == priv->ai_request) return;
+	global_params_t *params = priv->shell->user_data;
+	assert(params && params->ai);
+	ai_client_cancel(params->ai, priv->ai_request);
+	priv->ai_request = NULL;
+	return;
+}
+
+/*
+ * start_prediction(): the detections are merged into the annotation list when the ai-server replies.
+ */
+static int start_prediction(struct shell_context *shell)
+{
+	struct shell_private *priv = shell->priv;
+	global_params_t *params = shell->user_data;
+	assert(params);
+	if(NULL == params->ai) return -1;
+	
+	cancel_prediction(priv);
 	
-	int rc = 0;
 	unsigned char *image_data = NULL;
-	ssize_t cb_image = load_binary_data(image_file, &image_data);
+	ssize_t cb_image = load_binary_data(priv->image_file, &image_data);
 	if(cb_image <= 0 || NULL == image_data) return -1;
 	
-	json_object *jresult = NULL;
-	json_object *jdetections = NULL;
-	
-	rc = ai->predict(ai, image_data, cb_image, &jresult);
-	if(rc || NULL == jresult) {
-		if(jresult) json_object_put(jresult);
-		return -1;
-	}
-	json_bool ok = json_object_object_get_ex(jresult, "detections", &jdetections);
+	priv->ai_request = ai_client_predict_detections_async(params->ai, image_data, cb_image, on_prediction_done, shell);
+	free(image_data);	// copied into the request
+	if(NULL == priv->ai_request) return -1;
 	
-	rc = -1;
-	FILE *fp = NULL;
-	int num_detections = 0;
-	if(ok && jdetections)
-	{
-		num_detections = json_object_array_length(jdetections);
-		fp = fopen(annotation_file, "w+");
-	}
-	if(fp) {
-		for(int i = 0; i < num_detections; ++i) {
-			json_object *jdet = json_object_array_get_idx(jdetections, i);
-			if(NULL == jdet) continue;
-			
-			int class_index = json_get_value(jdet, int, class_index);
-			double left = json_get_value(jdet, double, left);
-			double top = json_get_value(jdet, double, top);
-			double width = json_get_value(jdet, double, width);
-			double height = json_get_value(jdet, double, height);
-			
-			double center_x = left + width / 2.0;
-			double center_y = top + height / 2.0;
-			 
-			fprintf(fp, "%d %g %g %g %g\n", class_index, 
-				center_x, center_y, width, height);
-		}
-		fclose(fp);
-		rc = 0;
-	}
-	json_object_put(jresult);
-	return rc;
+	statusbar_set_info(priv->statusbar, _("predicting %s ..."), priv->image_file);
+	return 0;
 }
 
 static GtkFileFilter *create_image_files_filter()
@@ -105,14 +116,102 @@ static GtkFileFilter *create_image_files_filter()
 }
 
 
+/*
+ * update_window_level_scales(): follow the window of the loaded image, only 16-bit images have one.
+ */
+static void update_window_level_scales(struct shell_private *priv)
+{
+	if(NULL == priv->window_center_scale) return;
+	da_image_t * image = priv->panels[0]->image;
+	int has_raw = (image && image->raw->data);
+	
+	gtk_widget_set_sensitive(priv->window_center_scale, has_raw);
+	gtk_widget_set_sensitive(priv->window_width_scale, has_raw);
+	if(!has_raw) return;
+	
+	priv->updating_window_level = 1;
+	gtk_range_set_value(GTK_RANGE(priv->window_center_scale), image->window_center);
+	gtk_range_set_value(GTK_RANGE(priv->window_width_scale), image->window_width);
+	priv->updating_window_level = 0;
+	return;
+}
+
+/*
+ * set_image_to_views(): the image is decoded once, all the views share it.
+ */
+static void set_image_to_views(struct shell_private *priv, da_image_t * image)
+{
+	for(int i = 0; i < priv->num_panels; ++i)
+	{
+		da_panel_set_image(priv->panels[i], image);
+	}
+	update_window_level_scales(priv);
+	return;
+}
+
+static void set_loading(struct shell_private *priv, int loading)
+{
+	if(NULL == priv->load_spinner) return;
+	if(loading)
+	{
+		gtk_widget_show(priv->load_spinner);
+		gtk_spinner_start(GTK_SPINNER(priv->load_spinner));
+	}else
+	{
+		gtk_spinner_stop(GTK_SPINNER(priv->load_spinner));
+		gtk_widget_hide(priv->load_spinner);
+	}
+	return;
+}
+
+static GtkWidget * add_load_spinner(GtkWidget * statusbar)
+{
+	GtkWidget * spinner = gtk_spinner_new();
+	gtk_widget_set_no_show_all(spinner, TRUE);	// visible only while loading
+	gtk_box_pack_end(GTK_BOX(statusbar), spinner, FALSE, FALSE, 4);
+	return spinner;
+}
+
+/*
+ * shell_load_image(): 
+ *   the image is decoded on the loader thread, on_image_loaded() finishes the job on the main thread.
+ *   A newer request cancels the pending one.
+ */
 static int shell_load_image(const char *path_name, struct shell_context *shell)
 {
-	int rc = -1;
 	assert(shell && shell->priv);
 	struct shell_private *priv = shell->priv;
+	assert(priv->loader);
+	
+	cancel_prediction(priv);	// the detections would belong to the previous image
+	priv->loader->load(priv->loader, path_name);
+	set_loading(priv, 1);
+	statusbar_set_info(priv->statusbar, _("loading %s ..."), path_name);
+	return 0;
+}
+
+static void on_image_loaded(image_loader_t * loader, const image_load_result_t * result, void * user_data)
+{
+	struct shell_context *shell = user_data;
+	assert(shell && shell->priv);
+	struct shell_private *priv = shell->priv;
+	const char * path_name = result->path_name;
+	
+	set_loading(priv, 0);
+	if(NULL == result->image)
+	{
+		statusbar_set_info(priv->statusbar, _("failed to load %s"), path_name);
+		return;
+	}
+	flush_auto_save(shell);	// pending edits belong to the previous image
 	
 	strncpy(priv->image_file, path_name, sizeof(priv->image_file));
 	
+	const char * p_filename = strrchr(path_name, '/');
+	if(NULL == p_filename) p_filename = path_name;
+	else ++p_filename;
+	if(priv->filename_label) gtk_label_set_text(GTK_LABEL(priv->filename_label), p_filename);
+	
 	char annotation_file[PATH_MAX] = "";
 	strncpy(annotation_file, path_name, sizeof(annotation_file));
 
@@ -122,31 +221,27 @@ static int shell_load_image(const char *path_name, struct shell_context *shell)
 	
 	strncpy(priv->label_file, annotation_file, sizeof(priv->label_file));
 	
-	rc = check_file(annotation_file);
-	if(rc || priv->ai_enabled) {
-		global_params_t *params = shell->user_data;
-		assert(params);
-		rc = auto_parse_image(params->ai, priv->image_file, annotation_file);
-	}
-	
-	da_panel_t * panel = priv->panels[0];
-	assert(panel->load_image);
-	if(panel->load_image)
-	{
-		annotation_list_t * list = priv->properties->annotations;
-		assert(list);
-		annotation_list_reset(list);
-		
-		if(0 == rc) {
-			debug_printf("annotation_file: '%s'", priv->label_file);
-			ssize_t count = list->load(list, priv->label_file);
-			assert(count >= 0);
-			annotation_list_dump(list);
-		}
-		panel->load_image(panel, path_name);
+	annotation_list_t * list = priv->properties->annotations;
+	assert(list);
+	annotation_list_reset(list);
+	
+	// shown at once, the detections are merged in when they arrive
+	da_image_t * image = result->image;
+	set_image_to_views(priv, image);
+	da_image_unref(image);	// the views keep their references
+	
+	int rc = check_file(annotation_file);
+	if(0 == rc && !priv->ai_enabled) {
+		debug_printf("annotation_file: '%s'", priv->label_file);
+		ssize_t count = list->load(list, priv->label_file);
+		assert(count >= 0);
+		annotation_list_dump(list);
 	}
+	redraw_annotations(priv);
 	
-	return 0;
+	statusbar_set_info(priv->statusbar, "%s", path_name);
+	if(rc || priv->ai_enabled) start_prediction(shell);
+	return;
 }
 
 void statusbar_set_info(GtkWidget *statusbar, const char *fmt, ...)
@@ -168,14 +263,11 @@ void statusbar_set_info(GtkWidget *statusbar, const char *fmt, ...)
 static void on_image_file_changed(GtkFileChooserButton *file_chooser, struct shell_context *shell)
 {
 	assert(shell && shell->priv);
-	struct shell_private *priv = shell->priv;
 	
 	char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(file_chooser));
 	if(NULL == filename) return;
 	
 	shell_load_image(filename, shell);
-	
-	statusbar_set_info(priv->statusbar, "%s", filename);
 	free(filename);	
 	return;
 }
@@ -215,61 +307,18 @@ static void on_load_image(GtkButton * button, struct shell_context *shell)
 		return;
 	}
 
-	guint msgid = gtk_statusbar_get_context_id(GTK_STATUSBAR(priv->statusbar), "info");
-	const char * path_name = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
-	gtk_statusbar_push(GTK_STATUSBAR(priv->statusbar), msgid, path_name);
-	int rc = 0;
-	
-	const char * p_filename = strrchr(path_name, '/');
-	if(NULL == p_filename) p_filename = path_name;
-	else ++p_filename;
-	gtk_label_set_text(GTK_LABEL(priv->filename_label), p_filename);
+	char * path_name = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
+	if(NULL == path_name) return;
 	
-	priv->image_file[0] = '\0';
-	priv->label_file[0] = '\0';
-
-	rc = check_file(path_name);
+	int rc = check_file(path_name);
 	if(rc) {
 		show_error_message(shell, "invalid image path_name: %s\n", path_name);
+		g_free(path_name);
 		return;
 	}
 	
-	strncpy(priv->image_file, path_name, sizeof(priv->image_file));
-	
-	char annotation_file[PATH_MAX] = "";
-	strncpy(annotation_file, path_name, sizeof(annotation_file));
-
-	char * p_ext = strrchr(annotation_file, '.');
-	if(p_ext) strcpy(p_ext, ".txt");
-	else strcat(annotation_file, ".txt");
-	
-	strncpy(priv->label_file, annotation_file, sizeof(priv->label_file));	
-	rc = check_file(annotation_file);
-	if(rc || priv->ai_enabled) {
-		global_params_t *params = shell->user_data;
-		assert(params);
-		rc = auto_parse_image(params->ai, priv->image_file, annotation_file);
-	}
-	
-	
-	da_panel_t * panel = priv->panels[0];
-	assert(panel->load_image);
-	if(panel->load_image)
-	{
-		annotation_list_t * list = priv->properties->annotations;
-		assert(list);
-		annotation_list_reset(list);
-
-		if(0 == rc)
-		{
-			printf("annotation_file: '%s'", priv->label_file);
-			ssize_t count = list->load(list, priv->label_file);
-			assert(count >= 0);
-			annotation_list_dump(list);
-		}
-		panel->load_image(panel, path_name);
-	}
-	
+	shell_load_image(path_name, shell);
+	g_free(path_name);
 	return;
 }
 
@@ -280,6 +329,12 @@ static void on_save_annotation(GtkWidget * button, struct shell_context *shell)
 	
 	annotation_list_t * list = priv->properties->annotations;
 	assert(list);
+	
+	if(priv->auto_save_id) {	// saved now
+		g_source_remove(priv->auto_save_id);
+		priv->auto_save_id = 0;
+	}
+	if(priv->label_file[0] == '\0') return;
 
 	int rc = list->save(list, priv->label_file);
 	if(rc) {
@@ -290,6 +345,35 @@ static void on_save_annotation(GtkWidget * button, struct shell_context *shell)
 	return;
 }
 
+/*
+ * auto save:
+ *   edits are coalesced, the annotation file is written once the changes settle
+ *   (and before another image replaces the list).
+ */
+#define AUTO_SAVE_DELAY_MS (500)
+static gboolean on_auto_save_timeout(struct shell_context *shell)
+{
+	struct shell_private *priv = shell->priv;
+	priv->auto_save_id = 0;
+	on_save_annotation(NULL, shell);
+	return G_SOURCE_REMOVE;
+}
+
+static void schedule_auto_save(struct shell_context *shell)
+{
+	struct shell_private *priv = shell->priv;
+	if(priv->auto_save_id) g_source_remove(priv->auto_save_id);
+	priv->auto_save_id = g_timeout_add(AUTO_SAVE_DELAY_MS, (GSourceFunc)on_auto_save_timeout, shell);
+	return;
+}
+
+static void flush_auto_save(struct shell_context *shell)
+{
+	struct shell_private *priv = shell->priv;
+	if(priv->auto_save_id) on_save_annotation(NULL, shell);
+	return;
+}
+
 static void on_selchanged_labels(GtkComboBox * combo, struct shell_context *shell)
 {
 	assert(shell && shell->priv);
@@ -305,10 +389,13 @@ static void on_selchanged_labels(GtkComboBox * combo, struct shell_context *shel
 	gtk_header_bar_set_subtitle(header_bar, msg);
 
 
-	da_panel_t * panel = priv->panels[0];
-	assert(panel);
-
-	da_panel_set_annotation(panel, id);
+	// new boxes get the class in every view, 
+	// but a selection left in another view must not be relabeled
+	for(int i = 0; i < priv->num_panels; ++i)
+	{
+		priv->panels[i]->def_class = id;
+	}
+	if(priv->active_panel) da_panel_set_annotation(priv->active_panel, id);
 	return;
 }
 
@@ -387,7 +474,7 @@ static GtkListStore *create_classes_list_store(global_params_t *params)
 	if(NULL == params) params = global_params_get_default();
 	assert(params->num_labels > 0 && params->labels);
 	
-	GtkListStore * store = gtk_list_store_new(2, G_TYPE_INT, G_TYPE_STRING);
+	GtkListStore * store = gtk_list_store_new(3, G_TYPE_INT, G_TYPE_STRING, G_TYPE_BOOLEAN);
 	assert(store);
 	for(int i = 0; i < params->num_labels; ++i)
 	{
@@ -397,6 +484,7 @@ static GtkListStore *create_classes_list_store(global_params_t *params)
 		gtk_list_store_set(store, &iter,
 			0, i,
 			1, _(params->labels[i]),
+			2, TRUE,	// visible
 			-1);
 	}
 	return store;
@@ -425,10 +513,37 @@ static int init_classes_combo(GtkWidget *combo, GtkListStore * store, struct she
 	return 0;
 }
 
+static void on_class_visible_toggled(GtkCellRendererToggle *cr, gchar *path, struct shell_context *shell)
+{
+	assert(shell && shell->priv);
+	struct shell_private *priv = shell->priv;
+	
+	GtkTreeModel *model = gtk_tree_view_get_model(GTK_TREE_VIEW(priv->classes_list));
+	GtkTreeIter iter;
+	if(!gtk_tree_model_get_iter_from_string(model, &iter, path)) return;
+	
+	gint id = -1;
+	gboolean visible = FALSE;
+	gtk_tree_model_get(model, &iter, 0, &id, 2, &visible, -1);
+	
+	visible = !visible;
+	gtk_list_store_set(GTK_LIST_STORE(model), &iter, 2, visible, -1);
+	for(int i = 0; i < priv->num_panels; ++i)
+	{
+		da_panel_set_class_visible(priv->panels[i], id, visible);
+	}
+	return;
+}
+
 static int init_classes_tree(GtkWidget *listview, GtkListStore *store, struct shell_context *shell)
 {
 	GtkCellRenderer * cr = NULL;
 	GtkTreeViewColumn * col = NULL;
+	
+	cr = gtk_cell_renderer_toggle_new();
+	col = gtk_tree_view_column_new_with_attributes(_("Show"), cr, "active", 2, NULL);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(listview), col);
+	g_signal_connect(cr, "toggled", G_CALLBACK(on_class_visible_toggled), shell);
 
 	cr = gtk_cell_renderer_text_new();
 	col = gtk_tree_view_column_new_with_attributes(_("Id"), cr, "text", 0, NULL);
@@ -451,6 +566,141 @@ static int init_classes_tree(GtkWidget *listview, GtkListStore *store, struct sh
 	
 }
 
+/******************************************************************************
+ * display adjustments popover
+******************************************************************************/
+static void on_display_adjustments_changed(GtkWidget * widget, struct shell_context *shell)
+{
+	assert(shell && shell->priv);
+	struct shell_private *priv = shell->priv;
+	
+	img_adjustments_t * adj = priv->display;
+	adj->brightness = gtk_range_get_value(GTK_RANGE(priv->brightness_scale));
+	adj->contrast = gtk_range_get_value(GTK_RANGE(priv->contrast_scale));
+	adj->gamma = gtk_range_get_value(GTK_RANGE(priv->gamma_scale));
+	adj->auto_levels = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->auto_levels_check));
+	adj->clahe = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->clahe_check));
+	
+	for(int i = 0; i < priv->num_panels; ++i)
+	{
+		da_panel_set_display_adjustments(priv->panels[i], adj);
+	}
+	return;
+}
+
+static void on_display_adjustments_reset(GtkWidget * button, struct shell_context *shell)
+{
+	struct shell_private *priv = shell->priv;
+	img_adjustments_init(priv->display);
+	
+	gtk_range_set_value(GTK_RANGE(priv->brightness_scale), priv->display->brightness);
+	gtk_range_set_value(GTK_RANGE(priv->contrast_scale), priv->display->contrast);
+	gtk_range_set_value(GTK_RANGE(priv->gamma_scale), priv->display->gamma);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(priv->auto_levels_check), FALSE);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(priv->clahe_check), FALSE);
+	on_display_adjustments_changed(button, shell);
+	return;
+}
+
+static void on_window_level_changed(GtkWidget * widget, struct shell_context *shell)
+{
+	assert(shell && shell->priv);
+	struct shell_private *priv = shell->priv;
+	if(priv->updating_window_level) return;
+	
+	int window_center = (int)gtk_range_get_value(GTK_RANGE(priv->window_center_scale));
+	int window_width = (int)gtk_range_get_value(GTK_RANGE(priv->window_width_scale));
+	
+	// the views share the raw samples: remapped once, then every view is invalidated
+	for(int i = 0; i < priv->num_panels; ++i)
+	{
+		da_panel_set_window_level(priv->panels[i], window_center, window_width);
+	}
+	return;
+}
+
+static GtkWidget * add_display_scale(GtkWidget * grid, int row, const char * title, double min, double max, double step, double value, 
+	GCallback on_changed, struct shell_context *shell)
+{
+	GtkWidget * label = gtk_label_new(title);
+	GtkWidget * scale = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, min, max, step);
+	gtk_range_set_value(GTK_RANGE(scale), value);
+	gtk_widget_set_size_request(scale, 200, -1);
+	gtk_widget_set_halign(label, GTK_ALIGN_START);
+	gtk_grid_attach(GTK_GRID(grid), label, 0, row, 1, 1);
+	gtk_grid_attach(GTK_GRID(grid), scale, 1, row, 1, 1);
+	g_signal_connect(scale, "value-changed", on_changed, shell);
+	return scale;
+}
+
+static GtkWidget * create_display_adjustments_button(struct shell_context *shell)
+{
+	struct shell_private *priv = shell->priv;
+	img_adjustments_init(priv->display);
+	
+	GtkWidget * button = gtk_menu_button_new();
+	gtk_button_set_image(GTK_BUTTON(button), gtk_image_new_from_icon_name("display-brightness-symbolic", GTK_ICON_SIZE_BUTTON));
+	gtk_widget_set_tooltip_text(button, _("Display adjustments"));
+	
+	GtkWidget * popover = gtk_popover_new(button);
+	GtkWidget * grid = gtk_grid_new();
+	gtk_grid_set_row_spacing(GTK_GRID(grid), 4);
+	gtk_grid_set_column_spacing(GTK_GRID(grid), 8);
+	gtk_container_set_border_width(GTK_CONTAINER(grid), 8);
+	
+	GCallback on_changed = G_CALLBACK(on_display_adjustments_changed);
+	priv->brightness_scale = add_display_scale(grid, 0, _("Brightness"), -1.0, 1.0, 0.01, priv->display->brightness, on_changed, shell);
+	priv->contrast_scale = add_display_scale(grid, 1, _("Contrast"), 0.0, 4.0, 0.01, priv->display->contrast, on_changed, shell);
+	priv->gamma_scale = add_display_scale(grid, 2, _("Gamma"), 0.1, 4.0, 0.01, priv->display->gamma, on_changed, shell);
+	
+	priv->auto_levels_check = gtk_check_button_new_with_label(_("Auto levels"));
+	priv->clahe_check = gtk_check_button_new_with_label(_("CLAHE"));
+	g_signal_connect(priv->auto_levels_check, "toggled", G_CALLBACK(on_display_adjustments_changed), shell);
+	g_signal_connect(priv->clahe_check, "toggled", G_CALLBACK(on_display_adjustments_changed), shell);
+	gtk_grid_attach(GTK_GRID(grid), priv->auto_levels_check, 0, 3, 2, 1);
+	gtk_grid_attach(GTK_GRID(grid), priv->clahe_check, 0, 4, 2, 1);
+	
+	GtkWidget * reset_btn = gtk_button_new_with_label(_("Reset"));
+	g_signal_connect(reset_btn, "clicked", G_CALLBACK(on_display_adjustments_reset), shell);
+	gtk_grid_attach(GTK_GRID(grid), reset_btn, 1, 5, 1, 1);
+	
+	on_changed = G_CALLBACK(on_window_level_changed);
+	priv->window_center_scale = add_display_scale(grid, 6, _("Level"), 0, 65535, 1, 32768, on_changed, shell);
+	priv->window_width_scale = add_display_scale(grid, 7, _("Window"), 1, 65535, 1, 65535, on_changed, shell);
+	gtk_scale_set_digits(GTK_SCALE(priv->window_center_scale), 0);
+	gtk_scale_set_digits(GTK_SCALE(priv->window_width_scale), 0);
+	gtk_widget_set_sensitive(priv->window_center_scale, FALSE);
+	gtk_widget_set_sensitive(priv->window_width_scale, FALSE);
+	
+	gtk_container_add(GTK_CONTAINER(popover), grid);
+	gtk_widget_show_all(grid);
+	gtk_menu_button_set_popover(GTK_MENU_BUTTON(button), popover);
+	return button;
+}
+
+/*
+ * create_views(): 
+ *   the views share the decoded image and the annotation list (through the shell),
+ *   returns the first (main) view.
+ */
+static da_panel_t * create_views(struct shell_private *priv, int min_width, int min_height)
+{
+	global_params_t * params = global_params_get_default();
+	int num_panels = params->num_viewports;
+	if(num_panels < 1) num_panels = 1;
+	if(num_panels > SHELL_MAX_VIEWPORTS) num_panels = SHELL_MAX_VIEWPORTS;
+	
+	for(int i = 0; i < num_panels; ++i)
+	{
+		da_panel_t * panel = da_panel_new(min_width / num_panels, min_height, priv->shell);
+		assert(panel);
+		priv->panels[i] = panel;
+	}
+	priv->num_panels = num_panels;
+	priv->active_panel = priv->panels[0];
+	return priv->panels[0];
+}
+
 static int init_windows(struct shell_context *shell)
 {
 	assert(shell && shell->priv);
@@ -471,13 +721,21 @@ static int init_windows(struct shell_context *shell)
 	assert(list);
 	priv->properties = list;
 
-	da_panel_t * panel = da_panel_new(640, 480, shell);
+	da_panel_t * panel = create_views(priv, 640, 480);
 	assert(panel);
-	priv->panels[0] = panel;
 
 	gtk_grid_attach(GTK_GRID(grid), list->scrolled_win, 0, 0, 1, 1);
 	
-	gtk_paned_add1(GTK_PANED(hpaned), panel->frame);
+	if(priv->num_panels > 1)
+	{
+		GtkWidget * views = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+		gtk_box_set_homogeneous(GTK_BOX(views), TRUE);
+		for(int i = 0; i < priv->num_panels; ++i) gtk_box_pack_start(GTK_BOX(views), priv->panels[i]->frame, TRUE, TRUE, 0);
+		gtk_paned_add1(GTK_PANED(hpaned), views);
+	}else
+	{
+		gtk_paned_add1(GTK_PANED(hpaned), panel->frame);
+	}
 	gtk_paned_add2(GTK_PANED(hpaned), grid);
 	gtk_paned_set_position(GTK_PANED(hpaned), 640);
 
@@ -504,6 +762,7 @@ static int init_windows(struct shell_context *shell)
 	assert(save_btn);
 	g_signal_connect(save_btn, "clicked", G_CALLBACK(on_save_annotation), shell);
 	gtk_header_bar_pack_start(GTK_HEADER_BAR(header_bar), save_btn);
+	gtk_header_bar_pack_end(GTK_HEADER_BAR(header_bar), create_display_adjustments_button(shell));
 
 	GtkListStore *store = create_classes_list_store(NULL);
 	GtkWidget * combo = gtk_combo_box_new_with_entry();
@@ -523,6 +782,7 @@ static int init_windows(struct shell_context *shell)
 	priv->header_bar = header_bar;
 	priv->content_area = vbox;
 	priv->statusbar = statusbar;
+	priv->load_spinner = add_load_spinner(statusbar);
 	
 	gtk_window_set_default_size(GTK_WINDOW(window), 1280, 800);
 	g_signal_connect_swapped(window, "destroy", G_CALLBACK(shell_stop), shell);
@@ -537,7 +797,7 @@ static gboolean on_ai_flags_state_changed(GtkSwitch *widget, gboolean state, str
 	priv->ai_enabled = state;
 	
 	on_image_file_changed(GTK_FILE_CHOOSER_BUTTON(priv->file_chooser), shell);
-	gtk_widget_queue_draw(priv->panels[0]->da);
+	for(int i = 0; i < priv->num_panels; ++i) gtk_widget_queue_draw(priv->panels[i]->da);
 	
 	return FALSE;
 }
@@ -575,9 +835,8 @@ static int init_windows_with_ui_file(struct shell_context *shell, const char *ui
 	GtkBuilder *builder = gtk_builder_new_from_file(ui_file);
 	if(NULL == builder) return init_windows(shell);
 	
-	da_panel_t * panel = da_panel_new(640, 480, shell);
+	da_panel_t * panel = create_views(priv, 640, 480);
 	assert(panel);
-	priv->panels[0] = panel;
 	
 	
 	GtkWidget *window = get_widget(builder, "main_window");
@@ -594,16 +853,29 @@ static int init_windows_with_ui_file(struct shell_context *shell, const char *ui
 	GtkWidget *properties_list = get_widget(builder, "properties_list");
 	
 
+	GtkAdjustment *hadj = GTK_ADJUSTMENT(gtk_builder_get_object(builder, "da_horz_scroll"));
+	GtkAdjustment *vadj = GTK_ADJUSTMENT(gtk_builder_get_object(builder, "da_vert_scroll"));
+	da_panel_set_adjustments(panel, hadj, vadj);
+
 	if(da_frame) {
+		GtkWidget * views = da_frame;
+		if(priv->num_panels > 1)	// the first view keeps the scrollbars of the ui-file, the others are packed next to it
+		{
+			views = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+			gtk_box_set_homogeneous(GTK_BOX(views), TRUE);
+			gtk_container_add(GTK_CONTAINER(da_frame), views);
+		}
+		
 		g_object_ref(panel->da);
 		gtk_container_remove(GTK_CONTAINER(panel->frame), panel->da);
-		gtk_container_add(GTK_CONTAINER(da_frame), panel->da);
+		gtk_container_add(GTK_CONTAINER(views), panel->da);
 		g_object_unref(panel->da);
 		
 		gtk_widget_destroy(panel->frame);
 		panel->frame = da_frame;
-		gtk_widget_show_all(panel->frame);
 		
+		for(int i = 1; i < priv->num_panels; ++i) gtk_box_pack_start(GTK_BOX(views), priv->panels[i]->frame, TRUE, TRUE, 0);
+		gtk_widget_show_all(panel->frame);
 	}
 	
 	GtkWidget *file_chooser = gtk_file_chooser_button_new(_("Open File"), GTK_FILE_CHOOSER_ACTION_OPEN);
@@ -613,10 +885,12 @@ static int init_windows_with_ui_file(struct shell_context *shell, const char *ui
 	gtk_file_chooser_set_current_folder(GTK_FILE_CHOOSER(file_chooser), priv->app_path);
 	g_signal_connect(file_chooser, "file-set", G_CALLBACK(on_image_file_changed), shell);
 	gtk_header_bar_pack_start(GTK_HEADER_BAR(header_bar), file_chooser);
+	gtk_header_bar_pack_end(GTK_HEADER_BAR(header_bar), create_display_adjustments_button(shell));
 
 	priv->window = window;
 	priv->header_bar = header_bar;
 	priv->statusbar = statusbar;
+	priv->load_spinner = add_load_spinner(statusbar);
 	priv->combo = classes_combo;
 	priv->classes_list = classes_list;
 	priv->file_chooser = file_chooser;
@@ -681,6 +955,8 @@ static struct shell_private *shell_private_new(struct shell_context *shell)
 	priv->shell = shell;
 	priv->app_path = get_app_path();
 	
+	priv->loader = image_loader_new((image_decode_func)da_image_load, (image_free_func)da_image_unref, on_image_loaded, shell);
+	assert(priv->loader);
 	return priv;
 }
 
@@ -697,6 +973,12 @@ struct shell_context * shell_context_init(struct shell_context *shell, void * us
 
 void shell_context_cleanup(struct shell_context * shell)
 {
+	if(NULL == shell || NULL == shell->priv) return;
+	struct shell_private *priv = shell->priv;
+	image_loader_free(priv->loader);
+	priv->loader = NULL;
+	cancel_prediction(priv);
+	flush_auto_save(shell);
 	return;
 }
 
@@ -713,15 +995,73 @@ annotation_list_t * shell_get_annotations(struct shell_context * shell)
 	return NULL;
 }
 
+static void redraw_annotations(shell_private_t * priv)
+{
+	property_list_t * props = priv->properties;
+	property_list_redraw(props);
+	for(int i = 0; i < priv->num_panels; ++i)
+	{
+		da_panel_invalidate_overlay(priv->panels[i]);
+	}
+	return;
+}
+
 void shell_redraw(struct shell_context * shell)
+{
+	assert(shell && shell->priv);
+	shell_private_t * priv = shell->priv;
+	redraw_annotations(priv);
+	
+	// auto save 
+	schedule_auto_save(shell);
+	return;
+}
+
+/*
+ * shell_notify_annotation_changed(): 
+ *   one box has been added or modified in one of the views,
+ *   every view re-renders only the areas covered by the old and new box.
+ */
+void shell_notify_annotation_changed(struct shell_context * shell, const annotation_data_t * before, const annotation_data_t * after)
 {
 	assert(shell && shell->priv);
 	shell_private_t * priv = shell->priv;
 	property_list_t * props = priv->properties;
 	property_list_redraw(props);
 	
+	for(int i = 0; i < priv->num_panels; ++i)
+	{
+		da_panel_damage_annotation(priv->panels[i], before);
+		da_panel_damage_annotation(priv->panels[i], after);
+	}
+	
 	// auto save 
-	on_save_annotation(NULL, shell);
+	schedule_auto_save(shell);
+	return;
+}
+
+/*
+ * shell_notify_annotation_removed(): 
+ *   the box at 'index' has been removed in one of the views ('removed': a copy of it),
+ *   every view shifts its selection and re-renders only the area the box covered.
+ */
+void shell_notify_annotation_removed(struct shell_context * shell, ssize_t index, const annotation_data_t * removed)
+{
+	assert(shell && shell->priv);
+	shell_private_t * priv = shell->priv;
+	for(int i = 0; i < priv->num_panels; ++i)
+	{
+		da_panel_annotation_removed(priv->panels[i], index);
+	}
+	shell_notify_annotation_changed(shell, removed, NULL);
+	return;
+}
+
+void shell_set_active_panel(struct shell_context * shell, struct da_panel * panel)
+{
+	assert(shell && shell->priv);
+	shell_private_t * priv = shell->priv;
+	priv->active_panel = panel;
 	return;
 }
 
@@ -10,6 +10,7 @@ extern "C" {
 #include <json-c/json.h>
 
 struct shell_private;
+struct da_panel;
 struct shell_context
 {
 	void * user_data;
@@ -32,6 +33,9 @@ void shell_context_cleanup(struct shell_context *shell);
 int shell_add_annotation(struct shell_context * shell, int index, const annotation_data_t * data);
 annotation_list_t * shell_get_annotations(struct shell_context * shell);
 void shell_redraw(struct shell_context * shell);
+void shell_notify_annotation_changed(struct shell_context * shell, const annotation_data_t * before, const annotation_data_t * after);
+void shell_notify_annotation_removed(struct shell_context * shell, ssize_t index, const annotation_data_t * removed);
+void shell_set_active_panel(struct shell_context * shell, struct da_panel * panel);	// the view the user works in
 void shell_set_current_label(struct shell_context * shell, int klass);
 
 #ifdef __cplusplus
@@ -6,6 +6,7 @@
 #include "shell.h"
 #include "da_panel.h"
 #include "property-list.h"
+#include "image-loader.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,7 +24,10 @@ typedef struct shell_private
 	
 	GtkWidget * filename_label;
 
-	da_panel_t * panels[1];		// TODO: multi-viewport support
+#define SHELL_MAX_VIEWPORTS (4)
+	da_panel_t * panels[SHELL_MAX_VIEWPORTS];	// views of the same image and annotations
+	int num_panels;
+	da_panel_t * active_panel;	// the view the user clicked last, a class change applies to its selection only
 	property_list_t * properties;
 	
 	const char * app_path;
@@ -33,11 +37,29 @@ typedef struct shell_private
 	guint timer_id;
 	int ai_enabled;
 	
+	image_loader_t * loader;	// decodes on a worker thread
+	GtkWidget * load_spinner;	// statusbar: shown while loading
+	struct ai_request * ai_request;	// pending prediction of the current image
+	guint auto_save_id;			// pending (coalesced) save of the annotation file
+	
 	GtkWidget *classes_list;
 	
 	int show_sidebar;
 	int show_properties_list;
 	GtkWidget *file_chooser;
+	
+	// display adjustments (applied to all views)
+	img_adjustments_t display[1];
+	GtkWidget *brightness_scale;
+	GtkWidget *contrast_scale;
+	GtkWidget *gamma_scale;
+	GtkWidget *auto_levels_check;
+	GtkWidget *clahe_check;
+	
+	// window / level (16-bit images)
+	GtkWidget *window_center_scale;
+	GtkWidget *window_width_scale;
+	int updating_window_level;
 }shell_private_t;
 
 
@@ -0,0 +1,245 @@
+/*
+ * tile-renderer.c
+ * 
+ * Copyright 2020 chehw <htc.chehw@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "tile-renderer.h"
+
+#define TILE_RENDERER_DEFAULT_TILE_SIZE (256)
+#define TILE_RENDERER_MAX_THREADS (64)
+
+static inline void get_tile_rect(const tile_renderer_t * renderer, int index, cairo_rectangle_int_t * tile)
+{
+	const cairo_rectangle_int_t * area = &renderer->area;
+	int tile_size = renderer->tile_size;
+	int col = index % renderer->cols;
+	int row = index / renderer->cols;
+	
+	tile->x = area->x + col * tile_size;
+	tile->y = area->y + row * tile_size;
+	tile->width = area->x + area->width - tile->x;
+	tile->height = area->y + area->height - tile->y;
+	if(tile->width > tile_size) tile->width = tile_size;
+	if(tile->height > tile_size) tile->height = tile_size;
+	return;
+}
+
+static void render_one_tile(tile_render_func render_tile, void * user_data, cairo_surface_t * surface, const cairo_rectangle_int_t * tile)
+{
+	cairo_t * cr = cairo_create(surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	
+	cairo_rectangle(cr, 0, 0, tile->width, tile->height);
+	cairo_clip(cr);
+	cairo_translate(cr, -tile->x, -tile->y);
+	render_tile(user_data, cr, tile);
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+	return;
+}
+
+static void * worker_thread(void * user_data)
+{
+	tile_renderer_t * renderer = user_data;
+	assert(renderer);
+	
+	pthread_mutex_lock(&renderer->mutex);
+	while(!renderer->quit)
+	{
+		if(NULL == renderer->render_tile || renderer->next_tile >= renderer->num_tiles || renderer->num_free <= 0)
+		{
+			pthread_cond_wait(&renderer->cond, &renderer->mutex);
+			continue;
+		}
+		
+		struct tile_job job;
+		memset(&job, 0, sizeof(job));
+		get_tile_rect(renderer, renderer->next_tile++, &job.tile);
+		job.surface = renderer->free_surfaces[--renderer->num_free];
+		tile_render_func render_tile = renderer->render_tile;
+		void * render_data = renderer->user_data;
+		pthread_mutex_unlock(&renderer->mutex);
+		
+		render_one_tile(render_tile, render_data, job.surface, &job.tile);
+		
+		pthread_mutex_lock(&renderer->mutex);
+		assert(renderer->num_done < renderer->num_surfaces);
+		renderer->done[renderer->num_done++] = job;
+		pthread_cond_broadcast(&renderer->cond);
+	}
+	pthread_mutex_unlock(&renderer->mutex);
+	return NULL;
+}
+
+static inline void composite_tile(cairo_t * cr, const struct tile_job * job)
+{
+	cairo_set_source_surface(cr, job->surface, job->tile.x, job->tile.y);
+	cairo_rectangle(cr, job->tile.x, job->tile.y, job->tile.width, job->tile.height);
+	cairo_fill(cr);
+}
+
+/*
+ * tile_renderer_render(): 
+ *   split 'area' of 'target' into tiles, render them on the worker pool
+ *   and composite the finished tiles on the calling thread. (blocks until done)
+ */
+static int tile_renderer_render(struct tile_renderer * renderer, cairo_surface_t * target, const cairo_rectangle_int_t * area, 
+	tile_render_func render_tile, void * user_data)
+{
+	assert(renderer && target && area && render_tile);
+	if(area->width <= 0 || area->height <= 0) return 0;
+	
+	int tile_size = renderer->tile_size;
+	int cols = (area->width + tile_size - 1) / tile_size;
+	int rows = (area->height + tile_size - 1) / tile_size;
+	int num_tiles = cols * rows;
+	
+	cairo_t * cr = cairo_create(target);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	
+	if(renderer->num_threads <= 0 || num_tiles == 1)	// not worth the hand-off
+	{
+		cairo_surface_t * surface = renderer->free_surfaces[0];
+		for(int i = 0; i < num_tiles; ++i)
+		{
+			struct tile_job job = { .surface = surface };
+			renderer->area = *area;
+			renderer->cols = cols;
+			get_tile_rect(renderer, i, &job.tile);
+			render_one_tile(render_tile, user_data, surface, &job.tile);
+			composite_tile(cr, &job);
+		}
+		cairo_destroy(cr);
+		return 0;
+	}
+	
+	struct tile_job * jobs = calloc(renderer->num_surfaces, sizeof(*jobs));
+	assert(jobs);
+	
+	pthread_mutex_lock(&renderer->mutex);
+	renderer->area = *area;
+	renderer->cols = cols;
+	renderer->num_tiles = num_tiles;
+	renderer->next_tile = 0;
+	renderer->render_tile = render_tile;
+	renderer->user_data = user_data;
+	pthread_cond_broadcast(&renderer->cond);
+	
+	int completed = 0;
+	while(completed < num_tiles)
+	{
+		while(renderer->num_done == 0) pthread_cond_wait(&renderer->cond, &renderer->mutex);
+		
+		int num_jobs = renderer->num_done;
+		memcpy(jobs, renderer->done, num_jobs * sizeof(*jobs));
+		renderer->num_done = 0;
+		pthread_mutex_unlock(&renderer->mutex);
+		
+		for(int i = 0; i < num_jobs; ++i) composite_tile(cr, &jobs[i]);
+		cairo_surface_flush(target);	// before the tile surfaces are reused
+		
+		pthread_mutex_lock(&renderer->mutex);
+		for(int i = 0; i < num_jobs; ++i) renderer->free_surfaces[renderer->num_free++] = jobs[i].surface;
+		completed += num_jobs;
+		pthread_cond_broadcast(&renderer->cond);
+	}
+	renderer->render_tile = NULL;
+	renderer->user_data = NULL;
+	pthread_mutex_unlock(&renderer->mutex);
+	
+	free(jobs);
+	cairo_destroy(cr);
+	return 0;
+}
+
+tile_renderer_t * tile_renderer_new(int num_threads, int tile_size)
+{
+	if(num_threads <= 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_threads > TILE_RENDERER_MAX_THREADS) num_threads = TILE_RENDERER_MAX_THREADS;
+	if(num_threads <= 1) num_threads = 0;	// serial
+	if(tile_size <= 0) tile_size = TILE_RENDERER_DEFAULT_TILE_SIZE;
+	
+	tile_renderer_t * renderer = calloc(1, sizeof(*renderer));
+	assert(renderer);
+	
+	renderer->num_threads = num_threads;
+	renderer->tile_size = tile_size;
+	renderer->render = tile_renderer_render;
+	
+	// two surfaces per worker: one in flight, one waiting to be composited
+	int num_surfaces = (num_threads > 0)?(num_threads * 2):1;
+	renderer->num_surfaces = num_surfaces;
+	renderer->free_surfaces = calloc(num_surfaces, sizeof(*renderer->free_surfaces));
+	renderer->done = calloc(num_surfaces, sizeof(*renderer->done));
+	assert(renderer->free_surfaces && renderer->done);
+	for(int i = 0; i < num_surfaces; ++i)
+	{
+		cairo_surface_t * surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, tile_size, tile_size);
+		assert(surface && cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
+		renderer->free_surfaces[renderer->num_free++] = surface;
+	}
+	
+	pthread_mutex_init(&renderer->mutex, NULL);
+	pthread_cond_init(&renderer->cond, NULL);
+	
+	if(num_threads > 0)
+	{
+		renderer->threads = calloc(num_threads, sizeof(*renderer->threads));
+		assert(renderer->threads);
+		for(int i = 0; i < num_threads; ++i)
+		{
+			int rc = pthread_create(&renderer->threads[i], NULL, worker_thread, renderer);
+			assert(0 == rc);
+		}
+	}
+	return renderer;
+}
+
+void tile_renderer_free(tile_renderer_t * renderer)
+{
+	if(NULL == renderer) return;
+	
+	pthread_mutex_lock(&renderer->mutex);
+	renderer->quit = 1;
+	pthread_cond_broadcast(&renderer->cond);
+	pthread_mutex_unlock(&renderer->mutex);
+	
+	for(int i = 0; i < renderer->num_threads; ++i) pthread_join(renderer->threads[i], NULL);
+	free(renderer->threads);
+	
+	for(int i = 0; i < renderer->num_free; ++i) cairo_surface_destroy(renderer->free_surfaces[i]);
+	free(renderer->free_surfaces);
+	free(renderer->done);
+	
+	pthread_mutex_destroy(&renderer->mutex);
+	pthread_cond_destroy(&renderer->cond);
+	free(renderer);
+	return;
+}
@@ -0,0 +1,61 @@
+#ifndef ANNOTATION_TOOLS_TILE_RENDERER_H_
+#define ANNOTATION_TOOLS_TILE_RENDERER_H_
+
+#include <stdio.h>
+#include <pthread.h>
+#include <cairo/cairo.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * tile_render_func: 
+ *   render one tile, 'cr' targets a cleared ARGB32 tile surface and is already
+ *   translated so that the caller draws in target (viewport) coordinates.
+ *   Called from worker threads: must not touch GTK.
+ */
+typedef void (* tile_render_func)(void * user_data, cairo_t * cr, const cairo_rectangle_int_t * tile);
+
+struct tile_job
+{
+	cairo_rectangle_int_t tile;
+	cairo_surface_t * surface;
+};
+
+typedef struct tile_renderer
+{
+	int num_threads;
+	int tile_size;
+	pthread_t * threads;
+	
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int quit;
+	
+	// current batch
+	tile_render_func render_tile;
+	void * user_data;
+	cairo_rectangle_int_t area;
+	int cols;
+	int num_tiles;
+	int next_tile;
+	
+	// tile surfaces: free-list and finished tiles (waiting to be composited)
+	int num_surfaces;
+	cairo_surface_t ** free_surfaces;
+	int num_free;
+	struct tile_job * done;
+	int num_done;
+	
+	int (* render)(struct tile_renderer * renderer, cairo_surface_t * target, const cairo_rectangle_int_t * area, 
+		tile_render_func render_tile, void * user_data);
+}tile_renderer_t;
+
+tile_renderer_t * tile_renderer_new(int num_threads, int tile_size);	// num_threads <= 0: number of online cpus
+void tile_renderer_free(tile_renderer_t * renderer);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,851 @@
+/*
+ * ai-batch.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+/*
+ * ai-batch: headless pre-annotation of a folder (or a list) of images.
+ *
+ *   reader --> [resize] --> infer x N --> writer
+ *
+ * The stages are connected by bounded queues, N is the number of requests in flight,
+ * each request carries up to --batch-size images.
+ * Every image written is appended to a manifest (done-file), a restarted run skips them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <json-c/json.h>
+
+#include "annotation-core.h"
+
+/*************************************************
+ * batch_item: one image travelling through the pipeline
+*************************************************/
+typedef struct batch_item
+{
+	char * path;
+	unsigned char * data;	// encoded image (jpeg/png)
+	ssize_t cb_data;
+
+	int rc;
+	ai_detections_t detections;
+	double latency;			// seconds spent in predict()
+}batch_item_t;
+
+static batch_item_t * batch_item_new(const char * path)
+{
+	batch_item_t * item = calloc(1, sizeof(*item));
+	assert(item);
+	item->path = strdup(path);
+	return item;
+}
+
+static void batch_item_free(batch_item_t * item)
+{
+	if(NULL == item) return;
+	free(item->path);
+	free(item->data);
+	ai_detections_clear(&item->detections);
+	free(item);
+}
+
+/*************************************************
+ * batch_queue: bounded, blocking FIFO
+*************************************************/
+typedef struct batch_queue
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+
+	batch_item_t ** items;
+	int size;
+	int head;
+	int length;
+
+	int num_producers;	// closed when the last producer leaves
+}batch_queue_t;
+
+static void batch_queue_init(batch_queue_t * queue, int size, int num_producers)
+{
+	assert(size > 0 && num_producers > 0);
+	memset(queue, 0, sizeof(*queue));
+	queue->items = calloc(size, sizeof(*queue->items));
+	assert(queue->items);
+	queue->size = size;
+	queue->num_producers = num_producers;
+
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->not_empty, NULL);
+	pthread_cond_init(&queue->not_full, NULL);
+}
+
+static void batch_queue_cleanup(batch_queue_t * queue)
+{
+	for(int i = 0; i < queue->length; ++i) {
+		batch_item_free(queue->items[(queue->head + i) % queue->size]);
+	}
+	free(queue->items);
+	pthread_cond_destroy(&queue->not_full);
+	pthread_cond_destroy(&queue->not_empty);
+	pthread_mutex_destroy(&queue->mutex);
+	memset(queue, 0, sizeof(*queue));
+}
+
+static void batch_queue_push(batch_queue_t * queue, batch_item_t * item)
+{
+	pthread_mutex_lock(&queue->mutex);
+	while(queue->length == queue->size) pthread_cond_wait(&queue->not_full, &queue->mutex);
+	queue->items[(queue->head + queue->length) % queue->size] = item;
+	++queue->length;
+	pthread_cond_signal(&queue->not_empty);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+static batch_item_t * batch_queue_pop(batch_queue_t * queue)	// NULL: closed and drained
+{
+	batch_item_t * item = NULL;
+	pthread_mutex_lock(&queue->mutex);
+	while(queue->length == 0 && queue->num_producers > 0) pthread_cond_wait(&queue->not_empty, &queue->mutex);
+	if(queue->length > 0) {
+		item = queue->items[queue->head];
+		queue->items[queue->head] = NULL;
+		queue->head = (queue->head + 1) % queue->size;
+		--queue->length;
+		pthread_cond_signal(&queue->not_full);
+	}
+	pthread_mutex_unlock(&queue->mutex);
+	return item;
+}
+
+static int batch_queue_pop_batch(batch_queue_t * queue, batch_item_t ** items, int max_items)	// waits for the first item only
+{
+	int count = 0;
+	batch_item_t * item = batch_queue_pop(queue);
+	if(NULL == item) return 0;
+	items[count++] = item;
+
+	pthread_mutex_lock(&queue->mutex);
+	while(count < max_items && queue->length > 0) {
+		items[count++] = queue->items[queue->head];
+		queue->items[queue->head] = NULL;
+		queue->head = (queue->head + 1) % queue->size;
+		--queue->length;
+	}
+	pthread_cond_broadcast(&queue->not_full);
+	pthread_mutex_unlock(&queue->mutex);
+	return count;
+}
+
+static void batch_queue_leave(batch_queue_t * queue)	// a producer has finished
+{
+	pthread_mutex_lock(&queue->mutex);
+	assert(queue->num_producers > 0);
+	if(--queue->num_producers == 0) pthread_cond_broadcast(&queue->not_empty);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+/*************************************************
+ * batch_context
+*************************************************/
+typedef struct batch_context
+{
+	json_object * jserver_urls;	// a url or an array of replicas
+	json_object * jensemble_urls;	// other models, their detections are fused with the first one's (wbf)
+	struct ai_client ** models;		// one client per model, shared by the workers (one endpoint table)
+	int num_models;
+	ai_postprocess_t postprocess[1];
+	int num_workers;
+	int queue_size;
+	int max_size;		// > 0: images larger than max_size x max_size are downscaled before upload
+	int input_size;		// > 0: letterboxed to the model input size by the ai client
+	int batch_size;		// images per request
+	int tile_size;		// > 0: larger images are predicted as overlapping tiles (not batched)
+	double tile_overlap;
+	int tile_concurrency;	// tiles in flight per worker
+	int timeout;		// seconds per request
+	int max_retries;
+	int jpeg_quality;
+	int force;			// re-annotate images that already have a label file
+	int verbose;
+
+	const char ** inputs;
+	int num_inputs;
+
+	const char * manifest_file;
+	GHashTable * done;	// paths listed in the manifest
+	FILE * manifest_fp;
+
+	batch_queue_t read_queue[1];
+	batch_queue_t infer_queue[1];
+	batch_queue_t write_queue[1];
+
+	// stats
+	long num_queued;
+	long num_skipped;
+	long num_ok;
+	long num_failed;
+	long num_detections;
+	int64_t bytes_sent;
+	int64_t queue_time_us;	// sums over the requests, see on_request_stats()
+	int64_t rtt_us;
+	int64_t server_time_us;
+	long num_requests;
+	long num_server_times;
+	long num_retries;
+	long num_tiles;
+	int64_t tile_encode_us;
+	int64_t tile_predict_us;
+	double * latencies;
+	long num_latencies;
+	long max_latencies;
+}batch_context_t;
+
+static int is_image_file(const char * path)
+{
+	const char * ext = strrchr(path, '.');
+	if(NULL == ext) return 0;
+	return (0 == strcasecmp(ext, ".jpg")
+		|| 0 == strcasecmp(ext, ".jpeg")
+		|| 0 == strcasecmp(ext, ".png"));
+}
+
+static void make_label_file(char label_file[static PATH_MAX], const char * image_file)
+{
+	strncpy(label_file, image_file, PATH_MAX - 5);
+	label_file[PATH_MAX - 5] = '\0';
+
+	char * p_ext = strrchr(label_file, '.');
+	char * p_slash = strrchr(label_file, '/');
+	if(p_ext && (NULL == p_slash || p_ext > p_slash)) strcpy(p_ext, ".txt");
+	else strcat(label_file, ".txt");
+}
+
+static void enqueue_image(batch_context_t * ctx, batch_queue_t * queue, const char * path)
+{
+	if(g_hash_table_contains(ctx->done, path)) {
+		++ctx->num_skipped;
+		return;
+	}
+	if(!ctx->force) {
+		char label_file[PATH_MAX] = "";
+		make_label_file(label_file, path);
+		if(0 == check_file(label_file)) {
+			++ctx->num_skipped;
+			return;
+		}
+	}
+
+	batch_item_t * item = batch_item_new(path);
+	item->cb_data = load_binary_data(path, &item->data);
+	if(item->cb_data <= 0) {
+		fprintf(stderr, "[ERROR]: failed to read '%s'\n", path);
+		item->rc = -1;
+	}
+	++ctx->num_queued;
+	batch_queue_push(queue, item);
+}
+
+static int filter_images(const struct dirent * entry)
+{
+	return (entry->d_name[0] != '.' && is_image_file(entry->d_name));
+}
+
+static void enqueue_folder(batch_context_t * ctx, batch_queue_t * queue, const char * folder)
+{
+	// sorted, so that an interrupted run resumes in the same order
+	struct dirent ** entries = NULL;
+	int count = scandir(folder, &entries, filter_images, alphasort);
+	if(count < 0) {
+		perror(folder);
+		return;
+	}
+
+	char path[PATH_MAX] = "";
+	for(int i = 0; i < count; ++i) {
+		snprintf(path, sizeof(path), "%s/%s", folder, entries[i]->d_name);
+		enqueue_image(ctx, queue, path);
+		free(entries[i]);
+	}
+	free(entries);
+}
+
+static void enqueue_list(batch_context_t * ctx, batch_queue_t * queue, const char * list_file)
+{
+	FILE * fp = fopen(list_file, "r");
+	if(NULL == fp) {
+		perror(list_file);
+		return;
+	}
+	char line[PATH_MAX] = "";
+	while(fgets(line, sizeof(line), fp)) {
+		char * path = trim(line, line + strlen(line));
+		if(NULL == path || path[0] == '\0' || path[0] == '#') continue;
+		enqueue_image(ctx, queue, path);
+	}
+	fclose(fp);
+}
+
+/*************************************************
+ * stages
+*************************************************/
+static void * reader_thread(void * user_data)
+{
+	batch_context_t * ctx = user_data;
+	batch_queue_t * queue = (ctx->max_size > 0)?ctx->read_queue:ctx->infer_queue;
+
+	for(int i = 0; i < ctx->num_inputs; ++i) {
+		const char * input = ctx->inputs[i];
+		struct stat st[1];
+		if(stat(input, st)) {
+			perror(input);
+			continue;
+		}
+		if(S_ISDIR(st->st_mode)) enqueue_folder(ctx, queue, input);
+		else if(is_image_file(input)) enqueue_image(ctx, queue, input);
+		else enqueue_list(ctx, queue, input);
+	}
+	batch_queue_leave(queue);
+	return NULL;
+}
+
+static int shrink_image(batch_context_t * ctx, batch_item_t * item)
+{
+	int width = 0, height = 0;
+	int rc = img_utils_get_jpeg_size(item->data, item->cb_data, &width, &height);
+	if(rc) rc = img_utils_get_png_size(item->data, item->cb_data, &width, &height);
+	if(rc || (width <= ctx->max_size && height <= ctx->max_size)) return 0;	// sent as is
+
+	// the labels are normalized, the boxes do not depend on the upload size
+	int dst_width = ctx->max_size, dst_height = ctx->max_size;
+	if(width > height) dst_height = (int)((int64_t)height * ctx->max_size / width);
+	else dst_width = (int)((int64_t)width * ctx->max_size / height);
+	if(dst_width < 1) dst_width = 1;
+	if(dst_height < 1) dst_height = 1;
+
+	bgra_image_t image[1], resized[1];
+	memset(image, 0, sizeof(image));
+	memset(resized, 0, sizeof(resized));
+
+	rc = bgra_image_load_data(image, item->data, item->cb_data);
+	if(0 == rc) rc = bgra_image_resize(resized, image, dst_width, dst_height);
+	if(0 == rc) {
+		unsigned char * jpeg = NULL;
+		ssize_t cb_jpeg = bgra_image_to_jpeg_stream(resized, &jpeg, ctx->jpeg_quality);
+		if(cb_jpeg > 0) {
+			free(item->data);
+			item->data = jpeg;
+			item->cb_data = cb_jpeg;
+		}else {
+			free(jpeg);
+			rc = -1;
+		}
+	}
+	bgra_image_clear(image);
+	bgra_image_clear(resized);
+	return rc;
+}
+
+static void * resize_thread(void * user_data)
+{
+	batch_context_t * ctx = user_data;
+	batch_item_t * item = NULL;
+	while((item = batch_queue_pop(ctx->read_queue))) {
+		if(0 == item->rc && shrink_image(ctx, item)) {
+			fprintf(stderr, "[WARNING]: failed to resize '%s', sent as is\n", item->path);
+		}
+		batch_queue_push(ctx->infer_queue, item);
+	}
+	batch_queue_leave(ctx->infer_queue);
+	return NULL;
+}
+
+static void on_request_stats(struct ai_client * ai, const ai_request_stats_t * stats)
+{
+	batch_context_t * ctx = ai_client_get_user_data(ai);
+	__sync_fetch_and_add(&ctx->num_requests, 1);
+	__sync_fetch_and_add(&ctx->num_retries, stats->attempts - 1);
+	__sync_fetch_and_add(&ctx->queue_time_us, (int64_t)(stats->queue_time * 1000.0));
+	__sync_fetch_and_add(&ctx->rtt_us, (int64_t)(stats->rtt * 1000.0));
+	if(stats->server_time >= 0) {
+		__sync_fetch_and_add(&ctx->num_server_times, 1);
+		__sync_fetch_and_add(&ctx->server_time_us, (int64_t)(stats->server_time * 1000.0));
+	}
+}
+
+static void on_tile_stats(struct ai_client * ai, const ai_tile_stats_t * stats)
+{
+	batch_context_t * ctx = ai_client_get_user_data(ai);
+	__sync_fetch_and_add(&ctx->num_tiles, 1);
+	__sync_fetch_and_add(&ctx->tile_encode_us, (int64_t)(stats->encode_time * 1000.0));
+	__sync_fetch_and_add(&ctx->tile_predict_us, (int64_t)(stats->predict_time * 1000.0));
+	if(ctx->verbose) {
+		printf("  tile %d/%d (%d, %d, %d x %d): %s, %d detections, queue %.1f ms, encode %.1f ms, predict %.1f ms\n",
+			stats->index + 1, stats->num_tiles, stats->x, stats->y, stats->width, stats->height,
+			stats->rc?"failed":"ok", stats->num_detections,
+			stats->queue_time, stats->encode_time, stats->predict_time);
+	}
+}
+
+static struct ai_client * new_client(batch_context_t * ctx, json_object * jurls)
+{
+	struct ai_client * ai = ai_client_new(ctx);
+	assert(ai);
+	ai_client_options_t options;
+	ai_client_get_options(ai, &options, sizeof(options));
+	options.input_size = ctx->input_size;
+	options.jpeg_quality = ctx->jpeg_quality;
+	options.tile_size = ctx->tile_size;
+	options.tile_overlap = ctx->tile_overlap;
+	options.tile_concurrency = ctx->tile_concurrency;
+	options.on_tile_stats = on_tile_stats;
+	// the workers' requests are balanced over the replicas together
+	options.max_connections = ctx->num_workers * ((ctx->tile_size > 0)?ctx->tile_concurrency:1);
+	options.timeout = ctx->timeout;
+	options.max_retries = ctx->max_retries;
+	options.on_stats = on_request_stats;
+	ai_client_set_options(ai, &options, sizeof(options));
+	ai_client_load_endpoints(ai, jurls);
+	return ai;
+}
+
+/*
+ * predict_images(): the raw detections of one model, lists[i * stride] for images[i]
+ */
+static void predict_images(struct ai_client * ai, const ai_image_t * images, int num_images, 
+	json_object ** results, ai_detections_t * lists, int stride, batch_item_t ** pending)
+{
+	const batch_context_t * ctx = ai_client_get_user_data(ai);
+	if(num_images == 1 || ctx->tile_size > 0) {	// tiled images are not batched
+		for(int i = 0; i < num_images; ++i) {
+			if(ai_client_predict_detections(ai, images[i].data, images[i].size, &lists[i * stride])) pending[i]->rc = -1;
+		}
+		return;
+	}
+	
+	ai_client_predict_batch(ai, images, num_images, results);
+	for(int i = 0; i < num_images; ++i) {
+		ai_detections_t * detections = &lists[i * stride];
+		ai_detections_reset(detections);
+		if(NULL == results[i] || ai_detections_from_json(detections, results[i])) pending[i]->rc = -1;
+		if(results[i]) json_object_put(results[i]);
+	}
+}
+
+static void * infer_thread(void * user_data)
+{
+	batch_context_t * ctx = user_data;
+
+	// blocking requests on the shared clients: the number of workers is the number of requests in flight
+	int num_models = ctx->num_models;
+	struct ai_client ** models = ctx->models;
+
+	// up to batch_size queued images are sent in one request
+	batch_item_t ** items = calloc(ctx->batch_size, sizeof(*items));
+	ai_image_t * images = calloc(ctx->batch_size, sizeof(*images));
+	json_object ** results = calloc(ctx->batch_size, sizeof(*results));
+	batch_item_t ** pending = calloc(ctx->batch_size, sizeof(*pending));
+	ai_detections_t * lists = calloc(ctx->batch_size * num_models, sizeof(*lists));	// [image][model]
+	assert(items && images && results && pending && lists);
+
+	int count = 0;
+	while((count = batch_queue_pop_batch(ctx->infer_queue, items, ctx->batch_size)) > 0) {
+		int num_images = 0;
+		for(int i = 0; i < count; ++i) {
+			if(items[i]->rc) continue;
+			pending[num_images] = items[i];
+			images[num_images].data = items[i]->data;
+			images[num_images].size = items[i]->cb_data;
+			__sync_fetch_and_add(&ctx->bytes_sent, items[i]->cb_data);
+			++num_images;
+		}
+
+		if(num_images > 0) {
+			app_timer_t timer[1];
+			app_timer_start(timer);
+			for(int m = 0; m < num_models; ++m) {
+				predict_images(models[m], images, num_images, results, &lists[m], num_models, pending);
+			}
+			
+			for(int i = 0; i < num_images; ++i) {
+				if(pending[i]->rc) continue;
+				if(num_models > 1) {
+					ai_postprocess_apply_ensemble(ctx->postprocess, &pending[i]->detections, &lists[i * num_models], num_models);
+				}else {
+					ai_detections_t detections = pending[i]->detections;	// swap the buffers
+					pending[i]->detections = lists[i];
+					lists[i] = detections;
+					ai_postprocess_apply(ctx->postprocess, &pending[i]->detections);
+				}
+			}
+			double latency = app_timer_stop(timer);
+			for(int i = 0; i < num_images; ++i) pending[i]->latency = latency;
+		}
+
+		for(int i = 0; i < count; ++i) {
+			free(items[i]->data);	// the writer does not need the image
+			items[i]->data = NULL;
+			batch_queue_push(ctx->write_queue, items[i]);
+		}
+	}
+	for(int i = 0; i < ctx->batch_size * num_models; ++i) ai_detections_clear(&lists[i]);
+	free(lists);
+	free(pending);
+	free(results);
+	free(images);
+	free(items);
+	batch_queue_leave(ctx->write_queue);
+	return NULL;
+}
+
+static void add_latency(batch_context_t * ctx, double latency)
+{
+	if(ctx->num_latencies >= ctx->max_latencies) {
+		long new_size = ctx->max_latencies?(ctx->max_latencies * 2):1024;
+		double * latencies = realloc(ctx->latencies, new_size * sizeof(*latencies));
+		assert(latencies);
+		ctx->latencies = latencies;
+		ctx->max_latencies = new_size;
+	}
+	ctx->latencies[ctx->num_latencies++] = latency;
+}
+
+static int write_result(batch_context_t * ctx, batch_item_t * item, annotation_list_t * list)
+{
+	if(item->rc) return -1;
+
+	annotation_list_reset(list);
+	ssize_t count = annotation_list_add_ai_detections(list, &item->detections);
+	if(count < 0) return -1;
+
+	char label_file[PATH_MAX] = "";
+	make_label_file(label_file, item->path);
+	int rc = list->save(list, label_file);
+	if(rc) return -1;
+
+	ctx->num_detections += count;
+	if(ctx->verbose) printf("%s: %d detections (%.1f ms)\n", item->path, (int)count, item->latency * 1000.0);
+	return 0;
+}
+
+static void writer_loop(batch_context_t * ctx)
+{
+	annotation_list_t list[1];
+	memset(list, 0, sizeof(list));
+	annotation_list_init(list, 0);
+
+	batch_item_t * item = NULL;
+	while((item = batch_queue_pop(ctx->write_queue))) {
+		if(item->latency > 0) add_latency(ctx, item->latency);
+		if(0 == write_result(ctx, item, list)) {
+			++ctx->num_ok;
+			if(ctx->manifest_fp) {
+				fprintf(ctx->manifest_fp, "%s\n", item->path);
+				fflush(ctx->manifest_fp);	// survives a kill
+			}
+		}else {
+			++ctx->num_failed;
+			fprintf(stderr, "[ERROR]: prediction failed: '%s'\n", item->path);
+		}
+		batch_item_free(item);
+	}
+	annotation_list_cleanup(list);
+}
+
+/*************************************************
+ * manifest
+*************************************************/
+static void load_manifest(batch_context_t * ctx)
+{
+	ctx->done = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	if(NULL == ctx->manifest_file) return;
+
+	FILE * fp = fopen(ctx->manifest_file, "r");
+	if(fp) {
+		char line[PATH_MAX] = "";
+		while(fgets(line, sizeof(line), fp)) {
+			char * path = trim(line, line + strlen(line));
+			if(path && path[0]) g_hash_table_add(ctx->done, strdup(path));
+		}
+		fclose(fp);
+	}
+
+	ctx->manifest_fp = fopen(ctx->manifest_file, "a");
+	if(NULL == ctx->manifest_fp) perror(ctx->manifest_file);
+}
+
+static int compare_latency(const void * a, const void * b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double * sorted, long count, double p)
+{
+	if(count <= 0) return 0;
+	long index = (long)(p * (count - 1) + 0.5);
+	return sorted[index];
+}
+
+static void print_stats(batch_context_t * ctx, double time_elapsed)
+{
+	qsort(ctx->latencies, ctx->num_latencies, sizeof(*ctx->latencies), compare_latency);
+	long n = ctx->num_latencies;
+	long processed = ctx->num_ok + ctx->num_failed;
+	if(time_elapsed <= 0) time_elapsed = 1e-9;
+
+	fprintf(stderr, "==== ai-batch: %ld ok, %ld failed, %ld skipped, %ld detections\n",
+		ctx->num_ok, ctx->num_failed, ctx->num_skipped, ctx->num_detections);
+	fprintf(stderr, "  time: %.3f s, throughput: %.2f images/s, %.2f MB/s uploaded\n",
+		time_elapsed, processed / time_elapsed, ctx->bytes_sent / time_elapsed / (1024.0 * 1024.0));
+	if(n > 0) {
+		fprintf(stderr, "  latency (ms): p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+			percentile(ctx->latencies, n, 0.50) * 1000.0,
+			percentile(ctx->latencies, n, 0.90) * 1000.0,
+			percentile(ctx->latencies, n, 0.99) * 1000.0,
+			ctx->latencies[n - 1] * 1000.0);
+	}
+	if(ctx->num_requests > 0) {
+		fprintf(stderr, "  requests: %ld, retries: %ld, avg queue %.1f ms, avg rtt %.1f ms",
+			ctx->num_requests, ctx->num_retries,
+			ctx->queue_time_us / 1000.0 / ctx->num_requests,
+			ctx->rtt_us / 1000.0 / ctx->num_requests);
+		if(ctx->num_server_times > 0) fprintf(stderr, ", avg server %.1f ms", ctx->server_time_us / 1000.0 / ctx->num_server_times);
+		fprintf(stderr, "\n");
+	}
+	if(ctx->num_tiles > 0) {
+		fprintf(stderr, "  tiles: %ld, avg encode %.1f ms, avg predict %.1f ms\n",
+			ctx->num_tiles,
+			ctx->tile_encode_us / 1000.0 / ctx->num_tiles,
+			ctx->tile_predict_us / 1000.0 / ctx->num_tiles);
+	}
+}
+
+static void show_help(const char * exe_name)
+{
+	fprintf(stderr, "usage: %s [options] <folder | image | list_file> ...\n"
+		"  -c, --conf=file         ai-server-url and the ai-score/merge settings (default: conf/annotation-tools.json)\n"
+		"  -u, --url=url           ai-server url, repeat it for several replicas\n"
+		"  -j, --jobs=N            requests in flight (default: 4)\n"
+		"  -q, --queue-size=N      capacity of each stage queue (default: 2 x jobs x batch size)\n"
+		"  -b, --batch-size=N      images per request (default: 1)\n"
+		"  -t, --timeout=seconds   per request (default: 30)\n"
+		"  -r, --retries=N         retries of failed requests, with backoff (default: 2)\n"
+		"  -s, --max-size=N        downscale images larger than NxN before upload (default: 0, off)\n"
+		"  -i, --input-size=N      letterbox to the NxN model input before upload (default: 0, off)\n"
+		"  -T, --tile-size=N       predict images larger than NxN as overlapping NxN tiles (default: 0, off)\n"
+		"  -O, --tile-overlap=r    overlap of the tiles, fraction of the tile size (default: 0.2)\n"
+		"  -C, --tile-jobs=N       tiles in flight per image (default: 4)\n"
+		"  -e, --ensemble=url      another model, its detections are fused with the first one's (wbf), repeatable\n"
+		"  -S, --score=threshold   drop detections below it (default: ai-score-threshold of the config, 0)\n"
+		"  -M, --merge=mode        overlapping boxes: nms, wbf, none (default: ai-merge of the config, nms)\n"
+		"  -m, --manifest=file     done-file used to resume (default: <first input>/.ai-batch.done)\n"
+		"  -f, --force             overwrite existing label files (images in the manifest are still skipped)\n"
+		"  -v, --verbose\n"
+		"  -h, --help\n",
+		exe_name);
+}
+
+int main(int argc, char ** argv)
+{
+	batch_context_t ctx[1];
+	memset(ctx, 0, sizeof(ctx));
+	ctx->num_workers = 4;
+	ctx->batch_size = 1;
+	ctx->timeout = 30;
+	ctx->max_retries = 2;
+	ctx->jpeg_quality = 90;
+	ctx->tile_overlap = 0.2;
+	ctx->tile_concurrency = 4;
+
+	const char * conf_file = "conf/annotation-tools.json";
+	const char * score_threshold = NULL;
+	const char * merge = NULL;
+	static struct option options[] = {
+		{ "conf", required_argument, 0, 'c' },
+		{ "url", required_argument, 0, 'u' },
+		{ "jobs", required_argument, 0, 'j' },
+		{ "queue-size", required_argument, 0, 'q' },
+		{ "batch-size", required_argument, 0, 'b' },
+		{ "timeout", required_argument, 0, 't' },
+		{ "retries", required_argument, 0, 'r' },
+		{ "max-size", required_argument, 0, 's' },
+		{ "input-size", required_argument, 0, 'i' },
+		{ "tile-size", required_argument, 0, 'T' },
+		{ "tile-overlap", required_argument, 0, 'O' },
+		{ "tile-jobs", required_argument, 0, 'C' },
+		{ "ensemble", required_argument, 0, 'e' },
+		{ "score", required_argument, 0, 'S' },
+		{ "merge", required_argument, 0, 'M' },
+		{ "manifest", required_argument, 0, 'm' },
+		{ "force", no_argument, 0, 'f' },
+		{ "verbose", no_argument, 0, 'v' },
+		{ "help", no_argument, 0, 'h' },
+		{ NULL },
+	};
+
+	while(1)
+	{
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "c:u:j:q:b:t:r:s:i:T:O:C:e:S:M:m:fvh", options, &option_index);
+		if(c == -1) break;
+
+		switch(c)
+		{
+		case 'c': conf_file = optarg; break;
+		case 'u':
+			if(NULL == ctx->jserver_urls) ctx->jserver_urls = json_object_new_array();
+			json_object_array_add(ctx->jserver_urls, json_object_new_string(optarg));
+			break;
+		case 'j': ctx->num_workers = atoi(optarg); break;
+		case 'q': ctx->queue_size = atoi(optarg); break;
+		case 'b': ctx->batch_size = atoi(optarg); break;
+		case 't': ctx->timeout = atoi(optarg); break;
+		case 'r': ctx->max_retries = atoi(optarg); break;
+		case 's': ctx->max_size = atoi(optarg); break;
+		case 'i': ctx->input_size = atoi(optarg); break;
+		case 'T': ctx->tile_size = atoi(optarg); break;
+		case 'O': ctx->tile_overlap = atof(optarg); break;
+		case 'C': ctx->tile_concurrency = atoi(optarg); break;
+		case 'e':
+			if(NULL == ctx->jensemble_urls) ctx->jensemble_urls = json_object_new_array();
+			json_object_array_add(ctx->jensemble_urls, json_object_new_string(optarg));
+			break;
+		case 'S': score_threshold = optarg; break;
+		case 'M': merge = optarg; break;
+		case 'm': ctx->manifest_file = optarg; break;
+		case 'f': ctx->force = 1; break;
+		case 'v': ctx->verbose = 1; break;
+		case 'h': show_help(argv[0]); exit(0); break;
+		default:
+			show_help(argv[0]);
+			exit(1);
+		}
+	}
+	if(optind >= argc) {
+		show_help(argv[0]);
+		exit(1);
+	}
+	ctx->inputs = (const char **)argv + optind;
+	ctx->num_inputs = argc - optind;
+
+	// the post-processing settings of the config, overridden by the command line
+	json_object * jconfig = json_object_from_file(conf_file);
+	ai_postprocess_init(ctx->postprocess);
+	if(jconfig) ai_postprocess_load(ctx->postprocess, jconfig);
+	if(score_threshold) ctx->postprocess->score_threshold = atof(score_threshold);
+	if(merge) {
+		ctx->postprocess->merge = ai_postprocess_parse_merge(merge);
+		if(ctx->postprocess->merge < 0) {
+			fprintf(stderr, "[ERROR]: unknown merge mode '%s'\n", merge);
+			exit(1);
+		}
+	}
+
+	if(NULL == ctx->jserver_urls) {
+		json_object * jserver_urls = NULL;
+		if(jconfig && json_object_object_get_ex(jconfig, "ai-server-url", &jserver_urls)) ctx->jserver_urls = json_object_get(jserver_urls);
+	}
+	if(NULL == ctx->jserver_urls) {
+		fprintf(stderr, "[ERROR]: no ai-server url, use '-u' or set 'ai-server-url' in %s\n", conf_file);
+		exit(1);
+	}
+	if(ctx->num_workers < 1) ctx->num_workers = 1;
+	if(ctx->batch_size < 1) ctx->batch_size = 1;
+	if(ctx->tile_concurrency < 1) ctx->tile_concurrency = 1;
+	if(ctx->queue_size < 1) ctx->queue_size = ctx->num_workers * ctx->batch_size * 2;
+
+	char manifest_file[PATH_MAX] = "";
+	if(NULL == ctx->manifest_file) {
+		struct stat st[1];
+		const char * input = ctx->inputs[0];
+		if(0 == stat(input, st) && S_ISDIR(st->st_mode)) snprintf(manifest_file, sizeof(manifest_file), "%s/.ai-batch.done", input);
+		else snprintf(manifest_file, sizeof(manifest_file), ".ai-batch.done");
+		ctx->manifest_file = manifest_file;
+	}
+	load_manifest(ctx);
+
+	ctx->num_models = 1;
+	if(ctx->jensemble_urls) ctx->num_models += json_object_array_length(ctx->jensemble_urls);
+	ctx->models = calloc(ctx->num_models, sizeof(*ctx->models));
+	assert(ctx->models);
+	ctx->models[0] = new_client(ctx, ctx->jserver_urls);
+	for(int m = 1; m < ctx->num_models; ++m) ctx->models[m] = new_client(ctx, json_object_array_get_idx(ctx->jensemble_urls, m - 1));
+
+	batch_queue_init(ctx->read_queue, ctx->queue_size, 1);
+	batch_queue_init(ctx->infer_queue, ctx->queue_size, 1);
+	batch_queue_init(ctx->write_queue, ctx->queue_size, ctx->num_workers);
+
+	app_timer_t timer[1];
+	app_timer_start(timer);
+
+	pthread_t reader, resizer;
+	pthread_t * workers = calloc(ctx->num_workers, sizeof(*workers));
+	assert(workers);
+
+	int rc = pthread_create(&reader, NULL, reader_thread, ctx);
+	assert(0 == rc);
+	if(ctx->max_size > 0) {
+		rc = pthread_create(&resizer, NULL, resize_thread, ctx);
+		assert(0 == rc);
+	}
+	for(int i = 0; i < ctx->num_workers; ++i) {
+		rc = pthread_create(&workers[i], NULL, infer_thread, ctx);
+		assert(0 == rc);
+	}
+
+	writer_loop(ctx);
+
+	pthread_join(reader, NULL);
+	if(ctx->max_size > 0) pthread_join(resizer, NULL);
+	for(int i = 0; i < ctx->num_workers; ++i) pthread_join(workers[i], NULL);
+	free(workers);
+	for(int m = 0; m < ctx->num_models; ++m) {
+		ai_client_free(ctx->models[m]);
+	}
+	free(ctx->models);
+
+	print_stats(ctx, app_timer_stop(timer));
+
+	batch_queue_cleanup(ctx->read_queue);
+	batch_queue_cleanup(ctx->infer_queue);
+	batch_queue_cleanup(ctx->write_queue);
+	if(ctx->manifest_fp) fclose(ctx->manifest_fp);
+	g_hash_table_destroy(ctx->done);
+	free(ctx->latencies);
+	json_object_put(ctx->jserver_urls);
+	if(ctx->jensemble_urls) json_object_put(ctx->jensemble_urls);
+	ai_postprocess_cleanup(ctx->postprocess);
+	if(jconfig) json_object_put(jconfig);
+
+	return (ctx->num_failed > 0);
+}
@@ -0,0 +1,239 @@
+/*
+ * ai-ipc-server.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * ai-ipc-server: reference server of the local transport (include/ai-ipc.h).
+ *
+ *   one thread per connection: maps the client's ring, answers every PREDICT with a RESULT record.
+ *   The detections are derived from a hash of the pixels, the same image always gets the same boxes;
+ *   a real server runs its model on the pixels instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ai-ipc.h"
+
+typedef struct ipc_server
+{
+	const char * socket_path;
+	int num_classes;
+	int delay_ms;		// per image
+}ipc_server_t;
+
+typedef struct ipc_connection
+{
+	ipc_server_t * server;
+	int sock;
+}ipc_connection_t;
+
+static uint64_t hash_pixels(const unsigned char * data, size_t width, size_t height, size_t stride)	// FNV-1a
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(size_t y = 0; y < height; ++y) {
+		const unsigned char * row = data + y * stride;
+		for(size_t x = 0; x < width * 4; ++x) {
+			hash ^= row[x];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	return hash;
+}
+
+static uint32_t fake_detections(ipc_server_t * server, uint64_t hash, ai_ipc_detection_t * detections)
+{
+	uint32_t num_detections = 1 + (uint32_t)(hash % 3);
+	for(uint32_t i = 0; i < num_detections; ++i) {
+		hash = hash * 6364136223846793005ULL + 1442695040888963407ULL;
+		ai_ipc_detection_t * det = &detections[i];
+		det->width = 0.1f + (float)((hash >> 16) & 0xff) / 255.0f * 0.3f;
+		det->height = 0.1f + (float)((hash >> 24) & 0xff) / 255.0f * 0.3f;
+		det->left = (float)((hash >> 32) & 0xff) / 255.0f * (1.0f - det->width);
+		det->top = (float)((hash >> 40) & 0xff) / 255.0f * (1.0f - det->height);
+		det->class_index = (int32_t)((hash >> 48) % server->num_classes);
+		det->score = 0.5f + (float)((hash >> 56) & 0x7f) / 255.0f;
+	}
+	return num_detections;
+}
+
+static void * connection_thread(void * user_data)
+{
+	ipc_connection_t * conn = user_data;
+	ipc_server_t * server = conn->server;
+	int sock = conn->sock;
+	free(conn);
+
+	ai_ipc_header_t header;
+	ai_ipc_hello_t hello = { 0 };
+	int fd = -1;
+	unsigned char * ring = MAP_FAILED;
+
+	int rc = ai_ipc_recv_msg(sock, &header, &hello, sizeof(hello), &fd);
+	if(rc || header.type != AI_IPC_HELLO || header.length != sizeof(hello) || fd < 0) {
+		fprintf(stderr, "[ERROR]: invalid hello\n");
+		goto label_cleanup;
+	}
+
+	struct stat st[1];
+	if(fstat(fd, st) || (uint64_t)st->st_size < hello.ring_size) goto label_cleanup;
+	ring = mmap(NULL, hello.ring_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(ring == MAP_FAILED) goto label_cleanup;
+
+	struct {
+		ai_ipc_result_t result;
+		ai_ipc_detection_t detections[3];
+	}reply;
+
+	while(1) {
+		ai_ipc_image_t image;
+		rc = ai_ipc_recv_msg(sock, &header, &image, sizeof(image), NULL);
+		if(rc) break;	// closed
+		if(header.type != AI_IPC_PREDICT || header.length != sizeof(image)) break;
+
+		memset(&reply, 0, sizeof(reply));
+		if(image.format != AI_IPC_FORMAT_BGRA8 || image.stride < (uint64_t)image.width * 4
+			|| image.offset > hello.ring_size
+			|| (uint64_t)image.stride * image.height > hello.ring_size - image.offset)
+		{
+			reply.result.status = -1;
+		}else {
+			uint64_t hash = hash_pixels(ring + image.offset, image.width, image.height, image.stride);
+			reply.result.num_detections = fake_detections(server, hash, reply.detections);
+			if(server->delay_ms > 0) usleep(server->delay_ms * 1000);
+		}
+
+		uint32_t length = sizeof(reply.result) + reply.result.num_detections * sizeof(ai_ipc_detection_t);
+		rc = ai_ipc_send_msg(sock, AI_IPC_RESULT, header.id, &reply, length, -1);
+		if(rc) break;
+	}
+
+label_cleanup:
+	if(ring != MAP_FAILED) munmap(ring, hello.ring_size);
+	if(fd >= 0) close(fd);
+	close(sock);
+	return NULL;
+}
+
+static void show_help(const char * exe_name)
+{
+	fprintf(stderr, "usage: %s [options]\n"
+		"  -s, --socket=path       (default: /tmp/ai-ipc.sock)\n"
+		"  -n, --classes=N         class indices 0 ~ N-1 (default: 80)\n"
+		"  -d, --delay=ms          per image\n"
+		"  -h, --help\n",
+		exe_name);
+}
+
+int main(int argc, char ** argv)
+{
+	ipc_server_t server[1] = {{
+		.socket_path = "/tmp/ai-ipc.sock",
+		.num_classes = 80,
+	}};
+
+	static struct option options[] = {
+		{ "socket", required_argument, 0, 's' },
+		{ "classes", required_argument, 0, 'n' },
+		{ "delay", required_argument, 0, 'd' },
+		{ "help", no_argument, 0, 'h' },
+		{ NULL },
+	};
+
+	while(1)
+	{
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "s:n:d:h", options, &option_index);
+		if(c == -1) break;
+
+		switch(c)
+		{
+		case 's': server->socket_path = optarg; break;
+		case 'n': server->num_classes = atoi(optarg); break;
+		case 'd': server->delay_ms = atoi(optarg); break;
+		case 'h': show_help(argv[0]); exit(0); break;
+		default:
+			show_help(argv[0]);
+			exit(1);
+		}
+	}
+	if(server->num_classes < 1) server->num_classes = 1;
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(server->socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "[ERROR]: socket path too long: %s\n", server->socket_path);
+		exit(1);
+	}
+	strcpy(addr.sun_path, server->socket_path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	assert(sock >= 0);
+	unlink(server->socket_path);
+	if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, 16)) {
+		perror(server->socket_path);
+		exit(1);
+	}
+	fprintf(stderr, "ai-ipc-server: unix:%s\n", server->socket_path);
+
+	while(1) {
+		int client = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+		if(client < 0) {
+			if(errno == EINTR) continue;
+			perror("accept");
+			break;
+		}
+
+		ipc_connection_t * conn = calloc(1, sizeof(*conn));
+		assert(conn);
+		conn->server = server;
+		conn->sock = client;
+
+		pthread_t th;
+		if(pthread_create(&th, NULL, connection_thread, conn)) {
+			close(client);
+			free(conn);
+			continue;
+		}
+		pthread_detach(th);
+	}
+
+	close(sock);
+	unlink(server->socket_path);
+	return 0;
+}
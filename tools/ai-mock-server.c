@@ -0,0 +1,291 @@
+/*
+ * ai-mock-server.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * ai-mock-server: stands in for the ai-server when testing the client and the tools.
+ *
+ *   POST <path> with an image body (image/jpeg, image/png)
+ *       ==> { "detections": [ { "class_index", "left", "top", "width", "height" }, ... ] }
+ *   POST <path> with multipart/form-data, one part per image
+ *       ==> { "results": [ { "detections": [...] }, ... ] }, in the order of the parts
+ *
+ * The detections are derived from a hash of the image bytes: the same image always gets the same boxes.
+ * --delay and --image-delay simulate the inference time of a request and of each image in it,
+ * reported in a Server-Timing header; --fail-rate answers some requests with 503.
+ * A delayed request is paused and answered from a timer: the simulated inference of concurrent
+ * requests overlaps, as on a server running several models at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <getopt.h>
+
+#include <libsoup/soup.h>
+#include <json-c/json.h>
+
+typedef struct mock_server
+{
+	int port;
+	const char * path;
+	int num_classes;
+	int delay_ms;			// per request
+	int image_delay_ms;		// per image
+	int fail_rate;			// percent of the requests answered with 503
+
+	long num_requests;
+	long num_images;
+}mock_server_t;
+
+static uint64_t hash_bytes(const unsigned char * data, size_t length)	// FNV-1a
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static json_object * fake_result(mock_server_t * server, const unsigned char * data, size_t length)
+{
+	uint64_t hash = hash_bytes(data, length);
+	int num_detections = 1 + (int)(hash % 3);
+
+	json_object * jdetections = json_object_new_array();
+	for(int i = 0; i < num_detections; ++i) {
+		hash = hash * 6364136223846793005ULL + 1442695040888963407ULL;
+		double width = 0.1 + (double)((hash >> 16) & 0xff) / 255.0 * 0.3;
+		double height = 0.1 + (double)((hash >> 24) & 0xff) / 255.0 * 0.3;
+		double left = (double)((hash >> 32) & 0xff) / 255.0 * (1.0 - width);
+		double top = (double)((hash >> 40) & 0xff) / 255.0 * (1.0 - height);
+
+		json_object * jdet = json_object_new_object();
+		json_object_object_add(jdet, "class_index", json_object_new_int((int)((hash >> 48) % server->num_classes)));
+		json_object_object_add(jdet, "left", json_object_new_double(left));
+		json_object_object_add(jdet, "top", json_object_new_double(top));
+		json_object_object_add(jdet, "width", json_object_new_double(width));
+		json_object_object_add(jdet, "height", json_object_new_double(height));
+		json_object_array_add(jdetections, jdet);
+	}
+
+	json_object * jresult = json_object_new_object();
+	json_object_object_add(jresult, "detections", jdetections);
+
+	++server->num_images;
+	return jresult;
+}
+
+static json_object * predict_multipart(mock_server_t * server, SoupMessage * msg)
+{
+	SoupMultipart * multipart = soup_multipart_new_from_message(msg->request_headers, msg->request_body);
+	if(NULL == multipart) return NULL;
+
+	json_object * jresults = json_object_new_array();
+	int num_parts = soup_multipart_get_length(multipart);
+	for(int i = 0; i < num_parts; ++i) {
+		SoupMessageHeaders * headers = NULL;
+		SoupBuffer * body = NULL;
+		if(!soup_multipart_get_part(multipart, i, &headers, &body)) continue;
+		json_object_array_add(jresults, fake_result(server, (const unsigned char *)body->data, body->length));
+	}
+	soup_multipart_free(multipart);
+
+	json_object * jresponse = json_object_new_object();
+	json_object_object_add(jresponse, "results", jresults);
+	return jresponse;
+}
+
+typedef struct delayed_response
+{
+	SoupServer * soup_server;
+	SoupMessage * msg;
+	gint64 begin;
+	gulong finished_handler;
+	int finished;		// the client went away while the message was paused
+}delayed_response_t;
+
+static void set_server_timing(SoupMessage * msg, gint64 begin)
+{
+	char server_timing[64] = "";
+	snprintf(server_timing, sizeof(server_timing), "inference;dur=%.3f", (g_get_monotonic_time() - begin) / 1000.0);
+	soup_message_headers_replace(msg->response_headers, "Server-Timing", server_timing);
+}
+
+static void on_delayed_finished(SoupMessage * msg, delayed_response_t * delayed)
+{
+	delayed->finished = 1;
+}
+
+static gboolean on_delay_timeout(delayed_response_t * delayed)
+{
+	SoupMessage * msg = delayed->msg;
+	g_signal_handler_disconnect(msg, delayed->finished_handler);
+	if(!delayed->finished) {
+		set_server_timing(msg, delayed->begin);
+		soup_server_unpause_message(delayed->soup_server, msg);
+	}
+	g_object_unref(msg);
+	free(delayed);
+	return G_SOURCE_REMOVE;
+}
+
+static void on_predict(SoupServer * soup_server, SoupMessage * msg, const char * path,
+	GHashTable * query, SoupClientContext * client, gpointer user_data)
+{
+	mock_server_t * server = user_data;
+	if(msg->method != SOUP_METHOD_POST) {
+		soup_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED);
+		return;
+	}
+
+	SoupMessageBody * request_body = msg->request_body;
+	if(NULL == request_body || request_body->length <= 0) {
+		soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
+		return;
+	}
+
+	++server->num_requests;
+	if(server->fail_rate > 0 && g_random_int_range(0, 100) < server->fail_rate) {
+		soup_message_set_status(msg, SOUP_STATUS_SERVICE_UNAVAILABLE);
+		return;
+	}
+
+	gint64 begin = g_get_monotonic_time();
+	long num_images = server->num_images;
+	json_object * jresponse = NULL;
+	const char * content_type = soup_message_headers_get_content_type(msg->request_headers, NULL);
+	if(content_type && 0 == strncmp(content_type, "multipart/", sizeof("multipart/") - 1)) {
+		jresponse = predict_multipart(server, msg);
+	}else {
+		jresponse = fake_result(server, (const unsigned char *)request_body->data, request_body->length);
+	}
+	if(NULL == jresponse) {
+		soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
+		return;
+	}
+
+	size_t length = 0;
+	const char * response = json_object_to_json_string_length(jresponse, JSON_C_TO_STRING_PLAIN, &length);
+	soup_message_set_status(msg, SOUP_STATUS_OK);
+	soup_message_set_response(msg, "application/json", SOUP_MEMORY_COPY, response, length);
+	json_object_put(jresponse);
+	
+	// simulated inference time: answered later from the main loop, without blocking the other connections
+	long delay_ms = server->delay_ms + server->image_delay_ms * (server->num_images - num_images);
+	if(delay_ms > 0) {
+		delayed_response_t * delayed = calloc(1, sizeof(*delayed));
+		assert(delayed);
+		delayed->soup_server = soup_server;
+		delayed->msg = g_object_ref(msg);
+		delayed->begin = begin;
+		delayed->finished_handler = g_signal_connect(msg, "finished", G_CALLBACK(on_delayed_finished), delayed);
+		soup_server_pause_message(soup_server, msg);
+		g_timeout_add(delay_ms, (GSourceFunc)on_delay_timeout, delayed);
+	}else {
+		set_server_timing(msg, begin);
+	}
+
+	if((server->num_requests % 100) == 0) {
+		fprintf(stderr, "== %ld requests, %ld images\n", server->num_requests, server->num_images);
+	}
+}
+
+static void show_help(const char * exe_name)
+{
+	fprintf(stderr, "usage: %s [options]\n"
+		"  -p, --port=port         (default: 9090)\n"
+		"  -P, --path=path         (default: /ai)\n"
+		"  -n, --classes=N         class indices 0 ~ N-1 (default: 80)\n"
+		"  -d, --delay=ms          per request\n"
+		"  -D, --image-delay=ms    per image\n"
+		"  -e, --fail-rate=percent answer with 503 (to test the client's retries)\n"
+		"  -h, --help\n",
+		exe_name);
+}
+
+int main(int argc, char ** argv)
+{
+	mock_server_t server[1] = {{
+		.port = 9090,
+		.path = "/ai",
+		.num_classes = 80,
+	}};
+
+	static struct option options[] = {
+		{ "port", required_argument, 0, 'p' },
+		{ "path", required_argument, 0, 'P' },
+		{ "classes", required_argument, 0, 'n' },
+		{ "delay", required_argument, 0, 'd' },
+		{ "image-delay", required_argument, 0, 'D' },
+		{ "fail-rate", required_argument, 0, 'e' },
+		{ "help", no_argument, 0, 'h' },
+		{ NULL },
+	};
+
+	while(1)
+	{
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "p:P:n:d:D:e:h", options, &option_index);
+		if(c == -1) break;
+
+		switch(c)
+		{
+		case 'p': server->port = atoi(optarg); break;
+		case 'P': server->path = optarg; break;
+		case 'n': server->num_classes = atoi(optarg); break;
+		case 'd': server->delay_ms = atoi(optarg); break;
+		case 'D': server->image_delay_ms = atoi(optarg); break;
+		case 'e': server->fail_rate = atoi(optarg); break;
+		case 'h': show_help(argv[0]); exit(0); break;
+		default:
+			show_help(argv[0]);
+			exit(1);
+		}
+	}
+	if(server->num_classes < 1) server->num_classes = 1;
+
+	SoupServer * soup_server = soup_server_new(SOUP_SERVER_SERVER_HEADER, "ai-mock-server", NULL);
+	assert(soup_server);
+	soup_server_add_handler(soup_server, server->path, (SoupServerCallback)on_predict, server, NULL);
+
+	GError * gerr = NULL;
+	gboolean ok = soup_server_listen_local(soup_server, server->port, 0, &gerr);
+	if(!ok) {
+		fprintf(stderr, "[ERROR]: listen on port %d failed: %s\n", server->port, gerr?gerr->message:"");
+		if(gerr) g_error_free(gerr);
+		exit(1);
+	}
+	fprintf(stderr, "ai-mock-server: http://127.0.0.1:%d%s\n", server->port, server->path);
+
+	GMainLoop * loop = g_main_loop_new(NULL, FALSE);
+	g_main_loop_run(loop);
+
+	g_main_loop_unref(loop);
+	g_object_unref(soup_server);
+	return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * img_adjust.c
+ *
+ * Copyright 2020 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <math.h>
+
+#include "img_proc.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MAX_STATS_SAMPLES (1 << 20)	// statistics are gathered from (at most) 1M pixels
+#define MAX_CLAHE_GAIN (2047)		// 8.8 fixed point, ~8x
+
+void img_adjustments_init(img_adjustments_t * adj)
+{
+	assert(adj);
+	memset(adj, 0, sizeof(*adj));
+	adj->contrast = 1.0;
+	adj->gamma = 1.0;
+	adj->clahe_clip_limit = 2.0;
+	return;
+}
+
+int img_adjustments_is_identity(const img_adjustments_t * adj)
+{
+	if(NULL == adj) return 1;
+	return (adj->brightness == 0.0 && adj->contrast == 1.0 && adj->gamma == 1.0
+		&& !adj->auto_levels && !adj->clahe);
+}
+
+static inline int get_sample_step(const bgra_image_t * image)
+{
+	double pixels = (double)image->width * (double)image->height;
+	int step = (int)ceil(sqrt(pixels / MAX_STATS_SAMPLES));
+	return (step < 1)?1:step;
+}
+
+static inline int luma(const unsigned char * p)
+{
+	return (29 * p[0] + 150 * p[1] + 77 * p[2]) >> 8;	// BGRA
+}
+
+/*
+ * img_lut_build():
+ *   auto-levels (optional, from 'image') --> contrast / brightness --> gamma
+ */
+void img_lut_build(img_lut_t * lut, const img_adjustments_t * adj, const bgra_image_t * image)
+{
+	assert(lut && adj);
+
+	int lo[3] = { 0, 0, 0 };
+	int hi[3] = { 255, 255, 255 };
+	if(adj->auto_levels && image && image->data)
+	{
+		uint32_t hist[3][256];
+		memset(hist, 0, sizeof(hist));
+
+		int step = get_sample_step(image);
+		int stride = (image->stride > 0)?image->stride:(image->width * 4);
+		size_t count = 0;
+		for(int y = 0; y < image->height; y += step)
+		{
+			const unsigned char * p = image->data + (size_t)y * stride;
+			for(int x = 0; x < image->width; x += step, p += step * 4)
+			{
+				++hist[0][p[0]];
+				++hist[1][p[1]];
+				++hist[2][p[2]];
+			}
+			count += (image->width + step - 1) / step;
+		}
+
+		size_t clip = count / 200;	// 0.5%
+		for(int c = 0; c < 3; ++c)
+		{
+			size_t sum = 0;
+			while(lo[c] < 255 && (sum += hist[c][lo[c]]) <= clip) ++lo[c];
+			sum = 0;
+			while(hi[c] > 0 && (sum += hist[c][hi[c]]) <= clip) --hi[c];
+			if(hi[c] <= lo[c]) { lo[c] = 0; hi[c] = 255; }
+		}
+	}
+
+	double contrast = (adj->contrast > 0)?adj->contrast:1.0;
+	double inv_gamma = 1.0 / ((adj->gamma > 0)?adj->gamma:1.0);
+	for(int c = 0; c < 3; ++c)
+	{
+		double range = hi[c] - lo[c];
+		for(int v = 0; v < 256; ++v)
+		{
+			double x = (v - lo[c]) / range;
+			x = (x - 0.5) * contrast + 0.5 + adj->brightness;
+			if(x < 0) x = 0;
+			else if(x > 1) x = 1;
+			if(inv_gamma != 1.0) x = pow(x, inv_gamma);
+			lut->bgr[c][v] = (unsigned char)lrint(x * 255.0);
+		}
+	}
+	return;
+}
+
+/*
+ * bgra_apply_lut():
+ *   a 256-entry byte table per channel is a gather, SSE2/AVX2 have no byte gather
+ *   and pshufb-emulated 256-entry tables are slower than the plain L1-resident lookups below.
+ */
+void bgra_apply_lut(unsigned char * data, int width, int height, int stride, const img_lut_t * lut)
+{
+	assert(data && lut);
+	const unsigned char * restrict lut_b = lut->bgr[0];
+	const unsigned char * restrict lut_g = lut->bgr[1];
+	const unsigned char * restrict lut_r = lut->bgr[2];
+
+	for(int y = 0; y < height; ++y)
+	{
+		unsigned char * restrict p = data + (size_t)y * stride;
+		int x = 0;
+		for(; x + 4 <= width; x += 4, p += 16)
+		{
+			p[0] = lut_b[p[0]];  p[1] = lut_g[p[1]];  p[2] = lut_r[p[2]];
+			p[4] = lut_b[p[4]];  p[5] = lut_g[p[5]];  p[6] = lut_r[p[6]];
+			p[8] = lut_b[p[8]];  p[9] = lut_g[p[9]];  p[10] = lut_r[p[10]];
+			p[12] = lut_b[p[12]]; p[13] = lut_g[p[13]]; p[14] = lut_r[p[14]];
+		}
+		for(; x < width; ++x, p += 4)
+		{
+			p[0] = lut_b[p[0]]; p[1] = lut_g[p[1]]; p[2] = lut_r[p[2]];
+		}
+	}
+	return;
+}
+
+/******************************************************************************
+ * CLAHE:
+ *   per-tile luma histograms of the whole image (sampled), clipped and equalized.
+ *   Display pixels interpolate the 4 nearest tile mappings and scale b, g, r by mapped / luma.
+******************************************************************************/
+int img_clahe_build(img_clahe_t * clahe, const bgra_image_t * image, int tiles_x, int tiles_y, double clip_limit)
+{
+	assert(clahe && image && image->data);
+	if(tiles_x < 1) tiles_x = 8;
+	if(tiles_y < 1) tiles_y = 8;
+	if(clip_limit < 1.0) clip_limit = 1.0;
+
+	int num_tiles = tiles_x * tiles_y;
+	uint32_t * hists = calloc((size_t)num_tiles * 256, sizeof(*hists));
+	unsigned char * luts = realloc(clahe->luts, (size_t)num_tiles * 256);
+	if(NULL == hists || NULL == luts) {
+		free(hists);
+		if(luts) clahe->luts = luts;
+		return -1;
+	}
+	clahe->luts = luts;
+	clahe->tiles_x = tiles_x;
+	clahe->tiles_y = tiles_y;
+
+	int step = get_sample_step(image);
+	int stride = (image->stride > 0)?image->stride:(image->width * 4);
+	for(int y = 0; y < image->height; y += step)
+	{
+		int ty = (int)((int64_t)y * tiles_y / image->height);
+		const unsigned char * p = image->data + (size_t)y * stride;
+		for(int x = 0; x < image->width; x += step, p += step * 4)
+		{
+			int tx = (int)((int64_t)x * tiles_x / image->width);
+			++hists[((size_t)ty * tiles_x + tx) * 256 + luma(p)];
+		}
+	}
+
+	for(int i = 0; i < num_tiles; ++i)
+	{
+		uint32_t * hist = hists + (size_t)i * 256;
+		unsigned char * lut = luts + (size_t)i * 256;
+
+		uint64_t total = 0;
+		for(int v = 0; v < 256; ++v) total += hist[v];
+		if(0 == total) {
+			for(int v = 0; v < 256; ++v) lut[v] = v;
+			continue;
+		}
+
+		// clip and redistribute the excess uniformly
+		uint32_t limit = (uint32_t)ceil(clip_limit * (double)total / 256.0);
+		uint64_t excess = 0;
+		for(int v = 0; v < 256; ++v)
+		{
+			if(hist[v] > limit) { excess += hist[v] - limit; hist[v] = limit; }
+		}
+		uint32_t bonus = (uint32_t)(excess / 256);
+		uint32_t residual = (uint32_t)(excess % 256);
+
+		uint64_t cdf = 0;
+		for(int v = 0; v < 256; ++v)
+		{
+			cdf += hist[v] + bonus + ((uint32_t)v < residual);
+			lut[v] = (unsigned char)((cdf * 255 + total / 2) / total);
+		}
+	}
+	free(hists);
+	return 0;
+}
+
+void img_clahe_cleanup(img_clahe_t * clahe)
+{
+	if(NULL == clahe) return;
+	free(clahe->luts);
+	memset(clahe, 0, sizeof(*clahe));
+	return;
+}
+
+static inline void get_tile_weight(double pos, int num_tiles, int * t0, int * t1, int * weight)
+{
+	double f = pos * num_tiles - 0.5;
+	int t = (int)floor(f);
+	int w = (int)((f - t) * 256);
+	if(t < 0) { t = 0; w = 0; }
+	if(t >= num_tiles - 1) { t = num_tiles - 1; w = 0; }
+	*t0 = t;
+	*t1 = (t + 1 < num_tiles)?(t + 1):t;
+	*weight = w;
+}
+
+#ifdef __SSE2__
+// b, g, r of 4 pixels scaled by (gain / 256), alpha is kept
+static inline void apply_gains_4(unsigned char * p, const uint16_t gains[4])
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i px = _mm_loadu_si128((const __m128i *)p);
+	__m128i lo = _mm_unpacklo_epi8(zero, px);	// (c << 8)
+	__m128i hi = _mm_unpackhi_epi8(zero, px);
+	__m128i g_lo = _mm_set_epi16(256, gains[1], gains[1], gains[1], 256, gains[0], gains[0], gains[0]);
+	__m128i g_hi = _mm_set_epi16(256, gains[3], gains[3], gains[3], 256, gains[2], gains[2], gains[2]);
+	lo = _mm_mulhi_epu16(lo, g_lo);
+	hi = _mm_mulhi_epu16(hi, g_hi);
+	_mm_storeu_si128((__m128i *)p, _mm_packus_epi16(lo, hi));
+}
+#endif
+
+static inline void apply_gain_1(unsigned char * p, uint16_t gain)
+{
+	for(int c = 0; c < 3; ++c)
+	{
+		unsigned int v = ((unsigned int)p[c] * gain) >> 8;
+		p[c] = (v > 255)?255:v;
+	}
+}
+
+void bgra_apply_clahe(unsigned char * data, int width, int height, int stride, const img_clahe_t * clahe,
+	double u0, double v0, double du, double dv)
+{
+	assert(data && clahe && clahe->luts);
+	if(width <= 0 || height <= 0) return;
+
+	int tiles_x = clahe->tiles_x;
+	int tiles_y = clahe->tiles_y;
+
+	// horizontal interpolation coefficients are shared by all rows
+	int * cols = malloc(sizeof(*cols) * width * 3);
+	assert(cols);
+	for(int x = 0; x < width; ++x)
+	{
+		get_tile_weight(u0 + x * du, tiles_x, &cols[x * 3], &cols[x * 3 + 1], &cols[x * 3 + 2]);
+	}
+
+	for(int y = 0; y < height; ++y)
+	{
+		int ty0, ty1, wy;
+		get_tile_weight(v0 + y * dv, tiles_y, &ty0, &ty1, &wy);
+		const unsigned char * row0 = clahe->luts + (size_t)ty0 * tiles_x * 256;
+		const unsigned char * row1 = clahe->luts + (size_t)ty1 * tiles_x * 256;
+
+		unsigned char * p = data + (size_t)y * stride;
+		uint16_t gains[4];
+		int x = 0;
+		for(; x < width; ++x, p += 4)
+		{
+			int tx0 = cols[x * 3], tx1 = cols[x * 3 + 1], wx = cols[x * 3 + 2];
+			int v = luma(p);
+			int top = row0[tx0 * 256 + v] * (256 - wx) + row0[tx1 * 256 + v] * wx;
+			int bottom = row1[tx0 * 256 + v] * (256 - wx) + row1[tx1 * 256 + v] * wx;
+			int mapped = (top * (256 - wy) + bottom * wy) >> 16;
+
+			int gain = ((mapped + 1) << 8) / (v + 1);
+			if(gain > MAX_CLAHE_GAIN) gain = MAX_CLAHE_GAIN;
+			gains[x & 3] = (uint16_t)gain;
+
+#ifdef __SSE2__
+			if((x & 3) == 3) apply_gains_4(p - 12, gains);
+#else
+			apply_gain_1(p, gains[x & 3]);
+#endif
+		}
+#ifdef __SSE2__
+		// tail: the last (width % 4) pixels
+		for(int i = width & ~3; i < width; ++i)
+		{
+			apply_gain_1(data + (size_t)y * stride + i * 4, gains[i & 3]);
+		}
+#endif
+	}
+	free(cols);
+	return;
+}
@@ -0,0 +1,281 @@
+/*
+ * img_gradient.c
+ *
+ * Copyright 2020 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "img_proc.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+int img_gradient_init(img_gradient_t * grad, const bgra_image_t * image, int tile_size)
+{
+	assert(grad && image && image->data);
+	if(tile_size < 16) tile_size = 16;
+
+	img_gradient_cleanup(grad);
+	grad->image = image;
+	grad->tile_size = tile_size;
+	grad->tiles_x = (image->width + tile_size - 1) / tile_size;
+	grad->tiles_y = (image->height + tile_size - 1) / tile_size;
+	grad->tiles = calloc(grad->tiles_x * grad->tiles_y, sizeof(*grad->tiles));
+	assert(grad->tiles);
+	return 0;
+}
+
+void img_gradient_reset(img_gradient_t * grad)
+{
+	if(NULL == grad || NULL == grad->tiles) return;
+	for(int i = 0; i < grad->tiles_x * grad->tiles_y; ++i)
+	{
+		img_gradient_tile_t * tile = &grad->tiles[i];
+		free(tile->col_sums);
+		free(tile->row_sums);
+		tile->col_sums = NULL;
+		tile->row_sums = NULL;
+	}
+	return;
+}
+
+void img_gradient_cleanup(img_gradient_t * grad)
+{
+	if(NULL == grad) return;
+	img_gradient_reset(grad);
+	free(grad->tiles);
+	memset(grad, 0, sizeof(*grad));
+	return;
+}
+
+static inline int clamp_int(int value, int min_value, int max_value)
+{
+	if(value < min_value) return min_value;
+	if(value > max_value) return max_value;
+	return value;
+}
+
+/*
+ * sobel_row(): |Gx| and |Gy| of one row,
+ *   top / mid / bottom: luma rows with one pixel of padding on each side.
+ */
+static void sobel_row(const int16_t * top, const int16_t * mid, const int16_t * bottom, int cx,
+	int16_t * abs_gx, int16_t * abs_gy)
+{
+	int x = 0;
+#ifdef __SSE2__
+	for(; x + 8 <= cx; x += 8)
+	{
+		__m128i tl = _mm_loadu_si128((const __m128i *)(top + x));
+		__m128i tc = _mm_loadu_si128((const __m128i *)(top + x + 1));
+		__m128i tr = _mm_loadu_si128((const __m128i *)(top + x + 2));
+		__m128i ml = _mm_loadu_si128((const __m128i *)(mid + x));
+		__m128i mr = _mm_loadu_si128((const __m128i *)(mid + x + 2));
+		__m128i bl = _mm_loadu_si128((const __m128i *)(bottom + x));
+		__m128i bc = _mm_loadu_si128((const __m128i *)(bottom + x + 1));
+		__m128i br = _mm_loadu_si128((const __m128i *)(bottom + x + 2));
+
+		// gx = (tr + 2 * mr + br) - (tl + 2 * ml + bl)
+		__m128i gx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(tr, br), _mm_slli_epi16(mr, 1)),
+			_mm_add_epi16(_mm_add_epi16(tl, bl), _mm_slli_epi16(ml, 1)));
+		// gy = (bl + 2 * bc + br) - (tl + 2 * tc + tr)
+		__m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(bl, br), _mm_slli_epi16(bc, 1)),
+			_mm_add_epi16(_mm_add_epi16(tl, tr), _mm_slli_epi16(tc, 1)));
+
+		gx = _mm_max_epi16(gx, _mm_sub_epi16(_mm_setzero_si128(), gx));
+		gy = _mm_max_epi16(gy, _mm_sub_epi16(_mm_setzero_si128(), gy));
+		_mm_storeu_si128((__m128i *)(abs_gx + x), gx);
+		_mm_storeu_si128((__m128i *)(abs_gy + x), gy);
+	}
+#endif
+	for(; x < cx; ++x)
+	{
+		int gx = (top[x + 2] + 2 * mid[x + 2] + bottom[x + 2]) - (top[x] + 2 * mid[x] + bottom[x]);
+		int gy = (bottom[x] + 2 * bottom[x + 1] + bottom[x + 2]) - (top[x] + 2 * top[x + 1] + top[x + 2]);
+		abs_gx[x] = (gx < 0)?-gx:gx;
+		abs_gy[x] = (gy < 0)?-gy:gy;
+	}
+	return;
+}
+
+// dst[x] = src[x] + values[x]
+static void accumulate_row(uint32_t * dst, const uint32_t * src, const int16_t * values, int cx)
+{
+	int x = 0;
+#ifdef __SSE2__
+	for(; x + 8 <= cx; x += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(values + x));	// 0 ~ 1020
+		__m128i lo = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+		__m128i hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(src + x)), lo));
+		_mm_storeu_si128((__m128i *)(dst + x + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(src + x + 4)), hi));
+	}
+#endif
+	for(; x < cx; ++x) dst[x] = src[x] + values[x];
+	return;
+}
+
+static const img_gradient_tile_t * get_tile(img_gradient_t * grad, int tile_x, int tile_y)
+{
+	img_gradient_tile_t * tile = &grad->tiles[tile_y * grad->tiles_x + tile_x];
+	if(tile->col_sums) return tile;
+
+	const bgra_image_t * image = grad->image;
+	int stride = (image->stride > 0)?image->stride:(image->width * 4);
+	int x0 = tile_x * grad->tile_size;
+	int y0 = tile_y * grad->tile_size;
+	int cx = image->width - x0;
+	int cy = image->height - y0;
+	if(cx > grad->tile_size) cx = grad->tile_size;
+	if(cy > grad->tile_size) cy = grad->tile_size;
+
+	// luma of the tile plus a one pixel border (clamped to the image edges)
+	int luma_width = cx + 2;
+	int16_t * luma = malloc(sizeof(*luma) * luma_width * (cy + 2));
+	int16_t * abs_gx = malloc(sizeof(*abs_gx) * cx * 2);
+	assert(luma && abs_gx);
+	int16_t * abs_gy = abs_gx + cx;
+
+	for(int y = 0; y < cy + 2; ++y)
+	{
+		const unsigned char * src = image->data + (size_t)clamp_int(y0 + y - 1, 0, image->height - 1) * stride;
+		int16_t * dst = luma + y * luma_width;
+		for(int x = 0; x < luma_width; ++x)
+		{
+			const unsigned char * bgra = src + clamp_int(x0 + x - 1, 0, image->width - 1) * 4;
+			dst[x] = (bgra[0] * 29 + bgra[1] * 150 + bgra[2] * 77) >> 8;
+		}
+	}
+
+	tile->col_sums = calloc((size_t)(cy + 1) * cx, sizeof(*tile->col_sums));
+	tile->row_sums = malloc(sizeof(*tile->row_sums) * (size_t)cy * (cx + 1));
+	assert(tile->col_sums && tile->row_sums);
+
+	for(int y = 0; y < cy; ++y)
+	{
+		const int16_t * top = luma + y * luma_width;
+		sobel_row(top, top + luma_width, top + luma_width * 2, cx, abs_gx, abs_gy);
+
+		accumulate_row(tile->col_sums + (size_t)(y + 1) * cx, tile->col_sums + (size_t)y * cx, abs_gx, cx);
+
+		uint32_t * row_sums = tile->row_sums + (size_t)y * (cx + 1);
+		row_sums[0] = 0;
+		for(int x = 0; x < cx; ++x) row_sums[x + 1] = row_sums[x] + abs_gy[x];
+	}
+
+	free(abs_gx);
+	free(luma);
+	return tile;
+}
+
+// sum of |Gx| over column x, rows [y1, y2]
+static uint64_t column_strength(img_gradient_t * grad, int x, int y1, int y2)
+{
+	int tile_size = grad->tile_size;
+	int tile_x = x / tile_size;
+	int tx = x - tile_x * tile_size;
+	int cx = grad->image->width - tile_x * tile_size;
+	if(cx > tile_size) cx = tile_size;
+
+	uint64_t sum = 0;
+	for(int tile_y = y1 / tile_size; tile_y <= y2 / tile_size; ++tile_y)
+	{
+		int top = tile_y * tile_size;
+		int ty1 = ((y1 > top)?y1:top) - top;
+		int ty2 = ((y2 < top + tile_size - 1)?y2:(top + tile_size - 1)) - top;
+
+		const img_gradient_tile_t * tile = get_tile(grad, tile_x, tile_y);
+		sum += tile->col_sums[(size_t)(ty2 + 1) * cx + tx] - tile->col_sums[(size_t)ty1 * cx + tx];
+	}
+	return sum;
+}
+
+// sum of |Gy| over row y, columns [x1, x2]
+static uint64_t row_strength(img_gradient_t * grad, int y, int x1, int x2)
+{
+	int tile_size = grad->tile_size;
+	int tile_y = y / tile_size;
+	int ty = y - tile_y * tile_size;
+
+	uint64_t sum = 0;
+	for(int tile_x = x1 / tile_size; tile_x <= x2 / tile_size; ++tile_x)
+	{
+		int left = tile_x * tile_size;
+		int cx = grad->image->width - left;
+		if(cx > tile_size) cx = tile_size;
+		int tx1 = ((x1 > left)?x1:left) - left;
+		int tx2 = ((x2 < left + tile_size - 1)?x2:(left + tile_size - 1)) - left;
+
+		const img_gradient_tile_t * tile = get_tile(grad, tile_x, tile_y);
+		const uint32_t * row_sums = tile->row_sums + (size_t)ty * (cx + 1);
+		sum += row_sums[tx2 + 1] - row_sums[tx1];
+	}
+	return sum;
+}
+
+typedef uint64_t (* strength_func)(img_gradient_t * grad, int pos, int from, int to);
+static int snap(img_gradient_t * grad, strength_func strength, int pos, int size, int from, int to, int length,
+	int radius, int min_strength)
+{
+	if(from < 0) from = 0;
+	if(to > length - 1) to = length - 1;
+	if(from > to || radius <= 0) return pos;
+
+	int best = pos;
+	uint64_t best_strength = (uint64_t)min_strength * (to - from + 1);
+
+	// nearest candidates first: ties are resolved in favor of the smaller move
+	for(int distance = 0; distance <= radius; ++distance)
+	{
+		for(int sign = -1; sign <= 1; sign += 2)
+		{
+			int i = pos + sign * distance;
+			if(i < 0 || i >= size || (distance == 0 && sign > 0)) continue;
+
+			uint64_t value = strength(grad, i, from, to);
+			if(value > best_strength)
+			{
+				best = i;
+				best_strength = value;
+			}
+		}
+	}
+	return best;
+}
+
+int img_gradient_snap_x(img_gradient_t * grad, int x, int y1, int y2, int radius, int min_strength)
+{
+	assert(grad && grad->tiles);
+	return snap(grad, column_strength, x, grad->image->width, y1, y2, grad->image->height, radius, min_strength);
+}
+
+int img_gradient_snap_y(img_gradient_t * grad, int y, int x1, int x2, int radius, int min_strength)
+{
+	assert(grad && grad->tiles);
+	return snap(grad, row_strength, y, grad->image->height, x1, x2, grad->image->width, radius, min_strength);
+}
@@ -0,0 +1,308 @@
+/*
+ * img_gray16.c
+ *
+ * Copyright 2020 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <setjmp.h>
+
+#include <png.h>
+#include "img_proc.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+gray16_image_t * gray16_image_init(gray16_image_t * image, int width, int height, const uint16_t * image_data)
+{
+	if(width < 1 || height < 1) return NULL;
+
+	if(NULL == image) image = calloc(1, sizeof(*image));
+	assert(image);
+
+	size_t size = (size_t)width * height * sizeof(uint16_t);
+	uint16_t * data = realloc(image->data, size);
+	assert(data);
+
+	image->data = data;
+	image->width = width;
+	image->height = height;
+	image->stride = width;
+
+	if(image_data) memcpy(data, image_data, size);
+	return image;
+}
+
+void gray16_image_clear(gray16_image_t * image)
+{
+	if(NULL == image) return;
+	free(image->data);
+	memset(image, 0, sizeof(*image));
+	return;
+}
+
+/*
+ * gray16_image_load_png():
+ *   16-bit grayscale png only (8-bit images go through bgra_image_load_from_file),
+ *   the samples are kept as-is (host byte order).
+ */
+int gray16_image_load_png(gray16_image_t * image, const char * filename)
+{
+	assert(image && filename);
+	FILE * fp = fopen(filename, "rb");
+	if(NULL == fp) return -1;
+
+	unsigned char signature[8] = { 0 };
+	if(fread(signature, 1, sizeof(signature), fp) != sizeof(signature) || png_sig_cmp(signature, 0, sizeof(signature)))
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info = png ? png_create_info_struct(png) : NULL;
+	if(NULL == png || NULL == info)
+	{
+		png_destroy_read_struct(&png, &info, NULL);
+		fclose(fp);
+		return -1;
+	}
+
+	png_bytep * rows = NULL;
+	if(setjmp(png_jmpbuf(png)))
+	{
+		fprintf(stderr, "[WARNING]::%s(%s)::invalid png stream\n", __FUNCTION__, filename);
+		free(rows);
+		png_destroy_read_struct(&png, &info, NULL);
+		fclose(fp);
+		return -1;
+	}
+
+	png_init_io(png, fp);
+	png_set_sig_bytes(png, sizeof(signature));
+	png_read_info(png, info);
+
+	int width = png_get_image_width(png, info);
+	int height = png_get_image_height(png, info);
+	int bit_depth = png_get_bit_depth(png, info);
+	int color_type = png_get_color_type(png, info);
+	if(bit_depth != 16 || (color_type != PNG_COLOR_TYPE_GRAY && color_type != PNG_COLOR_TYPE_GRAY_ALPHA))
+	{
+		png_destroy_read_struct(&png, &info, NULL);
+		fclose(fp);
+		return -1;
+	}
+
+	if(color_type == PNG_COLOR_TYPE_GRAY_ALPHA) png_set_strip_alpha(png);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	png_set_swap(png);	// png samples are big-endian
+#endif
+	png_read_update_info(png, info);
+
+	gray16_image_t * p_image = gray16_image_init(image, width, height, NULL);
+	assert(p_image);
+
+	rows = malloc(sizeof(*rows) * height);
+	assert(rows);
+	for(int y = 0; y < height; ++y) rows[y] = (png_bytep)(image->data + (size_t)y * image->stride);
+	png_read_image(png, rows);
+	png_read_end(png, NULL);
+
+	free(rows);
+	png_destroy_read_struct(&png, &info, NULL);
+	fclose(fp);
+	return 0;
+}
+
+void gray16_image_get_range(const gray16_image_t * image, int * p_min, int * p_max)
+{
+	assert(image && image->data);
+	int stride = (image->stride > 0)?image->stride:image->width;
+	uint16_t min_value = 0xFFFF, max_value = 0;
+	for(int y = 0; y < image->height; ++y)
+	{
+		const uint16_t * row = image->data + (size_t)y * stride;
+		for(int x = 0; x < image->width; ++x)
+		{
+			if(row[x] < min_value) min_value = row[x];
+			if(row[x] > max_value) max_value = row[x];
+		}
+	}
+	if(p_min) *p_min = min_value;
+	if(p_max) *p_max = max_value;
+	return;
+}
+
+/*
+ * window / level mapping:
+ *   v = clamp(x - low, 0, range) * 255 / range,
+ *   computed as ((d << shift) * k) >> 16 so that the SSE2 (mulhi_epu16) and scalar paths are bit-exact.
+ *   A window starting below 0 (low < 0) is computed as d = min(x, limit) + bias, with bias = -low, 
+ *   limit = range - bias, which keeps every term unsigned 16-bit.
+ */
+static inline uint8_t map_sample(uint16_t x, uint16_t low, uint16_t limit, uint16_t bias, int shift, uint16_t k)
+{
+	unsigned int d = (x > low)?(x - low):0;
+	if(d > limit) d = limit;
+	d += bias;
+	return (uint8_t)(((d << shift) * (unsigned int)k) >> 16);
+}
+
+int gray16_image_to_bgra(const gray16_image_t * image, bgra_image_t * bgra, int window_center, int window_width)
+{
+	assert(image && image->data && bgra);
+	if(window_width < 1) window_width = 1;
+	if(window_width > 65535) window_width = 65535;
+
+	int low = window_center - window_width / 2;
+	int bias = 0;	// the part of the window below 0
+	if(low < 0)
+	{
+		bias = -low;
+		low = 0;
+		if(bias > window_width) bias = window_width;
+	}
+	if(low > 65535) low = 65535;
+
+	unsigned int range = window_width;
+	unsigned int limit = range - bias;
+	int shift = 0;
+	while((range << shift) < 256) ++shift;
+	unsigned int scaled_range = range << shift;
+	uint16_t k = (uint16_t)(((255u << 16) + scaled_range - 1) / scaled_range);
+
+	if(bgra->width != image->width || bgra->height != image->height || NULL == bgra->data)
+	{
+		bgra_image_t * p_bgra = bgra_image_init(bgra, image->width, image->height, NULL);
+		if(NULL == p_bgra) return -1;
+	}
+
+	int src_stride = (image->stride > 0)?image->stride:image->width;
+	int dst_stride = (bgra->stride > 0)?bgra->stride:(bgra->width * 4);
+	for(int y = 0; y < image->height; ++y)
+	{
+		const uint16_t * src = image->data + (size_t)y * src_stride;
+		uint32_t * dst = (uint32_t *)(bgra->data + (size_t)y * dst_stride);
+		int x = 0;
+#ifdef __SSE2__
+		__m128i v_low = _mm_set1_epi16((short)low);
+		__m128i v_limit = _mm_set1_epi16((short)limit);
+		__m128i v_bias = _mm_set1_epi16((short)bias);
+		__m128i v_k = _mm_set1_epi16((short)k);
+		__m128i v_shift = _mm_cvtsi32_si128(shift);
+		__m128i v_alpha = _mm_set1_epi32((int)0xFF000000);
+		for(; x + 8 <= image->width; x += 8)
+		{
+			__m128i d = _mm_subs_epu16(_mm_loadu_si128((const __m128i *)(src + x)), v_low);
+			d = _mm_sub_epi16(d, _mm_subs_epu16(d, v_limit));	// min(d, limit)
+			d = _mm_add_epi16(d, v_bias);	// <= range
+			d = _mm_mulhi_epu16(_mm_sll_epi16(d, v_shift), v_k);
+
+			__m128i v8 = _mm_packus_epi16(d, d);			// 8 x gray
+			__m128i v16 = _mm_unpacklo_epi8(v8, v8);		// 8 x (gray, gray)
+			__m128i lo = _mm_or_si128(_mm_unpacklo_epi16(v16, v16), v_alpha);
+			__m128i hi = _mm_or_si128(_mm_unpackhi_epi16(v16, v16), v_alpha);
+			_mm_storeu_si128((__m128i *)(dst + x), lo);
+			_mm_storeu_si128((__m128i *)(dst + x + 4), hi);
+		}
+#endif
+		for(; x < image->width; ++x)
+		{
+			uint32_t v = map_sample(src[x], low, limit, bias, shift, k);
+			dst[x] = 0xFF000000 | (v << 16) | (v << 8) | v;
+		}
+	}
+	return 0;
+}
+
+#if defined(_TEST_IMG_GRAY16) && defined(_STAND_ALONE)
+#include <math.h>
+
+static int reference_sample(uint16_t x, int window_center, int window_width)
+{
+	double low = window_center - window_width / 2;
+	double v = (x - low) * 255.0 / window_width;
+	if(v < 0) v = 0;
+	if(v > 255) v = 255;
+	return (int)v;
+}
+
+int main(int argc, char ** argv)
+{
+	// a ramp over the full range, then random samples; 67 columns: the last 3 take the scalar path
+	gray16_image_t image[1];
+	memset(image, 0, sizeof(image));
+	gray16_image_init(image, 67, 1200, NULL);
+	srand(12345);
+	for(int i = 0; i < image->width * image->height; ++i) {
+		image->data[i] = (i < 65536)?(uint16_t)i:(uint16_t)rand();
+	}
+	
+	// windows inside the range, crossing 0, crossing 65535, beyond both ends, and 1-sample wide
+	static const int s_windows[][2] = {	// { center, width }
+		{ 32768, 65535 }, { 1000, 20000 }, { 0, 1 }, { 0, 2 }, { 5, 11 }, { 100, 300 }, 
+		{ -20000, 100 }, { -5, 1000 }, { 65000, 2000 }, { 70000, 1000 }, { 30000, 1 }, { 12345, 255 }, { 12345, 257 },
+	};
+	bgra_image_t bgra[1];
+	memset(bgra, 0, sizeof(bgra));
+	for(size_t w = 0; w < sizeof(s_windows) / sizeof(s_windows[0]); ++w) {
+		int window_center = s_windows[w][0], window_width = s_windows[w][1];
+		int rc = gray16_image_to_bgra(image, bgra, window_center, window_width);
+		assert(0 == rc);
+		
+		for(int y = 0; y < image->height; ++y) {
+			const uint16_t * src = image->data + (size_t)y * image->stride;
+			const uint32_t * dst = (const uint32_t *)(bgra->data + (size_t)y * bgra->stride);
+			for(int x = 0; x < image->width; ++x) {
+				int v = dst[x] & 0xFF;
+				assert(dst[x] == (0xFF000000 | (v << 16) | (v << 8) | v));
+				
+				int expected = reference_sample(src[x], window_center, window_width);
+				if(abs(v - expected) > 1) {
+					fprintf(stderr, "[ERROR]: window (%d, %d): %d ==> %d, expected %d\n", 
+						window_center, window_width, src[x], v, expected);
+				}
+				assert(abs(v - expected) <= 1);
+			}
+		}
+	}
+	
+	// the case that mapped a window crossing 0 as [0, width]
+	gray16_image_t pixels[1];
+	memset(pixels, 0, sizeof(pixels));
+	uint16_t samples[2] = { 1000, 11000 };
+	gray16_image_init(pixels, 2, 1, samples);
+	gray16_image_to_bgra(pixels, bgra, 1000, 20000);
+	assert((((uint32_t *)bgra->data)[0] & 0xFF) == 127);
+	assert((((uint32_t *)bgra->data)[1] & 0xFF) == 255);
+	
+	gray16_image_clear(pixels);
+	gray16_image_clear(image);
+	free(bgra->data);
+	printf("%s: ok\n", argv[0]);
+	return 0;
+}
+#endif
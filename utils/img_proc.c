@@ -28,6 +28,10 @@
 #include <assert.h>
 
 #include "img_proc.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <cairo/cairo.h>
 
 bgra_image_t * bgra_image_init(bgra_image_t * image, int width, int height, const unsigned char * image_data)
@@ -65,6 +69,156 @@ void bgra_image_clear(bgra_image_t * image)
 	return;
 }
 
+/*
+ * bgra_image_resize(): area-average (box filter) downscale, upscaling is a nearest-neighbour copy.
+ *   the 4 channels of a pixel are summed in one register (SSE2), 32-bit per row,
+ *   64-bit over the rows: a box of any area does not overflow.
+ */
+static inline void sum_box(const unsigned char * data, int stride, int x0, int x1, int y0, int y1, uint64_t sums[static 4])
+{
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc_lo = _mm_setzero_si128();	// channels 0, 1
+	__m128i acc_hi = _mm_setzero_si128();	// channels 2, 3
+	for(int y = y0; y < y1; ++y)
+	{
+		const unsigned char * p = data + (size_t)y * stride + x0 * 4;
+		__m128i acc = _mm_setzero_si128();
+		int x = x0;
+		for(; x + 2 <= x1; x += 2, p += 8)
+		{
+			__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), zero);	// 2 pixels, 16-bit
+			acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+			acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+		}
+		if(x < x1)
+		{
+			uint32_t pixel;
+			memcpy(&pixel, p, 4);
+			__m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero);
+			acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+		}
+		acc_lo = _mm_add_epi64(acc_lo, _mm_unpacklo_epi32(acc, zero));
+		acc_hi = _mm_add_epi64(acc_hi, _mm_unpackhi_epi32(acc, zero));
+	}
+	_mm_storeu_si128((__m128i *)sums, acc_lo);
+	_mm_storeu_si128((__m128i *)(sums + 2), acc_hi);
+#else
+	sums[0] = sums[1] = sums[2] = sums[3] = 0;
+	for(int y = y0; y < y1; ++y)
+	{
+		const unsigned char * p = data + (size_t)y * stride + x0 * 4;
+		for(int x = x0; x < x1; ++x, p += 4)
+		{
+			sums[0] += p[0]; sums[1] += p[1]; sums[2] += p[2]; sums[3] += p[3];
+		}
+	}
+#endif
+}
+
+int bgra_image_resize(bgra_image_t * dst, const bgra_image_t * src, int width, int height)
+{
+	assert(dst && src && dst != src);
+	if(NULL == src->data || width < 1 || height < 1) return -1;
+	if(NULL == bgra_image_init(dst, width, height, NULL)) return -1;
+	
+	int src_stride = src->stride?src->stride:(src->width * 4);
+	int dst_stride = width * 4;
+	dst->stride = dst_stride;
+	
+	for(int y = 0; y < height; ++y)
+	{
+		int y0 = (int)((int64_t)y * src->height / height);
+		int y1 = (int)((int64_t)(y + 1) * src->height / height);
+		if(y1 <= y0) y1 = y0 + 1;
+		
+		unsigned char * dst_row = dst->data + y * dst_stride;
+		for(int x = 0; x < width; ++x)
+		{
+			int x0 = (int)((int64_t)x * src->width / width);
+			int x1 = (int)((int64_t)(x + 1) * src->width / width);
+			if(x1 <= x0) x1 = x0 + 1;
+			
+			uint64_t sums[4];
+			sum_box(src->data, src_stride, x0, x1, y0, y1, sums);
+			uint64_t count = (uint64_t)(x1 - x0) * (y1 - y0);
+			for(int c = 0; c < 4; ++c) dst_row[x * 4 + c] = (unsigned char)((sums[c] + count / 2) / count);
+		}
+	}
+	return 0;
+}
+
+/*
+ * bgra_image_letterbox(): fits src into a size x size square (aspect ratio kept),
+ *   the borders are filled with gray, box receives the placement.
+ */
+#define LETTERBOX_FILL	(114)
+int bgra_image_letterbox(bgra_image_t * dst, const bgra_image_t * src, int size, img_letterbox_t * box)
+{
+	assert(dst && src && box);
+	if(NULL == src->data || src->width < 1 || src->height < 1 || size < 1) return -1;
+	
+	img_letterbox_t placement = {
+		.size = size,
+		.width = size, .height = size,
+		.src_width = src->width, .src_height = src->height,
+	};
+	if(src->width >= src->height) placement.height = (int)(((int64_t)src->height * size + src->width / 2) / src->width);
+	else placement.width = (int)(((int64_t)src->width * size + src->height / 2) / src->height);
+	if(placement.width < 1) placement.width = 1;
+	if(placement.height < 1) placement.height = 1;
+	placement.pad_x = (size - placement.width) / 2;
+	placement.pad_y = (size - placement.height) / 2;
+	
+	bgra_image_t content[1];
+	memset(content, 0, sizeof(content));
+	int rc = bgra_image_resize(content, src, placement.width, placement.height);
+	if(rc) return rc;
+	
+	if(NULL == bgra_image_init(dst, size, size, NULL)) {
+		bgra_image_clear(content);
+		return -1;
+	}
+	dst->stride = size * 4;
+	
+	uint32_t fill = 0xff000000 | (LETTERBOX_FILL << 16) | (LETTERBOX_FILL << 8) | LETTERBOX_FILL;
+	uint32_t * pixels = (uint32_t *)dst->data;
+	for(int i = 0; i < size * size; ++i) pixels[i] = fill;
+	
+	for(int y = 0; y < placement.height; ++y)
+	{
+		memcpy(dst->data + (y + placement.pad_y) * dst->stride + placement.pad_x * 4,
+			content->data + y * content->stride,
+			placement.width * 4);
+	}
+	bgra_image_clear(content);
+	
+	*box = placement;
+	return 0;
+}
+
+/*
+ * img_letterbox_to_source(): normalized box of the letterboxed image ==> normalized box of the source image
+ */
+void img_letterbox_to_source(const img_letterbox_t * box, double * x, double * y, double * width, double * height)
+{
+	assert(box && box->width > 0 && box->height > 0);
+	double x1 = (*x * box->size - box->pad_x) / box->width;
+	double y1 = (*y * box->size - box->pad_y) / box->height;
+	double x2 = ((*x + *width) * box->size - box->pad_x) / box->width;
+	double y2 = ((*y + *height) * box->size - box->pad_y) / box->height;
+	
+	if(x1 < 0) x1 = 0; else if(x1 > 1) x1 = 1;
+	if(y1 < 0) y1 = 0; else if(y1 > 1) y1 = 1;
+	if(x2 < 0) x2 = 0; else if(x2 > 1) x2 = 1;
+	if(y2 < 0) y2 = 0; else if(y2 > 1) y2 = 1;
+	
+	*x = x1;
+	*y = y1;
+	*width = x2 - x1;
+	*height = y2 - y1;
+}
+
 
 
 #include <jpeglib.h>
@@ -152,6 +306,16 @@ int img_utils_get_jpeg_size(const unsigned char * jpeg, size_t length, int * p_w
 }
 
 int bgra_image_from_jpeg_stream(bgra_image_t * image, const unsigned char * jpeg, size_t length)
+{
+	return bgra_image_from_jpeg_stream_scaled(image, jpeg, length, 0, 0);
+}
+
+/*
+ * bgra_image_from_jpeg_stream_scaled():
+ *   decodes at 1/2, 1/4 or 1/8 of the size when the result is still at least min_width x min_height,
+ *   the IDCT does the downscale, most of the decoding work is skipped.
+ */
+int bgra_image_from_jpeg_stream_scaled(bgra_image_t * image, const unsigned char * jpeg, size_t length, int min_width, int min_height)
 {
 	int rc = -1;
 	struct jpeg_decompress_struct cinfo;
@@ -174,6 +338,18 @@ int bgra_image_from_jpeg_stream(bgra_image_t * image, const unsigned char * jpeg
 	
 	(void)jpeg_read_header(&cinfo, TRUE);
 	
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = 1;
+	if(min_width > 0 && min_height > 0)
+	{
+		while(cinfo.scale_denom < 8
+			&& cinfo.image_width / (cinfo.scale_denom * 2) >= (unsigned int)min_width
+			&& cinfo.image_height / (cinfo.scale_denom * 2) >= (unsigned int)min_height)
+		{
+			cinfo.scale_denom *= 2;
+		}
+	}
+	
 	cinfo.out_color_space = JCS_EXT_BGRA;
 	(void)jpeg_start_decompress(&cinfo);
 	
@@ -229,6 +405,73 @@ cairo_status_t on_read_png_stream(png_closure_t * closure, unsigned char * data,
 	return CAIRO_STATUS_SUCCESS;
 }
 
+/*
+ * img_jpeg_reader: the rows are decoded in order into the caller's buffer, a band at a time,
+ *   a large image is processed without holding all of its pixels.
+ *   libjpeg reports errors with longjmp(): every call sets its own return point.
+ */
+typedef struct jpeg_reader_priv
+{
+	struct jpeg_decompress_struct cinfo;
+	custom_jpeg_err_t jerr;
+}jpeg_reader_priv_t;
+
+int img_jpeg_reader_open(img_jpeg_reader_t * reader, const unsigned char * jpeg, size_t length)
+{
+	assert(reader);
+	memset(reader, 0, sizeof(*reader));
+	jpeg_reader_priv_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	
+	priv->cinfo.err = jpeg_std_error((struct jpeg_error_mgr *)&priv->jerr);
+	priv->jerr.base->error_exit = on_jpeg_decompress_error;
+	if(setjmp(priv->jerr.setjmp_buffer))
+	{
+		jpeg_destroy_decompress(&priv->cinfo);
+		free(priv);
+		return -1;
+	}
+	
+	jpeg_create_decompress(&priv->cinfo);
+	jpeg_mem_src(&priv->cinfo, jpeg, length);
+	(void)jpeg_read_header(&priv->cinfo, TRUE);
+	priv->cinfo.out_color_space = JCS_EXT_BGRA;
+	(void)jpeg_start_decompress(&priv->cinfo);
+	
+	reader->width = priv->cinfo.output_width;
+	reader->height = priv->cinfo.output_height;
+	reader->priv = priv;
+	return 0;
+}
+
+int img_jpeg_reader_read(img_jpeg_reader_t * reader, unsigned char * data, int stride, int num_rows)
+{
+	jpeg_reader_priv_t * priv = reader->priv;
+	if(NULL == priv) return -1;
+	if(setjmp(priv->jerr.setjmp_buffer))
+	{
+		return -1;
+	}
+	
+	int rows = 0;
+	while(rows < num_rows && priv->cinfo.output_scanline < priv->cinfo.output_height) {
+		JSAMPROW row_pointer[1] = { (JSAMPROW)(data + (size_t)rows * stride) };
+		if(jpeg_read_scanlines(&priv->cinfo, row_pointer, 1) != 1) return -1;
+		++rows;
+	}
+	reader->next_row += rows;
+	return rows;
+}
+
+void img_jpeg_reader_close(img_jpeg_reader_t * reader)
+{
+	jpeg_reader_priv_t * priv = reader->priv;
+	if(NULL == priv) return;
+	jpeg_destroy_decompress(&priv->cinfo);	// the remaining rows are not decoded
+	free(priv);
+	reader->priv = NULL;
+}
+
 int bgra_image_from_png_stream(bgra_image_t * image, const unsigned char * png, size_t length)
 {
 	int rc = -1;